@@ -0,0 +1,514 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logger.h"
+#include "config.h"
+#include "database.h"
+#include "disaggregation.h"
+#include "appliance_tracker.h"
+
+#define APPLIANCE_TRACKER_FLUSH_INTERVAL 60
+
+/* Estado de um aparelho, on_timestamp é zero quando está desligado */
+typedef struct appliance_state_s {
+	int appliance_id;
+	time_t on_timestamp;
+	double power;
+	
+	// Até onde a energia do intervalo aberto já foi contabilizada
+	time_t accounted_timestamp;
+} appliance_state_t;
+
+/* Energia atribuída a um aparelho em uma hora local, ainda não gravada no banco de dados */
+typedef struct appliance_hour_s {
+	int appliance_id;
+	int year;
+	int month;
+	int day;
+	int hour;
+	int on_seconds;
+	double active;
+	double cost;
+} appliance_hour_t;
+
+/* O rastreador é alimentado apenas pela thread de desagregação, o mutex protege as leituras da API */
+static pthread_mutex_t tracker_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static appliance_state_t *states = NULL;
+static int state_qty = 0;
+
+static appliance_hour_t *pending_hours = NULL;
+static int pending_hour_qty = 0;
+static int pending_hour_max = 0;
+
+static time_t last_flush_timestamp = 0;
+
+/* Até onde a energia de todos os aparelhos está contabilizada: a gravada no banco de dados antes de iniciar e a que
+ * está na fila. Ao reiniciar o buffer em memória é desagregado de novo, a energia até a marca gravada é ignorada. */
+static time_t stored_accounted_timestamp = 0;
+static time_t pending_accounted_timestamp = 0;
+
+/* Cria as tabelas de energia por aparelho e hora e do estado do rastreador, se ainda não existirem */
+int appliance_tracker_init() {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_create_table[] = "CREATE TABLE IF NOT EXISTS appliance_energy_hours(appliance_id INTEGER, year INTEGER, month INTEGER, day INTEGER, hour INTEGER,"
+									" on_seconds INTEGER, active REAL, cost REAL, PRIMARY KEY(appliance_id,year,month,day,hour));"
+									// A chave primária começa pelo aparelho, as consultas por período usam este índice
+									"CREATE INDEX IF NOT EXISTS appliance_energy_hours_time ON appliance_energy_hours(year,month,day,hour);"
+									"CREATE TABLE IF NOT EXISTS appliance_tracker_state(id INTEGER PRIMARY KEY CHECK(id = 1), accounted_timestamp INTEGER);";
+	const char sql_get_state[] = "SELECT accounted_timestamp FROM appliance_tracker_state WHERE id = 1;";
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = sqlite3_exec(db_conn, sql_create_table, NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to create appliance energy table: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_state, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		stored_accounted_timestamp = sqlite3_column_int64(ppstmt, 0);
+		pending_accounted_timestamp = stored_accounted_timestamp;
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_ROW && result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get appliance tracker state: %s", sqlite3_errstr(result));
+		return -1;
+	}
+	
+	return 0;
+}
+
+static appliance_state_t *get_state(int appliance_id) {
+	appliance_state_t *new_states;
+	
+	for(int i = 0; i < state_qty; i++) {
+		if(states[i].appliance_id == appliance_id)
+			return &states[i];
+	}
+	
+	if((new_states = (appliance_state_t*) realloc(states, sizeof(appliance_state_t) * (state_qty + 1))) == NULL)
+		return NULL;
+	
+	states = new_states;
+	
+	memset(&states[state_qty], 0, sizeof(appliance_state_t));
+	states[state_qty].appliance_id = appliance_id;
+	
+	return &states[state_qty++];
+}
+
+/* Soma a energia na entrada pendente do mesmo aparelho e hora, criando a entrada se ainda não existir */
+static int pending_merge(const appliance_hour_t *hour) {
+	appliance_hour_t *new_hours;
+	appliance_hour_t *entry = NULL;
+	
+	for(int i = pending_hour_qty - 1; i >= 0; i--) {
+		if(pending_hours[i].appliance_id == hour->appliance_id && pending_hours[i].hour == hour->hour && pending_hours[i].day == hour->day
+			&& pending_hours[i].month == hour->month && pending_hours[i].year == hour->year) {
+			entry = &pending_hours[i];
+			break;
+		}
+	}
+	
+	if(entry == NULL) {
+		if(pending_hour_qty == pending_hour_max) {
+			if((new_hours = (appliance_hour_t*) realloc(pending_hours, sizeof(appliance_hour_t) * MAX(16, pending_hour_max * 2))) == NULL) {
+				LOG_ERROR("Failed to allocate memory for appliance energy.");
+				return -1;
+			}
+			
+			pending_hours = new_hours;
+			pending_hour_max = MAX(16, pending_hour_max * 2);
+		}
+		
+		entry = &pending_hours[pending_hour_qty++];
+		
+		memcpy(entry, hour, sizeof(appliance_hour_t));
+		
+		return 0;
+	}
+	
+	entry->on_seconds += hour->on_seconds;
+	entry->active += hour->active;
+	entry->cost += hour->cost;
+	
+	return 0;
+}
+
+static void pending_add(int appliance_id, const struct tm *hour_tm, int seconds, double active, double cost) {
+	appliance_hour_t hour;
+	
+	hour.appliance_id = appliance_id;
+	hour.year = hour_tm->tm_year + 1900;
+	hour.month = hour_tm->tm_mon + 1;
+	hour.day = hour_tm->tm_mday;
+	hour.hour = hour_tm->tm_hour;
+	hour.on_seconds = seconds;
+	hour.active = active;
+	hour.cost = cost;
+	
+	pending_merge(&hour);
+}
+
+/* Devolve para a fila as horas de uma gravação que falhou, somadas à energia acumulada durante a tentativa */
+static void requeue_hours(const appliance_hour_t *hours, int hour_qty) {
+	pthread_mutex_lock(&tracker_mutex);
+	
+	for(int i = 0; i < hour_qty; i++)
+		pending_merge(&hours[i]);
+	
+	pthread_mutex_unlock(&tracker_mutex);
+}
+
+/* Atribui ao aparelho a energia do intervalo aberto até timestamp, dividida pelas horas locais */
+static void account_energy(appliance_state_t *state, time_t timestamp) {
+	double kwh_rate;
+	time_t segment_start, segment_end;
+	struct tm hour_tm, next_tm;
+	
+	if(state->on_timestamp == 0)
+		return;
+	
+	// A energia até a marca gravada já está no banco de dados
+	if(state->accounted_timestamp < stored_accounted_timestamp)
+		state->accounted_timestamp = MIN(timestamp, stored_accounted_timestamp);
+	
+	if(timestamp <= state->accounted_timestamp)
+		return;
+	
+	kwh_rate = config_get_value_double("kwh_rate", 0, 10, 0);
+	
+	for(segment_start = state->accounted_timestamp; segment_start < timestamp; segment_start = segment_end) {
+		double active;
+		
+		localtime_r(&segment_start, &hour_tm);
+		
+		memcpy(&next_tm, &hour_tm, sizeof(struct tm));
+		next_tm.tm_min = 0;
+		next_tm.tm_sec = 0;
+		next_tm.tm_hour += 1;
+		next_tm.tm_isdst = -1;
+		
+		segment_end = MIN(timestamp, mktime(&next_tm));
+		
+		// Proteção contra horas que não avançam em transições de horário de verão
+		if(segment_end <= segment_start)
+			segment_end = MIN(timestamp, segment_start + 3600 - (segment_start % 3600));
+		
+		// Energia ativa em kWh, como em energy_hours
+		active = state->power * (segment_end - segment_start) / (3600.0 * 1000.0);
+		
+		pending_add(state->appliance_id, &hour_tm, segment_end - segment_start, active, active * kwh_rate);
+	}
+	
+	state->accounted_timestamp = timestamp;
+}
+
+/* Processa um evento classificado: ligamento abre (ou atualiza) o intervalo do aparelho e desligamento o fecha */
+void appliance_tracker_feed(const load_event_t *load_event) {
+	appliance_state_t *state;
+	
+	if(load_event == NULL || load_event->top_appliance_id <= 0)
+		return;
+	
+	pthread_mutex_lock(&tracker_mutex);
+	
+	if((state = get_state(load_event->top_appliance_id)) == NULL) {
+		pthread_mutex_unlock(&tracker_mutex);
+		return;
+	}
+	
+	account_energy(state, load_event->timestamp);
+	
+	if(load_event->delta_pt > 0.0) {
+		// Um novo ligamento com o aparelho já ligado é tratado como mudança de patamar
+		if(state->on_timestamp == 0) {
+			state->on_timestamp = load_event->timestamp;
+			state->accounted_timestamp = load_event->timestamp;
+		}
+		
+		state->power = load_event->delta_pt;
+	} else if(state->on_timestamp) {
+		state->on_timestamp = 0;
+		state->power = 0.0;
+	} else {
+		LOG_DEBUG("Ignoring off event at %ld for appliance %d, which was not on.", load_event->timestamp, load_event->top_appliance_id);
+	}
+	
+	pthread_mutex_unlock(&tracker_mutex);
+}
+
+/* Contabiliza os intervalos abertos até timestamp (horário da última amostra processada), fechando os que excederam
+ * o tempo máximo (desligamento não detectado), e grava a energia acumulada periodicamente. */
+void appliance_tracker_update(time_t timestamp) {
+	int max_on_time;
+	int flush = 0;
+	
+	max_on_time = config_get_value_int("appliance_max_on_hours", 1, 168, 24) * 3600;
+	
+	pthread_mutex_lock(&tracker_mutex);
+	
+	for(int i = 0; i < state_qty; i++) {
+		if(states[i].on_timestamp == 0)
+			continue;
+		
+		if(timestamp - states[i].on_timestamp > max_on_time) {
+			account_energy(&states[i], states[i].on_timestamp + max_on_time);
+			
+			LOG_WARN("Appliance %d on for more than %d hours, closing its interval.", states[i].appliance_id, max_on_time / 3600);
+			states[i].on_timestamp = 0;
+			states[i].power = 0.0;
+		} else {
+			account_energy(&states[i], timestamp);
+		}
+	}
+	
+	// Todos os intervalos abertos estão contabilizados até aqui
+	pending_accounted_timestamp = MAX(pending_accounted_timestamp, timestamp);
+	
+	if(last_flush_timestamp == 0)
+		last_flush_timestamp = timestamp;
+	
+	if(timestamp - last_flush_timestamp >= APPLIANCE_TRACKER_FLUSH_INTERVAL) {
+		last_flush_timestamp = timestamp;
+		flush = 1;
+	}
+	
+	pthread_mutex_unlock(&tracker_mutex);
+	
+	if(flush)
+		appliance_tracker_flush();
+}
+
+/* Grava a energia pendente em appliance_energy_hours e a marca de até onde ela foi contabilizada, em uma única
+ * transação, de maneira que a energia não seja somada duas vezes ao reiniciar. Em caso de falha a energia volta para a fila. */
+int appliance_tracker_flush() {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_store_state[] = "INSERT INTO appliance_tracker_state(id,accounted_timestamp) VALUES(1,?1)"
+									" ON CONFLICT(id) DO UPDATE SET accounted_timestamp = MAX(accounted_timestamp, excluded.accounted_timestamp);";
+	const char sql_store_hour[] = "INSERT INTO appliance_energy_hours(appliance_id,year,month,day,hour,on_seconds,active,cost) VALUES(?1,?2,?3,?4,?5,?6,?7,?8)"
+									" ON CONFLICT(appliance_id,year,month,day,hour) DO UPDATE SET on_seconds = on_seconds + excluded.on_seconds, active = active + excluded.active, cost = cost + excluded.cost;";
+	appliance_hour_t *hours;
+	int hour_qty;
+	time_t accounted_timestamp;
+	
+	pthread_mutex_lock(&tracker_mutex);
+	
+	hours = pending_hours;
+	hour_qty = pending_hour_qty;
+	accounted_timestamp = pending_accounted_timestamp;
+	
+	pending_hours = NULL;
+	pending_hour_qty = 0;
+	pending_hour_max = 0;
+	
+	pthread_mutex_unlock(&tracker_mutex);
+	
+	if(hour_qty == 0) {
+		free(hours);
+		return 0;
+	}
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		requeue_hours(hours, hour_qty);
+		free(hours);
+		
+		return -1;
+	}
+	
+	if((result = sqlite3_exec(db_conn, "BEGIN TRANSACTION", NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to begin SQL transaction: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		requeue_hours(hours, hour_qty);
+		free(hours);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_store_hour, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(db_conn);
+		requeue_hours(hours, hour_qty);
+		free(hours);
+		
+		return -1;
+	}
+	
+	for(int i = 0; i < hour_qty; i++) {
+		// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
+		result = sqlite3_bind_int(ppstmt, 1, hours[i].appliance_id);
+		result += sqlite3_bind_int(ppstmt, 2, hours[i].year);
+		result += sqlite3_bind_int(ppstmt, 3, hours[i].month);
+		result += sqlite3_bind_int(ppstmt, 4, hours[i].day);
+		result += sqlite3_bind_int(ppstmt, 5, hours[i].hour);
+		result += sqlite3_bind_int(ppstmt, 6, hours[i].on_seconds);
+		result += sqlite3_bind_double(ppstmt, 7, hours[i].active);
+		result += sqlite3_bind_double(ppstmt, 8, hours[i].cost);
+		
+		if(result || (result = sqlite3_step(ppstmt)) != SQLITE_DONE) {
+			LOG_ERROR("Failed to store appliance energy: %s", sqlite3_errstr(result));
+			database_finalize(ppstmt);
+			sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+			database_close(db_conn);
+			requeue_hours(hours, hour_qty);
+			free(hours);
+			
+			return -1;
+		}
+		
+		sqlite3_reset(ppstmt);
+	}
+	
+	database_finalize(ppstmt);
+	
+	if((result = database_prepare(db_conn, sql_store_state, &ppstmt)) != SQLITE_OK || (result = sqlite3_bind_int64(ppstmt, 1, accounted_timestamp)) != SQLITE_OK
+		|| (result = sqlite3_step(ppstmt)) != SQLITE_DONE) {
+		LOG_ERROR("Failed to store appliance tracker state: %s", sqlite3_errstr(result));
+		database_finalize(ppstmt);
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(db_conn);
+		requeue_hours(hours, hour_qty);
+		free(hours);
+		
+		return -1;
+	}
+	
+	database_finalize(ppstmt);
+	
+	if((result = sqlite3_exec(db_conn, "COMMIT", NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to commit SQL transaction: %s", sqlite3_errstr(result));
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(db_conn);
+		requeue_hours(hours, hour_qty);
+		free(hours);
+		
+		return -1;
+	}
+	
+	database_close(db_conn);
+	free(hours);
+	
+	return hour_qty;
+}
+
+/* Copia os intervalos abertos (aparelhos ligados) para o buffer */
+int appliance_tracker_get_intervals(appliance_interval_t *buffer, int buffer_len) {
+	int output_count = 0;
+	
+	if(buffer == NULL)
+		return -1;
+	
+	pthread_mutex_lock(&tracker_mutex);
+	
+	for(int i = 0; i < state_qty && output_count < buffer_len; i++) {
+		if(states[i].on_timestamp == 0)
+			continue;
+		
+		buffer[output_count].appliance_id = states[i].appliance_id;
+		buffer[output_count].on_timestamp = states[i].on_timestamp;
+		buffer[output_count].power = states[i].power;
+		output_count++;
+	}
+	
+	pthread_mutex_unlock(&tracker_mutex);
+	
+	return output_count;
+}
+
+/* Soma a energia atribuída a cada aparelho nas horas locais que começam em [timestamp_start, timestamp_end) */
+int appliance_energy_get(time_t timestamp_start, time_t timestamp_end, appliance_energy_t *buffer, int buffer_len) {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_energy[] = "SELECT appliance_id,SUM(on_seconds),SUM(active),SUM(cost) FROM appliance_energy_hours"
+									" WHERE (year,month,day,hour) >= (?1,?2,?3,?4) AND (year,month,day,hour) <= (?5,?6,?7,?8)"
+									" GROUP BY appliance_id ORDER BY appliance_id;";
+	struct tm start_tm, end_tm;
+	int output_count = 0;
+	
+	if(buffer == NULL)
+		return -1;
+	
+	// A hora que contém o início é incluída e a que contém o fim também, se o fim não estiver no início de uma hora
+	localtime_r(&timestamp_start, &start_tm);
+	timestamp_end -= 1;
+	localtime_r(&timestamp_end, &end_tm);
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_energy, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
+	result = sqlite3_bind_int(ppstmt, 1, start_tm.tm_year + 1900);
+	result += sqlite3_bind_int(ppstmt, 2, start_tm.tm_mon + 1);
+	result += sqlite3_bind_int(ppstmt, 3, start_tm.tm_mday);
+	result += sqlite3_bind_int(ppstmt, 4, start_tm.tm_hour);
+	result += sqlite3_bind_int(ppstmt, 5, end_tm.tm_year + 1900);
+	result += sqlite3_bind_int(ppstmt, 6, end_tm.tm_mon + 1);
+	result += sqlite3_bind_int(ppstmt, 7, end_tm.tm_mday);
+	result += sqlite3_bind_int(ppstmt, 8, end_tm.tm_hour);
+	
+	if(result) {
+		LOG_ERROR("Failed to bind value to prepared statement.");
+		database_finalize(ppstmt);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW && output_count < buffer_len) {
+		buffer[output_count].appliance_id = sqlite3_column_int(ppstmt, 0);
+		buffer[output_count].on_seconds = sqlite3_column_int(ppstmt, 1);
+		buffer[output_count].active = sqlite3_column_double(ppstmt, 2);
+		buffer[output_count].cost = sqlite3_column_double(ppstmt, 3);
+		output_count++;
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_DONE && result != SQLITE_ROW) {
+		LOG_ERROR("Failed to get appliance energy: %s", sqlite3_errstr(result));
+		return -1;
+	}
+	
+	return output_count;
+}
@@ -0,0 +1,31 @@
+#ifndef APPLIANCE_TRACKER_H
+#define APPLIANCE_TRACKER_H
+
+#include <time.h>
+
+#include "disaggregation.h"
+
+#define APPLIANCE_TRACKER_MAX_APPLIANCES 256
+
+/* Intervalo aberto de um aparelho ligado */
+typedef struct appliance_interval_s {
+	int appliance_id;
+	time_t on_timestamp;
+	double power;
+} appliance_interval_t;
+
+typedef struct appliance_energy_s {
+	int appliance_id;
+	int on_seconds;
+	double active;
+	double cost;
+} appliance_energy_t;
+
+int appliance_tracker_init();
+void appliance_tracker_feed(const load_event_t *load_event);
+void appliance_tracker_update(time_t timestamp);
+int appliance_tracker_flush();
+int appliance_tracker_get_intervals(appliance_interval_t *buffer, int buffer_len);
+int appliance_energy_get(time_t timestamp_start, time_t timestamp_end, appliance_energy_t *buffer, int buffer_len);
+
+#endif
@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logger.h"
+#include "database.h"
+#include "power.h"
+#include "archive.h"
+
+#define ARCHIVE_MAX_THREADS 64
+#define ARCHIVE_LOOKAHEAD_PER_THREAD 4
+
+typedef struct archive_job_s {
+	time_t first_day;
+	int day_qty;
+	time_t timestamp_start;
+	time_t timestamp_end;
+	
+	archive_day_process_func_t process_func;
+	void *arg;
+	
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	
+	int next_day;
+	int consumed_qty;
+	int lookahead;
+	int abort;
+	
+	int *done;
+	void **results;
+} archive_job_t;
+
+/* Interpreta um intervalo de datas locais no formato "AAAA-MM-DD:AAAA-MM-DD" (ou apenas uma data), o intervalo
+ * resultante vai da meia-noite do primeiro dia até a meia-noite do dia seguinte ao último. */
+int archive_parse_date_range(const char *range_str, time_t *timestamp_start, time_t *timestamp_end) {
+	struct tm start_tm, end_tm;
+	const char *end_str;
+	
+	if(range_str == NULL || timestamp_start == NULL || timestamp_end == NULL)
+		return -1;
+	
+	memset(&start_tm, 0, sizeof(struct tm));
+	
+	if((end_str = strptime(range_str, "%Y-%m-%d", &start_tm)) == NULL)
+		return -1;
+	
+	if(*end_str == ':') {
+		memset(&end_tm, 0, sizeof(struct tm));
+		
+		if((end_str = strptime(end_str + 1, "%Y-%m-%d", &end_tm)) == NULL || *end_str != '\0')
+			return -1;
+	} else if(*end_str == '\0') {
+		memcpy(&end_tm, &start_tm, sizeof(struct tm));
+	} else {
+		return -1;
+	}
+	
+	start_tm.tm_isdst = -1;
+	end_tm.tm_isdst = -1;
+	end_tm.tm_mday += 1;
+	
+	*timestamp_start = mktime(&start_tm);
+	*timestamp_end = mktime(&end_tm);
+	
+	if(*timestamp_start < 0 || *timestamp_end <= *timestamp_start)
+		return -1;
+	
+	return 0;
+}
+
+int archive_default_thread_qty() {
+	long cpu_qty = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	if(cpu_qty < 1)
+		return 1;
+	
+	return (int) MIN(cpu_qty, ARCHIVE_MAX_THREADS);
+}
+
+static void *archive_worker(void *argp) {
+	archive_job_t *job = (archive_job_t*) argp;
+	char filename[32];
+	power_data_t *data;
+	time_t day_start;
+	void *result;
+	int index;
+	int count;
+	int status;
+	
+	pthread_mutex_lock(&job->mutex);
+	
+	while(!job->abort && job->next_day < job->day_qty) {
+		/* Limita quantos dias podem ficar prontos à frente do consumidor, para manter o uso de memória constante */
+		if(job->next_day >= job->consumed_qty + job->lookahead) {
+			pthread_cond_wait(&job->cond, &job->mutex);
+			continue;
+		}
+		
+		index = job->next_day++;
+		
+		pthread_mutex_unlock(&job->mutex);
+		
+		day_start = job->first_day + (time_t) index * 24 * 3600;
+		generate_pd_filename(day_start, filename, sizeof(filename));
+		
+		result = NULL;
+		status = 1;
+		
+		/* Um arquivo que existe mas não pôde ser lido ou processado não pode ser tratado como um dia sem dados,
+		 * já que o consumidor substitui os dados do dia pelo resultado */
+		if(access(filename, F_OK) == 0) {
+			count = read_power_data_file(filename, MAX(job->timestamp_start, day_start), MIN(job->timestamp_end, day_start + 24 * 3600), &data);
+			
+			if(count >= 0) {
+				if((result = job->process_func(day_start, data, count, job->arg)) == NULL)
+					status = -1;
+				
+				free(data);
+			} else {
+				LOG_ERROR("Failed to read power data file \"%s\".", filename);
+				status = -1;
+			}
+		} else {
+			LOG_DEBUG("Power data file \"%s\" does not exist, skipping.", filename);
+		}
+		
+		pthread_mutex_lock(&job->mutex);
+		
+		job->results[index] = result;
+		job->done[index] = status;
+		
+		pthread_cond_broadcast(&job->cond);
+	}
+	
+	pthread_mutex_unlock(&job->mutex);
+	
+	return NULL;
+}
+
+/* Processa os arquivos pd-*.csv que cobrem o intervalo [timestamp_start, timestamp_end) usando thread_qty threads,
+ * cada uma processando um dia inteiro por vez. Os resultados são consumidos em ordem na thread chamadora, o que
+ * permite que o consumidor escreva no banco de dados sem precisar de sincronização. Os resultados devem ser
+ * alocados com um único malloc, pois os que não forem consumidos (em caso de interrupção) são liberados com free. */
+int archive_process_days(time_t timestamp_start, time_t timestamp_end, int thread_qty,
+							archive_day_process_func_t process_func, archive_day_consume_func_t consume_func, void *arg) {
+	archive_job_t job;
+	pthread_t threads[ARCHIVE_MAX_THREADS];
+	int started_threads = 0;
+	int result = 0;
+	time_t last_day;
+	
+	if(process_func == NULL || consume_func == NULL || timestamp_end <= timestamp_start)
+		return -1;
+	
+	thread_qty = MAX(1, MIN(thread_qty, ARCHIVE_MAX_THREADS));
+	
+	/* Os arquivos são divididos por dia em UTC */
+	job.first_day = timestamp_start - (timestamp_start % (24 * 3600));
+	last_day = (timestamp_end - 1) - ((timestamp_end - 1) % (24 * 3600));
+	job.day_qty = 1 + (last_day - job.first_day) / (24 * 3600);
+	
+	job.timestamp_start = timestamp_start;
+	job.timestamp_end = timestamp_end;
+	job.process_func = process_func;
+	job.arg = arg;
+	job.next_day = 0;
+	job.consumed_qty = 0;
+	job.lookahead = thread_qty * ARCHIVE_LOOKAHEAD_PER_THREAD;
+	job.abort = 0;
+	
+	job.done = (int*) calloc(job.day_qty, sizeof(int));
+	job.results = (void**) calloc(job.day_qty, sizeof(void*));
+	
+	if(job.done == NULL || job.results == NULL) {
+		free(job.done);
+		free(job.results);
+		
+		return -2;
+	}
+	
+	pthread_mutex_init(&job.mutex, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	
+	LOG_INFO("Processing %d days of power data using %d threads.", job.day_qty, thread_qty);
+	
+	for(int i = 0; i < thread_qty; i++) {
+		if(pthread_create(&threads[started_threads], NULL, archive_worker, &job) == 0)
+			started_threads++;
+	}
+	
+	if(started_threads == 0) {
+		LOG_ERROR("Failed to start archive processing threads.");
+		result = -3;
+		job.abort = 1;
+	}
+	
+	for(int index = 0; index < job.day_qty && !job.abort; index++) {
+		void *day_result;
+		
+		pthread_mutex_lock(&job.mutex);
+		
+		while(!job.done[index])
+			pthread_cond_wait(&job.cond, &job.mutex);
+		
+		day_result = job.results[index];
+		job.results[index] = NULL;
+		
+		pthread_mutex_unlock(&job.mutex);
+		
+		if(job.done[index] < 0) {
+			LOG_ERROR("Failed to process power data of day starting at %ld, stopping.", job.first_day + (time_t) index * 24 * 3600);
+			result = -5;
+			
+			pthread_mutex_lock(&job.mutex);
+			job.abort = 1;
+			pthread_mutex_unlock(&job.mutex);
+		} else if(consume_func(job.first_day + (time_t) index * 24 * 3600, day_result, arg)) {
+			result = -4;
+			
+			pthread_mutex_lock(&job.mutex);
+			job.abort = 1;
+			pthread_mutex_unlock(&job.mutex);
+		}
+		
+		pthread_mutex_lock(&job.mutex);
+		
+		job.consumed_qty++;
+		
+		pthread_cond_broadcast(&job.cond);
+		pthread_mutex_unlock(&job.mutex);
+	}
+	
+	for(int i = 0; i < started_threads; i++)
+		pthread_join(threads[i], NULL);
+	
+	for(int index = 0; index < job.day_qty; index++)
+		free(job.results[index]);
+	
+	pthread_cond_destroy(&job.cond);
+	pthread_mutex_destroy(&job.mutex);
+	
+	free(job.done);
+	free(job.results);
+	
+	return result;
+}
@@ -0,0 +1,22 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <time.h>
+
+#include "power.h"
+
+/* Processa os dados de um dia de arquivo, executada em uma das threads de trabalho. O resultado retornado é
+ * entregue para archive_day_consume_func_t na thread que chamou archive_process_days(), NULL indica falha. */
+typedef void *(*archive_day_process_func_t)(time_t day_start, const power_data_t *data, int count, void *arg);
+
+/* Consome o resultado de um dia, chamada na ordem dos dias e sempre na thread que chamou archive_process_days().
+ * O resultado é NULL somente quando o arquivo do dia não existe, se a leitura ou o processamento falhar a função não é
+ * chamada e o processamento é interrompido. Retornar um valor diferente de zero interrompe o processamento. */
+typedef int (*archive_day_consume_func_t)(time_t day_start, void *result, void *arg);
+
+int archive_parse_date_range(const char *range_str, time_t *timestamp_start, time_t *timestamp_end);
+int archive_default_thread_qty();
+int archive_process_days(time_t timestamp_start, time_t timestamp_end, int thread_qty,
+							archive_day_process_func_t process_func, archive_day_consume_func_t consume_func, void *arg);
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <openssl/evp.h>
 #include <uuid/uuid.h>
@@ -11,6 +12,219 @@
 
 #define SESSION_KEY_DURATION_HOURS 8
 
+#define SESSION_CACHE_BUCKETS 64
+#define SESSION_CACHE_MAX_QTY 1024
+// Tempo máximo que uma sessão fica em cache sem ser conferida novamente no banco de dados
+#define SESSION_CACHE_TTL 300
+
+/* Sessão válida de um usuário ativo, com a permissão de administrador lida junto com a sessão.
+ * Cada sessão fica em duas listas: a do hash da chave e a do usuário. */
+typedef struct session_entry_s {
+	char key[UUID_STR_LEN];
+	int user_id;
+	int is_admin;
+	time_t valid_thru;
+	time_t cached_until;
+	
+	struct session_entry_s *next;
+	struct session_entry_s *next_user;
+} session_entry_t;
+
+static pthread_rwlock_t session_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static session_entry_t *session_cache[SESSION_CACHE_BUCKETS];
+static session_entry_t *session_user_cache[SESSION_CACHE_BUCKETS];
+static int session_cache_qty = 0;
+
+// Incrementado a cada remoção, evita guardar uma sessão lida do banco de dados antes de ser removida
+static unsigned long session_cache_generation = 0;
+
+static unsigned int session_bucket(const char *key) {
+	unsigned int hash = 5381;
+	
+	while(*key)
+		hash = hash * 33 + (unsigned char) *key++;
+	
+	return hash % SESSION_CACHE_BUCKETS;
+}
+
+static unsigned int session_user_bucket(int user_id) {
+	return (unsigned int) user_id % SESSION_CACHE_BUCKETS;
+}
+
+static int session_entry_valid(const session_entry_t *entry, time_t now) {
+	return entry->valid_thru >= now && entry->cached_until >= now;
+}
+
+/* Retorna o usuário da sessão, 0 se a chave não está em cache ou precisa ser conferida novamente */
+static int session_cache_get(const char *key, time_t now) {
+	session_entry_t *entry;
+	int user_id = 0;
+	
+	pthread_rwlock_rdlock(&session_cache_lock);
+	
+	for(entry = session_cache[session_bucket(key)]; entry != NULL; entry = entry->next) {
+		if(strcmp(entry->key, key) == 0) {
+			if(session_entry_valid(entry, now))
+				user_id = entry->user_id;
+			
+			break;
+		}
+	}
+	
+	pthread_rwlock_unlock(&session_cache_lock);
+	
+	return user_id;
+}
+
+/* Desfaz as ligações da sessão nas duas listas e libera a memória, deve ser chamada com session_cache_lock travado para escrita */
+static void session_cache_remove_locked(session_entry_t *entry) {
+	session_entry_t **entry_ptr;
+	
+	for(entry_ptr = &session_cache[session_bucket(entry->key)]; *entry_ptr != NULL; entry_ptr = &(*entry_ptr)->next) {
+		if(*entry_ptr == entry) {
+			*entry_ptr = entry->next;
+			break;
+		}
+	}
+	
+	for(entry_ptr = &session_user_cache[session_user_bucket(entry->user_id)]; *entry_ptr != NULL; entry_ptr = &(*entry_ptr)->next_user) {
+		if(*entry_ptr == entry) {
+			*entry_ptr = entry->next_user;
+			break;
+		}
+	}
+	
+	free(entry);
+	session_cache_qty--;
+}
+
+static unsigned long session_cache_get_generation() {
+	unsigned long generation;
+	
+	pthread_rwlock_rdlock(&session_cache_lock);
+	generation = session_cache_generation;
+	pthread_rwlock_unlock(&session_cache_lock);
+	
+	return generation;
+}
+
+static void session_cache_remove_key(const char *key) {
+	session_entry_t *entry;
+	
+	pthread_rwlock_wrlock(&session_cache_lock);
+	
+	session_cache_generation++;
+	
+	for(entry = session_cache[session_bucket(key)]; entry != NULL; entry = entry->next) {
+		if(strcmp(entry->key, key) == 0) {
+			session_cache_remove_locked(entry);
+			break;
+		}
+	}
+	
+	pthread_rwlock_unlock(&session_cache_lock);
+}
+
+/* Remove do cache as sessões do usuário */
+static void session_cache_remove_user(int user_id) {
+	session_entry_t *entry, *next_entry;
+	
+	pthread_rwlock_wrlock(&session_cache_lock);
+	
+	session_cache_generation++;
+	
+	for(entry = session_user_cache[session_user_bucket(user_id)]; entry != NULL; entry = next_entry) {
+		next_entry = entry->next_user;
+		
+		if(entry->user_id == user_id)
+			session_cache_remove_locked(entry);
+	}
+	
+	pthread_rwlock_unlock(&session_cache_lock);
+}
+
+static void session_cache_put(const char *key, int user_id, int is_admin, time_t valid_thru, time_t now, unsigned long generation) {
+	session_entry_t *entry, *next_entry;
+	unsigned int bucket, user_bucket;
+	
+	if(strlen(key) >= UUID_STR_LEN)
+		return;
+	
+	pthread_rwlock_wrlock(&session_cache_lock);
+	
+	if(generation != session_cache_generation) {
+		pthread_rwlock_unlock(&session_cache_lock);
+		return;
+	}
+	
+	/* Com o cache cheio remove as sessões que precisam ser conferidas novamente, se ainda assim não houver
+	 * espaço a nova sessão continua sendo conferida no banco de dados */
+	if(session_cache_qty >= SESSION_CACHE_MAX_QTY) {
+		for(int b = 0; b < SESSION_CACHE_BUCKETS; b++) {
+			for(entry = session_cache[b]; entry != NULL; entry = next_entry) {
+				next_entry = entry->next;
+				
+				if(!session_entry_valid(entry, now))
+					session_cache_remove_locked(entry);
+			}
+		}
+	}
+	
+	bucket = session_bucket(key);
+	user_bucket = session_user_bucket(user_id);
+	
+	for(entry = session_cache[bucket]; entry != NULL; entry = entry->next) {
+		if(strcmp(entry->key, key) == 0) {
+			session_cache_remove_locked(entry);
+			break;
+		}
+	}
+	
+	if(session_cache_qty < SESSION_CACHE_MAX_QTY && (entry = (session_entry_t*) malloc(sizeof(session_entry_t))) != NULL) {
+		strcpy(entry->key, key);
+		entry->user_id = user_id;
+		entry->is_admin = is_admin;
+		entry->valid_thru = valid_thru;
+		entry->cached_until = now + SESSION_CACHE_TTL;
+		
+		entry->next = session_cache[bucket];
+		session_cache[bucket] = entry;
+		
+		entry->next_user = session_user_cache[user_bucket];
+		session_user_cache[user_bucket] = entry;
+		
+		session_cache_qty++;
+	}
+	
+	pthread_rwlock_unlock(&session_cache_lock);
+}
+
+/* Chamada quando os dados do usuário mudam (desativação, permissões ou senha), as sessões são lidas novamente do banco de dados */
+void auth_invalidate_user_sessions(int user_id) {
+	if(user_id > 0)
+		session_cache_remove_user(user_id);
+}
+
+/* Retorna a permissão de administrador de um usuário com sessão em cache ou -1 se o usuário não foi encontrado */
+int auth_get_cached_admin(int user_id) {
+	session_entry_t *entry;
+	time_t now = time(NULL);
+	int is_admin = -1;
+	
+	pthread_rwlock_rdlock(&session_cache_lock);
+	
+	for(entry = session_user_cache[session_user_bucket(user_id)]; entry != NULL; entry = entry->next_user) {
+		if(entry->user_id == user_id && session_entry_valid(entry, now)) {
+			is_admin = entry->is_admin;
+			break;
+		}
+	}
+	
+	pthread_rwlock_unlock(&session_cache_lock);
+	
+	return is_admin;
+}
+
 char *auth_hash_password(const char *salt, const char *password) {
 	EVP_MD_CTX *mdctx = NULL;
 	unsigned char md_result[EVP_MAX_MD_SIZE];
@@ -50,44 +264,52 @@ int auth_verify_key(const char *key) {
 	int result;
 	sqlite3 *db_conn = NULL;
 	sqlite3_stmt *ppstmt = NULL;
-	const char sql_verify_key[] = "SELECT user_id FROM sessions INNER JOIN users ON users.id = sessions.user_id WHERE key=?1 AND valid_thru>=?2 AND users.is_active = 1;";
-	int user_id = 0;
+	const char sql_verify_key[] = "SELECT user_id,valid_thru,users.is_admin FROM sessions INNER JOIN users ON users.id = sessions.user_id WHERE key=?1 AND valid_thru>=?2 AND users.is_active = 1;";
+	time_t now = time(NULL), valid_thru = 0;
+	int user_id = 0, is_admin = 0;
+	unsigned long generation;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((user_id = session_cache_get(key, now)) > 0)
+		return user_id;
+	
+	generation = session_cache_get_generation();
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_verify_key, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_verify_key, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
 	result = sqlite3_bind_text(ppstmt, 1, key, -1, SQLITE_STATIC);
-	result += sqlite3_bind_int64(ppstmt, 2, time(NULL));
+	result += sqlite3_bind_int64(ppstmt, 2, now);
 	
 	if(result) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	do {
-		if((result = sqlite3_step(ppstmt)) == SQLITE_ROW)
+		if((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
 			user_id = sqlite3_column_int(ppstmt, 0);
+			valid_thru = sqlite3_column_int64(ppstmt, 1);
+			is_admin = sqlite3_column_int(ppstmt, 2);
+		}
 	} while (result == SQLITE_ROW);
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to check authentication key: %s", sqlite3_errstr(result));
@@ -95,6 +317,9 @@ int auth_verify_key(const char *key) {
 		return -2;
 	}
 	
+	if(user_id > 0)
+		session_cache_put(key, user_id, is_admin, valid_thru, now, generation);
+	
 	return user_id;
 }
 
@@ -107,26 +332,24 @@ int auth_user_login(const char *username, const char *password) {
 	int user_id = 0;
 	char *salt = NULL, *correct_hash = NULL, *hash;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_find_user, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_find_user, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if((result = sqlite3_bind_text(ppstmt, 1, username, -1, SQLITE_STATIC)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -147,8 +370,8 @@ int auth_user_login(const char *username, const char *password) {
 		result = sqlite3_step(ppstmt);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to check user login: %s", sqlite3_errstr(result));
@@ -183,18 +406,16 @@ char *auth_new_session(int user_id) {
 	char session_key[UUID_STR_LEN];
 	time_t session_valid_thru;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return NULL;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_insert_session, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_insert_session, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return NULL;
 	}
@@ -212,25 +433,25 @@ char *auth_new_session(int user_id) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return NULL;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to create new user session: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return NULL;
 	}
 	
 	// Deleta as sessões expiradas e as sessões excedentes
-	if((result = sqlite3_prepare_v2(db_conn, sql_delete_sessions, -1, &ppstmt, NULL)) == SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_delete_sessions, &ppstmt)) == SQLITE_OK) {
 		
 		result = sqlite3_bind_int64(ppstmt, 1, time(NULL));
 		result += sqlite3_bind_int(ppstmt, 2, user_id);
@@ -242,12 +463,15 @@ char *auth_new_session(int user_id) {
 			LOG_ERROR("Failed to bind values to user session cleaning query.");
 		}
 		
-		sqlite3_finalize(ppstmt);
+		database_finalize(ppstmt);
 	} else {
 		LOG_ERROR("Failed to prepare SQL statement for cleaning user sessions: %s", sqlite3_errstr(result));
 	}
 	
-	sqlite3_close(db_conn);
+	database_close(db_conn);
+	
+	// As sessões excedentes do usuário podem ter sido removidas do banco de dados
+	session_cache_remove_user(user_id);
 	
 	return strdup(session_key);
 }
@@ -261,42 +485,47 @@ int auth_delete_session(const char *session_key) {
 	if(session_key == NULL)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	// Removida do cache antes do banco de dados, para que a chave deixe de ser aceita mesmo se a remoção falhar
+	session_cache_remove_key(session_key);
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_delete_session, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_delete_session, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if(sqlite3_bind_text(ppstmt, 1, session_key, -1, SQLITE_STATIC) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
+	
+	/* Um auth_verify_key() concorrente pode ter lido a linha antes do DELETE e colocado a sessão de volta no cache
+	 * com a geração já incrementada, então ela é removida de novo depois que o DELETE terminou */
+	session_cache_remove_key(session_key);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to delete session: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_close(db_conn);
+	database_close(db_conn);
 	
 	return 0;
 }
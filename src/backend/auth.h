@@ -4,3 +4,5 @@ int auth_verify_key(const char *key);
 int auth_user_login(const char *username, const char *password);
 char *auth_new_session(int user_id);
 int auth_delete_session(const char *session_key);
+void auth_invalidate_user_sessions(int user_id);
+int auth_get_cached_admin(int user_id);
@@ -0,0 +1,1509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <svm.h>
+#include <openssl/evp.h>
+
+#include "common.h"
+#include "logger.h"
+#include "config.h"
+#include "database.h"
+#include "disaggregation.h"
+#include "archive.h"
+#include "classifier.h"
+
+#define CLASSIFIER_MODEL_FILENAME "classifier.model"
+#define CLASSIFIER_FILE_MAGIC "MWCM"
+#define CLASSIFIER_FILE_FORMAT 3
+#define CLASSIFIER_TRAINING_WAIT_TIMEOUT 1000
+
+/* Grade de busca dos parâmetros, em potências de 2: C de 2^-5 a 2^15 e gamma de 2^-15 a 2^3 */
+#define CLASSIFIER_GRID_C_LOG2_MIN -5
+#define CLASSIFIER_GRID_C_QTY 11
+#define CLASSIFIER_GRID_GAMMA_LOG2_MIN -15
+#define CLASSIFIER_GRID_GAMMA_QTY 10
+#define CLASSIFIER_GRID_LOG2_STEP 2
+#define CLASSIFIER_GRID_MAX_THREADS 64
+
+/* Modelo de um tipo de evento (ligamento ou desligamento), imutável depois de publicado */
+typedef struct classifier_model_s {
+	struct svm_model *svm_model;
+	struct svm_node *node_space;
+	
+	// Modelos carregados do arquivo apontam para a região mapeada, que pertence ao conjunto de modelos
+	int mapped;
+	
+	int feature_qty;
+	double feature_min[SVM_PARAM_QTY_ON];
+	double feature_max[SVM_PARAM_QTY_ON];
+	
+	int class_qty;
+	int *labels;
+	
+	// Com apenas um aparelho não é possível treinar o SVM
+	int single_label;
+	
+	int sample_qty;
+	double c;
+	
+	// Acurácia da validação cruzada dos parâmetros escolhidos, negativa se não foi avaliada
+	double cv_accuracy;
+	
+	/* Com a redução do conjunto de treinamento, quantidade de assinaturas antes da redução e acurácia do modelo
+	 * sobre todas elas (negativa se não houve redução) */
+	int full_sample_qty;
+	double full_accuracy;
+	double training_time;
+	
+	// Tempo apenas do treinamento final do SVM, sem a busca em grade (não é salvo no arquivo)
+	double fit_time;
+} classifier_model_t;
+
+typedef struct classifier_params_s {
+	int max_signatures;
+	int grid_search;
+	double c;
+	double gamma;
+	
+	// Compara o modelo reduzido com um sem redução depois de cada treinamento, não faz parte do hash
+	int compare_reduction;
+} classifier_params_t;
+
+/* Busca em grade, as tarefas são combinações de (C, gamma) e partição da validação cruzada, distribuídas entre as threads */
+typedef struct grid_search_s {
+	const struct svm_problem *problem;
+	const int *sample_folds;
+	const volatile int *terminate;
+	
+	pthread_mutex_t mutex;
+	int next_task;
+	int task_qty;
+	int completed_qty;
+	int *correct_counts;
+} grid_search_t;
+
+/* Conjunto de modelos publicado, liberado quando a última referência for devolvida */
+typedef struct classifier_models_s {
+	int refcount;
+	int version;
+	unsigned char hash[CLASSIFIER_HASH_SIZE];
+	
+	classifier_model_t *on;
+	classifier_model_t *off;
+	
+	void *map;
+	size_t map_size;
+} classifier_models_t;
+
+/* Formato do arquivo: cabeçalho, seguido de dois modelos (ligamento e desligamento), cada um com seu cabeçalho
+ * seguido dos vetores do SVM. Todos os blocos têm tamanho múltiplo de 8 bytes para manter o alinhamento. */
+typedef struct classifier_file_header_s {
+	char magic[4];
+	uint32_t format;
+	uint32_t version;
+	uint32_t model_qty;
+	unsigned char hash[CLASSIFIER_HASH_SIZE];
+} classifier_file_header_t;
+
+typedef struct classifier_file_model_s {
+	int32_t present;
+	int32_t feature_qty;
+	int32_t single_label;
+	int32_t class_qty;
+	int32_t sv_qty;
+	int32_t svm_type;
+	int32_t kernel_type;
+	int32_t degree;
+	double gamma;
+	double coef0;
+	double feature_min[SVM_PARAM_QTY_ON];
+	double feature_max[SVM_PARAM_QTY_ON];
+	double c;
+	double cv_accuracy;
+	double full_accuracy;
+	double training_time;
+	int32_t sample_qty;
+	int32_t full_sample_qty;
+} classifier_file_model_t;
+
+/* Protege a troca do conjunto publicado e os contadores de referência, nunca é mantido durante o treinamento */
+static pthread_mutex_t models_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t models_cond = PTHREAD_COND_INITIALIZER;
+static classifier_models_t *current_models = NULL;
+
+static pthread_mutex_t training_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t training_cond = PTHREAD_COND_INITIALIZER;
+static int training_requested = 0;
+static int training_running = 0;
+
+static void svm_print_string_f(const char *s) {
+	LOG_DEBUG(s);
+}
+
+/* Eventos de ligamento usam as variações de potência ativa e reativa de cada fase mais o pico de potência, e os de
+ * desligamento apenas as variações, com o sinal invertido para ficarem no mesmo domínio. Retorna a quantidade de parâmetros. */
+int classifier_extract_features(double delta_pt, double peak_pt, const double *delta_p, const double *delta_q, double *features) {
+	if(delta_pt > 0.0) {
+		features[0] = delta_p[0];
+		features[1] = delta_p[1];
+		features[2] = delta_q[0];
+		features[3] = delta_q[1];
+		features[4] = peak_pt;
+		
+		return SVM_PARAM_QTY_ON;
+	}
+	
+	features[0] = -delta_p[0];
+	features[1] = -delta_p[1];
+	features[2] = -delta_q[0];
+	features[3] = -delta_q[1];
+	
+	return SVM_PARAM_QTY_OFF;
+}
+
+/* Carrega as assinaturas dos aparelhos ativos, o buffer retornado deve ser liberado com free(). */
+int classifier_load_signatures(load_signature_t **signatures_ptr) {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_signatures[] = "SELECT appliance_id,delta_pt,peak_pt,delta_pa,delta_pb,delta_sa,delta_sb,delta_qa,delta_qb FROM signatures"
+										" INNER JOIN appliances ON appliances.id = signatures.appliance_id WHERE appliances.is_active ORDER BY signatures.timestamp;";
+	load_signature_t *signatures = NULL;
+	load_signature_t *new_signatures;
+	int signature_qty = 0;
+	int signature_max = 0;
+	
+	if(signatures_ptr == NULL)
+		return -1;
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_signatures, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		load_signature_t *signature;
+		
+		if(signature_qty == signature_max) {
+			signature_max = (signature_max) ? (signature_max * 2) : 256;
+			
+			if((new_signatures = (load_signature_t*) realloc(signatures, sizeof(load_signature_t) * signature_max)) == NULL) {
+				LOG_ERROR("Failed to allocate memory for load signatures.");
+				result = SQLITE_NOMEM;
+				break;
+			}
+			
+			signatures = new_signatures;
+		}
+		
+		signature = &signatures[signature_qty++];
+		
+		signature->appliance_id = sqlite3_column_int(ppstmt, 0);
+		signature->delta_pt = sqlite3_column_double(ppstmt, 1);
+		signature->peak_pt = sqlite3_column_double(ppstmt, 2);
+		signature->delta_p[0] = sqlite3_column_double(ppstmt, 3);
+		signature->delta_p[1] = sqlite3_column_double(ppstmt, 4);
+		signature->delta_s[0] = sqlite3_column_double(ppstmt, 5);
+		signature->delta_s[1] = sqlite3_column_double(ppstmt, 6);
+		signature->delta_q[0] = sqlite3_column_double(ppstmt, 7);
+		signature->delta_q[1] = sqlite3_column_double(ppstmt, 8);
+		
+		classifier_extract_features(signature->delta_pt, signature->peak_pt, signature->delta_p, signature->delta_q, signature->features);
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to load appliance signatures: %s", sqlite3_errstr(result));
+		free(signatures);
+		
+		return -1;
+	}
+	
+	*signatures_ptr = signatures;
+	
+	return signature_qty;
+}
+
+static void model_destroy(classifier_model_t *model) {
+	if(model == NULL)
+		return;
+	
+	if(model->mapped && model->svm_model) {
+		free(model->svm_model->SV);
+		free(model->svm_model->sv_coef);
+		free(model->svm_model);
+	} else {
+		svm_free_and_destroy_model(&model->svm_model);
+	}
+	
+	free(model->node_space);
+	free(model->labels);
+	free(model);
+}
+
+/* Escala um parâmetro para o intervalo [-1, 1] de acordo com os limites encontrados no treinamento */
+static double model_scale(const classifier_model_t *model, int index, double value) {
+	if(model->feature_max[index] <= model->feature_min[index])
+		return 0.0;
+	
+	return -1.0 + 2.0 * (value - model->feature_min[index]) / (model->feature_max[index] - model->feature_min[index]);
+}
+
+static void svm_parameters_init(struct svm_parameter *parameters, double c, double gamma, int probability) {
+	memset(parameters, 0, sizeof(struct svm_parameter));
+	
+	parameters->svm_type = C_SVC;
+	parameters->kernel_type = RBF;
+	parameters->C = c;
+	parameters->gamma = gamma;
+	parameters->cache_size = 32;
+	parameters->eps = 0.001;
+	parameters->shrinking = 1;
+	parameters->probability = probability;
+}
+
+static double grid_c_value(int combination) {
+	return pow(2, CLASSIFIER_GRID_C_LOG2_MIN + (combination / CLASSIFIER_GRID_GAMMA_QTY) * CLASSIFIER_GRID_LOG2_STEP);
+}
+
+static double grid_gamma_value(int combination) {
+	return pow(2, CLASSIFIER_GRID_GAMMA_LOG2_MIN + (combination % CLASSIFIER_GRID_GAMMA_QTY) * CLASSIFIER_GRID_LOG2_STEP);
+}
+
+static void *grid_search_worker(void *argp) {
+	grid_search_t *search = (grid_search_t*) argp;
+	const struct svm_problem *problem = search->problem;
+	struct svm_problem fold_problem;
+	struct svm_parameter parameters;
+	struct svm_model *svm_model;
+	int task, combination, fold;
+	int correct_count;
+	
+	fold_problem.y = (double*) malloc(sizeof(double) * problem->l);
+	fold_problem.x = (struct svm_node**) malloc(sizeof(struct svm_node*) * problem->l);
+	
+	if(fold_problem.y == NULL || fold_problem.x == NULL) {
+		free(fold_problem.y);
+		free(fold_problem.x);
+		
+		return NULL;
+	}
+	
+	pthread_mutex_lock(&search->mutex);
+	
+	while(search->next_task < search->task_qty && !(*search->terminate)) {
+		task = search->next_task++;
+		
+		pthread_mutex_unlock(&search->mutex);
+		
+		combination = task / SVM_CROSSV_FOLD_NUM;
+		fold = task % SVM_CROSSV_FOLD_NUM;
+		
+		/* Os vetores das partições apontam para a mesma matriz de parâmetros já escalados, nada é copiado */
+		fold_problem.l = 0;
+		
+		for(int i = 0; i < problem->l; i++) {
+			if(search->sample_folds[i] == fold)
+				continue;
+			
+			fold_problem.y[fold_problem.l] = problem->y[i];
+			fold_problem.x[fold_problem.l] = problem->x[i];
+			fold_problem.l++;
+		}
+		
+		svm_parameters_init(&parameters, grid_c_value(combination), grid_gamma_value(combination), 0);
+		
+		correct_count = 0;
+		
+		if((svm_model = svm_train(&fold_problem, &parameters)) != NULL) {
+			for(int i = 0; i < problem->l; i++) {
+				if(search->sample_folds[i] == fold && svm_predict(svm_model, problem->x[i]) == problem->y[i])
+					correct_count++;
+			}
+			
+			svm_free_and_destroy_model(&svm_model);
+		}
+		
+		pthread_mutex_lock(&search->mutex);
+		
+		search->correct_counts[combination] += correct_count;
+		search->completed_qty++;
+	}
+	
+	pthread_mutex_unlock(&search->mutex);
+	
+	free(fold_problem.y);
+	free(fold_problem.x);
+	
+	return NULL;
+}
+
+static const double *sort_labels;
+
+static int sample_label_compare(const void *a, const void *b) {
+	int index_a = *((const int*) a);
+	int index_b = *((const int*) b);
+	
+	if(sort_labels[index_a] != sort_labels[index_b])
+		return (sort_labels[index_a] < sort_labels[index_b]) ? -1 : 1;
+	
+	return index_a - index_b;
+}
+
+/* Distribui as amostras entre as partições de forma estratificada: ordenadas por aparelho, são atribuídas em rodízio */
+static int grid_search_assign_folds(const struct svm_problem *problem, int *sample_folds) {
+	static pthread_mutex_t sort_mutex = PTHREAD_MUTEX_INITIALIZER;
+	int *order;
+	
+	if((order = (int*) malloc(sizeof(int) * problem->l)) == NULL)
+		return -1;
+	
+	for(int i = 0; i < problem->l; i++)
+		order[i] = i;
+	
+	// qsort não recebe contexto, os rótulos são passados por uma variável estática
+	pthread_mutex_lock(&sort_mutex);
+	
+	sort_labels = problem->y;
+	qsort(order, problem->l, sizeof(int), sample_label_compare);
+	
+	pthread_mutex_unlock(&sort_mutex);
+	
+	for(int i = 0; i < problem->l; i++)
+		sample_folds[order[i]] = i % SVM_CROSSV_FOLD_NUM;
+	
+	free(order);
+	
+	return 0;
+}
+
+/* Avalia toda a grade de (C, gamma) com validação cruzada em paralelo, usando a thread chamadora e mais thread_qty - 1
+ * threads. Retorna o índice da melhor combinação, ou negativo em caso de falha ou interrupção. */
+static int grid_search(const struct svm_problem *problem, const volatile int *terminate, double *accuracy) {
+	grid_search_t search;
+	pthread_t threads[CLASSIFIER_GRID_MAX_THREADS];
+	int started_threads = 0;
+	int thread_qty;
+	int *sample_folds;
+	int best_combination = -1;
+	
+	if((sample_folds = (int*) malloc(sizeof(int) * problem->l)) == NULL)
+		return -1;
+	
+	if(grid_search_assign_folds(problem, sample_folds)) {
+		free(sample_folds);
+		return -1;
+	}
+	
+	search.problem = problem;
+	search.sample_folds = sample_folds;
+	search.terminate = terminate;
+	search.next_task = 0;
+	search.task_qty = CLASSIFIER_GRID_C_QTY * CLASSIFIER_GRID_GAMMA_QTY * SVM_CROSSV_FOLD_NUM;
+	search.completed_qty = 0;
+	
+	if((search.correct_counts = (int*) calloc(CLASSIFIER_GRID_C_QTY * CLASSIFIER_GRID_GAMMA_QTY, sizeof(int))) == NULL) {
+		free(sample_folds);
+		return -1;
+	}
+	
+	pthread_mutex_init(&search.mutex, NULL);
+	
+	thread_qty = MIN(archive_default_thread_qty(), CLASSIFIER_GRID_MAX_THREADS);
+	
+	for(int i = 0; i < thread_qty - 1; i++) {
+		if(pthread_create(&threads[started_threads], NULL, grid_search_worker, &search) == 0)
+			started_threads++;
+	}
+	
+	grid_search_worker(&search);
+	
+	for(int i = 0; i < started_threads; i++)
+		pthread_join(threads[i], NULL);
+	
+	/* Em caso de empate fica a combinação com menor C, que tende a generalizar melhor */
+	if(search.completed_qty == search.task_qty) {
+		for(int i = 0; i < CLASSIFIER_GRID_C_QTY * CLASSIFIER_GRID_GAMMA_QTY; i++) {
+			if(best_combination < 0 || search.correct_counts[i] > search.correct_counts[best_combination])
+				best_combination = i;
+		}
+		
+		*accuracy = (double) search.correct_counts[best_combination] / problem->l;
+	}
+	
+	pthread_mutex_destroy(&search.mutex);
+	
+	free(search.correct_counts);
+	free(sample_folds);
+	
+	return best_combination;
+}
+
+/* Treina o modelo com as assinaturas do tipo de evento indicado (on diferente de zero para ligamento). Com a busca em
+ * grade ativada os parâmetros são escolhidos por validação cruzada, caso contrário são usados os configurados. */
+static classifier_model_t *model_train(const load_signature_t *signatures, int signature_qty, int on, const classifier_params_t *params, const volatile int *terminate) {
+	classifier_model_t *model;
+	struct svm_problem problem;
+	struct svm_parameter parameters;
+	const char *error_msg;
+	int sample_qty = 0;
+	int first_label = 0;
+	int best_combination = -1;
+	double gamma;
+	struct timespec time_start, time_end;
+	
+	if((model = (classifier_model_t*) calloc(1, sizeof(classifier_model_t))) == NULL)
+		return NULL;
+	
+	model->feature_qty = (on) ? SVM_PARAM_QTY_ON : SVM_PARAM_QTY_OFF;
+	
+	for(int f = 0; f < model->feature_qty; f++) {
+		model->feature_min[f] = DBL_MAX;
+		model->feature_max[f] = -DBL_MAX;
+	}
+	
+	model->single_label = -1;
+	model->cv_accuracy = -1.0;
+	
+	for(int i = 0; i < signature_qty; i++) {
+		if((signatures[i].delta_pt > 0.0) != (on != 0))
+			continue;
+		
+		if(sample_qty++ == 0)
+			first_label = signatures[i].appliance_id;
+		else if(signatures[i].appliance_id != first_label)
+			first_label = -1;
+		
+		for(int f = 0; f < model->feature_qty; f++) {
+			model->feature_min[f] = MIN(model->feature_min[f], signatures[i].features[f]);
+			model->feature_max[f] = MAX(model->feature_max[f], signatures[i].features[f]);
+		}
+	}
+	
+	if(sample_qty == 0) {
+		model_destroy(model);
+		return NULL;
+	}
+	
+	model->sample_qty = sample_qty;
+	
+	if(first_label > 0) {
+		model->single_label = first_label;
+		return model;
+	}
+	
+	problem.l = sample_qty;
+	problem.y = (double*) malloc(sizeof(double) * sample_qty);
+	problem.x = (struct svm_node**) malloc(sizeof(struct svm_node*) * sample_qty);
+	
+	/* Os vetores de suporte do modelo apontam para node_space, que deve existir enquanto o modelo existir.
+	 * A mesma matriz, já escalada, é compartilhada por todas as partições da busca em grade. */
+	model->node_space = (struct svm_node*) malloc(sizeof(struct svm_node) * sample_qty * (model->feature_qty + 1));
+	
+	if(problem.y == NULL || problem.x == NULL || model->node_space == NULL) {
+		free(problem.y);
+		free(problem.x);
+		model_destroy(model);
+		
+		return NULL;
+	}
+	
+	for(int i = 0, n = 0; i < signature_qty; i++) {
+		struct svm_node *nodes;
+		
+		if((signatures[i].delta_pt > 0.0) != (on != 0))
+			continue;
+		
+		nodes = &model->node_space[n * (model->feature_qty + 1)];
+		
+		for(int f = 0; f < model->feature_qty; f++) {
+			nodes[f].index = f + 1;
+			nodes[f].value = model_scale(model, f, signatures[i].features[f]);
+		}
+		
+		nodes[model->feature_qty].index = -1;
+		
+		problem.y[n] = signatures[i].appliance_id;
+		problem.x[n] = nodes;
+		n++;
+	}
+	
+	if(params->grid_search && sample_qty >= SVM_CROSSV_FOLD_NUM) {
+		if((best_combination = grid_search(&problem, terminate, &model->cv_accuracy)) < 0 && !(*terminate))
+			LOG_WARN("Grid search failed for %s model, using configured parameters.", (on) ? "on" : "off");
+	}
+	
+	if(*terminate) {
+		free(problem.y);
+		free(problem.x);
+		model_destroy(model);
+		
+		return NULL;
+	}
+	
+	if(best_combination >= 0) {
+		model->c = grid_c_value(best_combination);
+		gamma = grid_gamma_value(best_combination);
+		
+		LOG_INFO("Best parameters for %s model: C = %g, gamma = %g (cross-validation accuracy: %.1lf%%).", (on) ? "on" : "off", model->c, gamma, model->cv_accuracy * 100.0);
+	} else {
+		model->c = params->c;
+		gamma = (params->gamma > 0) ? params->gamma : (1.0 / model->feature_qty);
+	}
+	
+	svm_parameters_init(&parameters, model->c, gamma, 1);
+	
+	if((error_msg = svm_check_parameter(&problem, &parameters)) != NULL) {
+		LOG_ERROR("Invalid SVM parameters: %s", error_msg);
+		free(problem.y);
+		free(problem.x);
+		model_destroy(model);
+		
+		return NULL;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &time_start);
+	
+	model->svm_model = svm_train(&problem, &parameters);
+	
+	clock_gettime(CLOCK_MONOTONIC, &time_end);
+	
+	model->fit_time = (time_end.tv_sec - time_start.tv_sec) + (time_end.tv_nsec - time_start.tv_nsec) / 1e9;
+	
+	free(problem.y);
+	free(problem.x);
+	
+	if(model->svm_model == NULL) {
+		model_destroy(model);
+		return NULL;
+	}
+	
+	model->class_qty = svm_get_nr_class(model->svm_model);
+	model->labels = (int*) malloc(sizeof(int) * model->class_qty);
+	
+	if(model->labels == NULL) {
+		model_destroy(model);
+		return NULL;
+	}
+	
+	svm_get_labels(model->svm_model, model->labels);
+	
+	return model;
+}
+
+/* Fração das assinaturas do tipo de evento do modelo que ele classifica corretamente */
+static double model_evaluate(const classifier_model_t *model, const load_signature_t *signatures, int signature_qty, int on) {
+	struct svm_node nodes[SVM_PARAM_QTY_ON + 1];
+	int sample_qty = 0, correct_count = 0;
+	int label;
+	
+	for(int i = 0; i < signature_qty; i++) {
+		if((signatures[i].delta_pt > 0.0) != (on != 0))
+			continue;
+		
+		sample_qty++;
+		
+		if(model->single_label > 0) {
+			label = model->single_label;
+		} else {
+			for(int f = 0; f < model->feature_qty; f++) {
+				nodes[f].index = f + 1;
+				nodes[f].value = model_scale(model, f, signatures[i].features[f]);
+			}
+			
+			nodes[model->feature_qty].index = -1;
+			
+			label = (int) svm_predict(model->svm_model, nodes);
+		}
+		
+		if(label == signatures[i].appliance_id)
+			correct_count++;
+	}
+	
+	return (sample_qty) ? ((double) correct_count / sample_qty) : -1.0;
+}
+
+/* Treina com o conjunto (possivelmente reduzido) training_signatures, medindo o tempo de treinamento e, se houve
+ * redução, a acurácia sobre todas as assinaturas, para avaliar o impacto da redução */
+static classifier_model_t *model_build(const load_signature_t *signatures, int signature_qty, const load_signature_t *training_signatures, int training_qty,
+										int on, const classifier_params_t *params, const volatile int *terminate) {
+	classifier_model_t *model;
+	struct timespec time_start, time_end;
+	
+	clock_gettime(CLOCK_MONOTONIC, &time_start);
+	
+	if((model = model_train(training_signatures, training_qty, on, params, terminate)) == NULL)
+		return NULL;
+	
+	clock_gettime(CLOCK_MONOTONIC, &time_end);
+	
+	model->training_time = (time_end.tv_sec - time_start.tv_sec) + (time_end.tv_nsec - time_start.tv_nsec) / 1e9;
+	model->full_sample_qty = 0;
+	model->full_accuracy = -1.0;
+	
+	for(int i = 0; i < signature_qty; i++) {
+		if((signatures[i].delta_pt > 0.0) == (on != 0))
+			model->full_sample_qty++;
+	}
+	
+	if(model->full_sample_qty > model->sample_qty) {
+		model->full_accuracy = model_evaluate(model, signatures, signature_qty, on);
+		
+		LOG_INFO("Trained %s model in %.2lf s with %d of %d signatures (accuracy on all signatures: %.1lf%%).", (on) ? "on" : "off",
+					model->training_time, model->sample_qty, model->full_sample_qty, model->full_accuracy * 100.0);
+	} else {
+		LOG_INFO("Trained %s model in %.2lf s with %d signatures.", (on) ? "on" : "off", model->training_time, model->sample_qty);
+	}
+	
+	return model;
+}
+
+static void classifier_get_params(classifier_params_t *params) {
+	// Zero desativa a redução do conjunto de treinamento
+	params->max_signatures = config_get_value_int("svm_max_signatures_per_appliance", 0, 100000, 100);
+	
+	params->grid_search = config_get_value_int("svm_grid_search", 0, 1, 1);
+	
+	// Usados apenas quando a busca em grade está desativada
+	params->c = config_get_value_double("svm_c", 0.001, 100000, 100);
+	
+	// Zero indica o padrão do libsvm, 1 / quantidade de parâmetros
+	params->gamma = config_get_value_double("svm_gamma", 0, 1000, 0);
+	
+	// Custa SVM_CROSSV_FOLD_NUM treinamentos com o conjunto sem redução, por isso é desativada por padrão
+	params->compare_reduction = config_get_value_int("svm_compare_reduction", 0, 1, 0);
+}
+
+/*
+ * Avalia o efeito da redução do conjunto de treinamento por validação cruzada: em cada partição, um modelo é treinado
+ * com as demais assinaturas reduzidas e outro com elas sem redução, ambos com os parâmetros do modelo publicado, e os
+ * dois são avaliados nas assinaturas da partição, que nenhum deles viu. Registra os tempos de treinamento e as acurácias.
+ */
+static void model_compare_reduction(const classifier_model_t *model, const load_signature_t *signatures, int signature_qty, int on,
+									const classifier_params_t *params, const volatile int *terminate) {
+	classifier_params_t fold_params;
+	load_signature_t *training, *testing, *reduced;
+	classifier_model_t *reduced_model, *full_model;
+	int training_qty, testing_qty, reduced_qty;
+	int sample_qty = 0, fold_qty = 0;
+	double reduced_correct = 0.0, full_correct = 0.0;
+	double reduced_time = 0.0, full_time = 0.0;
+	double reduced_accuracy, full_accuracy;
+	
+	fold_params = *params;
+	fold_params.grid_search = 0;
+	
+	// Um modelo com apenas um aparelho não tem parâmetros escolhidos, ficam os configurados
+	if(model->svm_model) {
+		fold_params.c = model->c;
+		fold_params.gamma = model->svm_model->param.gamma;
+	}
+	
+	training = (load_signature_t*) malloc(sizeof(load_signature_t) * signature_qty);
+	testing = (load_signature_t*) malloc(sizeof(load_signature_t) * signature_qty);
+	
+	if(training == NULL || testing == NULL) {
+		free(training);
+		free(testing);
+		
+		return;
+	}
+	
+	for(int fold = 0; fold < SVM_CROSSV_FOLD_NUM && !(*terminate); fold++) {
+		training_qty = 0;
+		testing_qty = 0;
+		
+		for(int i = 0; i < signature_qty; i++) {
+			if(i % SVM_CROSSV_FOLD_NUM == fold)
+				testing[testing_qty++] = signatures[i];
+			else
+				training[training_qty++] = signatures[i];
+		}
+		
+		if((reduced_qty = classifier_reduce_signatures(training, training_qty, params->max_signatures, &reduced)) < 0)
+			continue;
+		
+		reduced_model = model_train(reduced, reduced_qty, on, &fold_params, terminate);
+		full_model = model_train(training, training_qty, on, &fold_params, terminate);
+		
+		if(reduced_model && full_model && (reduced_accuracy = model_evaluate(reduced_model, testing, testing_qty, on)) >= 0.0) {
+			int fold_sample_qty = 0;
+			
+			full_accuracy = model_evaluate(full_model, testing, testing_qty, on);
+			
+			for(int i = 0; i < testing_qty; i++) {
+				if((testing[i].delta_pt > 0.0) == (on != 0))
+					fold_sample_qty++;
+			}
+			
+			sample_qty += fold_sample_qty;
+			reduced_correct += reduced_accuracy * fold_sample_qty;
+			full_correct += full_accuracy * fold_sample_qty;
+			reduced_time += reduced_model->fit_time;
+			full_time += full_model->fit_time;
+			fold_qty++;
+		}
+		
+		if(reduced_model)
+			model_destroy(reduced_model);
+		
+		if(full_model)
+			model_destroy(full_model);
+		
+		free(reduced);
+	}
+	
+	free(training);
+	free(testing);
+	
+	if(fold_qty == 0 || sample_qty == 0) {
+		if(!(*terminate))
+			LOG_WARN("Failed to compare reduced and unreduced %s models.", (on) ? "on" : "off");
+		
+		return;
+	}
+	
+	LOG_INFO("Reduction of %s model (%d-fold held-out): fit in %.2lf s reduced vs %.2lf s unreduced (%.1lfx), accuracy %.1lf%% reduced vs %.1lf%% unreduced (%+.1lf points).",
+				(on) ? "on" : "off", fold_qty, reduced_time, full_time, (reduced_time > 0.0) ? (full_time / reduced_time) : 0.0,
+				reduced_correct / sample_qty * 100.0, full_correct / sample_qty * 100.0, (reduced_correct - full_correct) / sample_qty * 100.0);
+}
+
+/* O hash identifica o conjunto de treinamento (assinaturas e parâmetros), permitindo reutilizar o modelo salvo */
+static int signatures_hash(const load_signature_t *signatures, int signature_qty, const classifier_params_t *params, unsigned char *hash) {
+	EVP_MD_CTX *mdctx = NULL;
+	unsigned int hash_size = 0;
+	
+	if((mdctx = EVP_MD_CTX_new()) == NULL)
+		return -1;
+	
+	EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
+	EVP_DigestUpdate(mdctx, &params->max_signatures, sizeof(int));
+	EVP_DigestUpdate(mdctx, &params->grid_search, sizeof(int));
+	EVP_DigestUpdate(mdctx, &params->c, sizeof(double));
+	EVP_DigestUpdate(mdctx, &params->gamma, sizeof(double));
+	
+	for(int i = 0; i < signature_qty; i++) {
+		EVP_DigestUpdate(mdctx, &signatures[i].appliance_id, sizeof(int));
+		EVP_DigestUpdate(mdctx, &signatures[i].delta_pt, sizeof(double));
+		EVP_DigestUpdate(mdctx, signatures[i].features, sizeof(double) * SVM_PARAM_QTY_ON);
+	}
+	
+	EVP_DigestFinal_ex(mdctx, hash, &hash_size);
+	EVP_MD_CTX_free(mdctx);
+	
+	return (hash_size == CLASSIFIER_HASH_SIZE) ? 0 : -1;
+}
+
+static void models_destroy(classifier_models_t *models) {
+	if(models == NULL)
+		return;
+	
+	model_destroy(models->on);
+	model_destroy(models->off);
+	
+	if(models->map)
+		munmap(models->map, models->map_size);
+	
+	free(models);
+}
+
+static classifier_models_t *models_acquire() {
+	classifier_models_t *models;
+	
+	if(pthread_mutex_lock(&models_mutex))
+		return NULL;
+	
+	if((models = current_models) != NULL)
+		models->refcount++;
+	
+	pthread_mutex_unlock(&models_mutex);
+	
+	return models;
+}
+
+static void models_release(classifier_models_t *models) {
+	int refcount;
+	
+	if(models == NULL)
+		return;
+	
+	pthread_mutex_lock(&models_mutex);
+	
+	refcount = --models->refcount;
+	
+	pthread_mutex_unlock(&models_mutex);
+	
+	if(refcount == 0)
+		models_destroy(models);
+}
+
+/* Troca o conjunto publicado, quem ainda estiver classificando com o antigo continua usando-o até devolver a referência */
+static void models_publish(classifier_models_t *models) {
+	classifier_models_t *old_models;
+	
+	pthread_mutex_lock(&models_mutex);
+	
+	old_models = current_models;
+	current_models = models;
+	
+	pthread_cond_broadcast(&models_cond);
+	pthread_mutex_unlock(&models_mutex);
+	
+	models_release(old_models);
+}
+
+static int file_write_padded(FILE *fd, const void *data, size_t size) {
+	const char padding[8] = {0};
+	
+	if(size && fwrite(data, size, 1, fd) != 1)
+		return -1;
+	
+	if((size % 8) && fwrite(padding, 8 - (size % 8), 1, fd) != 1)
+		return -1;
+	
+	return 0;
+}
+
+static int model_write(FILE *fd, const classifier_model_t *model) {
+	classifier_file_model_t file_model;
+	const struct svm_model *svm_model;
+	int pair_qty;
+	
+	memset(&file_model, 0, sizeof(classifier_file_model_t));
+	
+	if(model == NULL)
+		return file_write_padded(fd, &file_model, sizeof(classifier_file_model_t));
+	
+	file_model.present = 1;
+	file_model.feature_qty = model->feature_qty;
+	file_model.single_label = model->single_label;
+	file_model.sample_qty = model->sample_qty;
+	file_model.c = model->c;
+	file_model.cv_accuracy = model->cv_accuracy;
+	file_model.full_sample_qty = model->full_sample_qty;
+	file_model.full_accuracy = model->full_accuracy;
+	file_model.training_time = model->training_time;
+	memcpy(file_model.feature_min, model->feature_min, sizeof(file_model.feature_min));
+	memcpy(file_model.feature_max, model->feature_max, sizeof(file_model.feature_max));
+	
+	if((svm_model = model->svm_model) != NULL) {
+		file_model.class_qty = svm_model->nr_class;
+		file_model.sv_qty = svm_model->l;
+		file_model.svm_type = svm_model->param.svm_type;
+		file_model.kernel_type = svm_model->param.kernel_type;
+		file_model.degree = svm_model->param.degree;
+		file_model.gamma = svm_model->param.gamma;
+		file_model.coef0 = svm_model->param.coef0;
+	}
+	
+	if(file_write_padded(fd, &file_model, sizeof(classifier_file_model_t)))
+		return -1;
+	
+	if(svm_model == NULL)
+		return 0;
+	
+	pair_qty = svm_model->nr_class * (svm_model->nr_class - 1) / 2;
+	
+	if(file_write_padded(fd, svm_model->label, sizeof(int) * svm_model->nr_class)
+		|| file_write_padded(fd, svm_model->nSV, sizeof(int) * svm_model->nr_class)
+		|| file_write_padded(fd, svm_model->rho, sizeof(double) * pair_qty)
+		|| file_write_padded(fd, svm_model->probA, sizeof(double) * pair_qty)
+		|| file_write_padded(fd, svm_model->probB, sizeof(double) * pair_qty))
+		return -1;
+	
+	for(int c = 0; c < svm_model->nr_class - 1; c++) {
+		if(file_write_padded(fd, svm_model->sv_coef[c], sizeof(double) * svm_model->l))
+			return -1;
+	}
+	
+	/* Cada vetor de suporte ocupa feature_qty + 1 nós, terminados com índice -1 */
+	for(int i = 0; i < svm_model->l; i++) {
+		struct svm_node nodes[SVM_PARAM_QTY_ON + 1];
+		int n;
+		
+		for(n = 0; n < model->feature_qty && svm_model->SV[i][n].index != -1; n++)
+			nodes[n] = svm_model->SV[i][n];
+		
+		for(; n <= model->feature_qty; n++) {
+			nodes[n].index = -1;
+			nodes[n].value = 0;
+		}
+		
+		if(file_write_padded(fd, nodes, sizeof(struct svm_node) * (model->feature_qty + 1)))
+			return -1;
+	}
+	
+	return 0;
+}
+
+/* Salva o conjunto de modelos em um arquivo temporário que substitui o anterior apenas quando estiver completo */
+static int models_save(const classifier_models_t *models) {
+	const char tmp_filename[] = CLASSIFIER_MODEL_FILENAME ".tmp";
+	classifier_file_header_t header;
+	FILE *fd;
+	
+	memset(&header, 0, sizeof(classifier_file_header_t));
+	memcpy(header.magic, CLASSIFIER_FILE_MAGIC, sizeof(header.magic));
+	header.format = CLASSIFIER_FILE_FORMAT;
+	header.version = models->version;
+	header.model_qty = 2;
+	memcpy(header.hash, models->hash, CLASSIFIER_HASH_SIZE);
+	
+	if((fd = fopen(tmp_filename, "wb")) == NULL) {
+		LOG_ERROR("Failed to create classifier model file.");
+		return -1;
+	}
+	
+	if(file_write_padded(fd, &header, sizeof(classifier_file_header_t)) || model_write(fd, models->on) || model_write(fd, models->off)) {
+		LOG_ERROR("Failed to write classifier model file.");
+		fclose(fd);
+		unlink(tmp_filename);
+		
+		return -1;
+	}
+	
+	if(fclose(fd) || rename(tmp_filename, CLASSIFIER_MODEL_FILENAME)) {
+		LOG_ERROR("Failed to save classifier model file.");
+		unlink(tmp_filename);
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Retorna um ponteiro para o próximo bloco da região mapeada, ou NULL se o arquivo terminar antes */
+static const void *map_take(const unsigned char *map, size_t map_size, size_t *offset, size_t size) {
+	const void *block = map + *offset;
+	
+	size = (size + 7) & ~((size_t) 7);
+	
+	if(*offset + size > map_size)
+		return NULL;
+	
+	*offset += size;
+	
+	return block;
+}
+
+/* Monta um modelo cujos vetores apontam diretamente para o arquivo mapeado */
+static int model_map(const unsigned char *map, size_t map_size, size_t *offset, classifier_model_t **model_ptr) {
+	const classifier_file_model_t *file_model;
+	classifier_model_t *model;
+	struct svm_model *svm_model;
+	const int *labels, *nsv;
+	const double *rho, *prob_a, *prob_b, *sv_coef;
+	struct svm_node *nodes;
+	int pair_qty;
+	
+	*model_ptr = NULL;
+	
+	if((file_model = (const classifier_file_model_t*) map_take(map, map_size, offset, sizeof(classifier_file_model_t))) == NULL)
+		return -1;
+	
+	if(!file_model->present)
+		return 0;
+	
+	if(file_model->feature_qty < 1 || file_model->feature_qty > SVM_PARAM_QTY_ON || file_model->class_qty < 0 || file_model->sv_qty < 0)
+		return -1;
+	
+	if((model = (classifier_model_t*) calloc(1, sizeof(classifier_model_t))) == NULL)
+		return -1;
+	
+	model->mapped = 1;
+	model->feature_qty = file_model->feature_qty;
+	model->single_label = file_model->single_label;
+	model->sample_qty = file_model->sample_qty;
+	model->c = file_model->c;
+	model->cv_accuracy = file_model->cv_accuracy;
+	model->full_sample_qty = file_model->full_sample_qty;
+	model->full_accuracy = file_model->full_accuracy;
+	model->training_time = file_model->training_time;
+	memcpy(model->feature_min, file_model->feature_min, sizeof(model->feature_min));
+	memcpy(model->feature_max, file_model->feature_max, sizeof(model->feature_max));
+	
+	if(file_model->class_qty == 0) {
+		*model_ptr = model;
+		return 0;
+	}
+	
+	pair_qty = file_model->class_qty * (file_model->class_qty - 1) / 2;
+	
+	labels = (const int*) map_take(map, map_size, offset, sizeof(int) * file_model->class_qty);
+	nsv = (const int*) map_take(map, map_size, offset, sizeof(int) * file_model->class_qty);
+	rho = (const double*) map_take(map, map_size, offset, sizeof(double) * pair_qty);
+	prob_a = (const double*) map_take(map, map_size, offset, sizeof(double) * pair_qty);
+	prob_b = (const double*) map_take(map, map_size, offset, sizeof(double) * pair_qty);
+	sv_coef = (const double*) map_take(map, map_size, offset, sizeof(double) * file_model->sv_qty * (file_model->class_qty - 1));
+	nodes = (struct svm_node*) map_take(map, map_size, offset, sizeof(struct svm_node) * file_model->sv_qty * (file_model->feature_qty + 1));
+	
+	model->class_qty = file_model->class_qty;
+	model->labels = (int*) malloc(sizeof(int) * file_model->class_qty);
+	model->svm_model = svm_model = (struct svm_model*) calloc(1, sizeof(struct svm_model));
+	
+	if(labels == NULL || nsv == NULL || rho == NULL || prob_a == NULL || prob_b == NULL || sv_coef == NULL || nodes == NULL || model->labels == NULL || svm_model == NULL) {
+		model_destroy(model);
+		return -1;
+	}
+	
+	memcpy(model->labels, labels, sizeof(int) * file_model->class_qty);
+	
+	svm_model->param.svm_type = file_model->svm_type;
+	svm_model->param.kernel_type = file_model->kernel_type;
+	svm_model->param.degree = file_model->degree;
+	svm_model->param.gamma = file_model->gamma;
+	svm_model->param.coef0 = file_model->coef0;
+	svm_model->param.probability = 1;
+	svm_model->nr_class = file_model->class_qty;
+	svm_model->l = file_model->sv_qty;
+	svm_model->label = (int*) labels;
+	svm_model->nSV = (int*) nsv;
+	svm_model->rho = (double*) rho;
+	svm_model->probA = (double*) prob_a;
+	svm_model->probB = (double*) prob_b;
+	svm_model->free_sv = 0;
+	
+	svm_model->sv_coef = (double**) malloc(sizeof(double*) * (file_model->class_qty - 1));
+	svm_model->SV = (struct svm_node**) malloc(sizeof(struct svm_node*) * MAX(1, file_model->sv_qty));
+	
+	if(svm_model->sv_coef == NULL || svm_model->SV == NULL) {
+		model_destroy(model);
+		return -1;
+	}
+	
+	for(int c = 0; c < file_model->class_qty - 1; c++)
+		svm_model->sv_coef[c] = (double*) &sv_coef[c * file_model->sv_qty];
+	
+	for(int i = 0; i < file_model->sv_qty; i++)
+		svm_model->SV[i] = &nodes[i * (file_model->feature_qty + 1)];
+	
+	*model_ptr = model;
+	
+	return 0;
+}
+
+/* Mapeia o arquivo de modelos salvo, retorna NULL se não existir ou for inválido */
+static classifier_models_t *models_load_file() {
+	classifier_models_t *models;
+	const classifier_file_header_t *header;
+	struct stat file_stat;
+	size_t offset = 0;
+	void *map;
+	int fd;
+	
+	if((fd = open(CLASSIFIER_MODEL_FILENAME, O_RDONLY)) < 0)
+		return NULL;
+	
+	if(fstat(fd, &file_stat) || file_stat.st_size < (off_t) sizeof(classifier_file_header_t)) {
+		close(fd);
+		return NULL;
+	}
+	
+	map = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	
+	close(fd);
+	
+	if(map == MAP_FAILED)
+		return NULL;
+	
+	header = (const classifier_file_header_t*) map_take(map, file_stat.st_size, &offset, sizeof(classifier_file_header_t));
+	
+	if(memcmp(header->magic, CLASSIFIER_FILE_MAGIC, sizeof(header->magic)) || header->format != CLASSIFIER_FILE_FORMAT || header->model_qty != 2) {
+		LOG_WARN("Ignoring invalid classifier model file.");
+		munmap(map, file_stat.st_size);
+		
+		return NULL;
+	}
+	
+	if((models = (classifier_models_t*) calloc(1, sizeof(classifier_models_t))) == NULL) {
+		munmap(map, file_stat.st_size);
+		return NULL;
+	}
+	
+	models->refcount = 1;
+	models->version = header->version;
+	memcpy(models->hash, header->hash, CLASSIFIER_HASH_SIZE);
+	models->map = map;
+	models->map_size = file_stat.st_size;
+	
+	if(model_map(map, file_stat.st_size, &offset, &models->on) || model_map(map, file_stat.st_size, &offset, &models->off)) {
+		LOG_WARN("Ignoring corrupted classifier model file.");
+		models_destroy(models);
+		
+		return NULL;
+	}
+	
+	return models;
+}
+
+/* Treina os modelos de ligamento e desligamento a partir da tabela de assinaturas, caso o conjunto de treinamento
+ * tenha mudado desde o último treinamento. O novo conjunto é salvo em disco e publicado. */
+static int classifier_retrain(const volatile int *terminate) {
+	load_signature_t *signatures = NULL;
+	load_signature_t *training_signatures = NULL;
+	int signature_qty;
+	int training_qty = -1;
+	classifier_params_t params;
+	classifier_models_t *models;
+	classifier_models_t *old_models;
+	unsigned char hash[CLASSIFIER_HASH_SIZE];
+	
+	if((signature_qty = classifier_load_signatures(&signatures)) < 0)
+		return -1;
+	
+	classifier_get_params(&params);
+	
+	if(signatures_hash(signatures, signature_qty, &params, hash)) {
+		free(signatures);
+		return -1;
+	}
+	
+	if((old_models = models_acquire()) != NULL && memcmp(old_models->hash, hash, CLASSIFIER_HASH_SIZE) == 0) {
+		models_release(old_models);
+		free(signatures);
+		
+		return 0;
+	}
+	
+	if((models = (classifier_models_t*) calloc(1, sizeof(classifier_models_t))) == NULL) {
+		models_release(old_models);
+		free(signatures);
+		
+		return -1;
+	}
+	
+	models->refcount = 1;
+	models->version = (old_models) ? (old_models->version + 1) : 1;
+	memcpy(models->hash, hash, CLASSIFIER_HASH_SIZE);
+	
+	models_release(old_models);
+	
+	if(params.max_signatures > 0) {
+		if((training_qty = classifier_reduce_signatures(signatures, signature_qty, params.max_signatures, &training_signatures)) < 0)
+			LOG_WARN("Failed to reduce training set, using all signatures.");
+		else if(training_qty < signature_qty)
+			LOG_INFO("Training set reduced from %d to %d signatures.", signature_qty, training_qty);
+	}
+	
+	if(training_qty < 0) {
+		training_signatures = signatures;
+		training_qty = signature_qty;
+	}
+	
+	models->on = model_build(signatures, signature_qty, training_signatures, training_qty, 1, &params, terminate);
+	models->off = model_build(signatures, signature_qty, training_signatures, training_qty, 0, &params, terminate);
+	
+	if(training_signatures != signatures)
+		free(training_signatures);
+	
+	// Interrompido pelo encerramento do programa, o conjunto incompleto é descartado
+	if(*terminate) {
+		models_release(models);
+		free(signatures);
+		
+		return 0;
+	}
+	
+	LOG_INFO("Trained appliance classifier version %d with %d signatures (on model: %s, off model: %s).", models->version, signature_qty, (models->on) ? "ok" : "none", (models->off) ? "ok" : "none");
+	
+	models_save(models);
+	
+	// A referência de models passa a ser do conjunto publicado, a comparação usa uma referência própria
+	models_publish(models);
+	
+	/* A comparação é feita depois da publicação, para que os novos modelos não esperem pelos treinamentos sem redução */
+	if(params.compare_reduction && training_qty < signature_qty && (models = models_acquire()) != NULL) {
+		if(models->on)
+			model_compare_reduction(models->on, signatures, signature_qty, 1, &params, terminate);
+		
+		if(models->off)
+			model_compare_reduction(models->off, signatures, signature_qty, 0, &params, terminate);
+		
+		models_release(models);
+	}
+	
+	free(signatures);
+	
+	return 1;
+}
+
+/* Carrega os modelos salvos, se o conjunto de treinamento mudou eles continuam sendo usados até o novo treinamento terminar. */
+int classifier_init() {
+	load_signature_t *signatures = NULL;
+	int signature_qty;
+	classifier_params_t params;
+	classifier_models_t *models;
+	unsigned char hash[CLASSIFIER_HASH_SIZE];
+	
+	svm_set_print_string_function(&svm_print_string_f);
+	
+	if((models = models_load_file()) != NULL) {
+		LOG_INFO("Loaded appliance classifier version %d.", models->version);
+		models_publish(models);
+	}
+	
+	if((signature_qty = classifier_load_signatures(&signatures)) < 0)
+		return -1;
+	
+	classifier_get_params(&params);
+	
+	if(signatures_hash(signatures, signature_qty, &params, hash) || models == NULL || memcmp(models->hash, hash, CLASSIFIER_HASH_SIZE))
+		classifier_request_retrain();
+	
+	free(signatures);
+	
+	return 0;
+}
+
+/* Pede o retreinamento dos modelos em segundo plano, chamada quando as assinaturas ou os aparelhos mudam */
+void classifier_request_retrain() {
+	pthread_mutex_lock(&training_mutex);
+	
+	training_requested = 1;
+	
+	pthread_cond_signal(&training_cond);
+	pthread_mutex_unlock(&training_mutex);
+}
+
+int classifier_get_version() {
+	classifier_models_t *models;
+	int version = 0;
+	
+	if((models = models_acquire()) != NULL) {
+		version = models->version;
+		models_release(models);
+	}
+	
+	return version;
+}
+
+static void model_get_status(const classifier_model_t *model, classifier_model_status_t *status) {
+	memset(status, 0, sizeof(classifier_model_status_t));
+	
+	status->cv_accuracy = -1.0;
+	
+	if(model == NULL)
+		return;
+	
+	status->available = 1;
+	status->sample_qty = model->sample_qty;
+	status->class_qty = (model->single_label > 0) ? 1 : model->class_qty;
+	status->cv_accuracy = model->cv_accuracy;
+	status->full_sample_qty = model->full_sample_qty;
+	status->full_accuracy = model->full_accuracy;
+	status->training_time = model->training_time;
+	
+	if(model->svm_model) {
+		status->sv_qty = model->svm_model->l;
+		status->c = model->c;
+		status->gamma = model->svm_model->param.gamma;
+	}
+}
+
+/* Preenche o estado do classificador publicado, com os parâmetros escolhidos e a acurácia da validação cruzada */
+int classifier_get_status(classifier_status_t *status) {
+	classifier_models_t *models;
+	
+	if(status == NULL)
+		return -1;
+	
+	memset(status, 0, sizeof(classifier_status_t));
+	
+	pthread_mutex_lock(&training_mutex);
+	status->training = training_running || training_requested;
+	pthread_mutex_unlock(&training_mutex);
+	
+	models = models_acquire();
+	
+	if(models)
+		status->version = models->version;
+	
+	model_get_status((models) ? models->on : NULL, &status->on);
+	model_get_status((models) ? models->off : NULL, &status->off);
+	
+	models_release(models);
+	
+	return 0;
+}
+
+/* Aguarda até que a versão dos modelos publicados seja diferente de version ou até o tempo limite, retorna a versão atual */
+int classifier_wait_version_change(int version, int timeout_ms) {
+	struct timespec abstime;
+	int current_version;
+	
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	
+	abstime.tv_sec += timeout_ms / 1000;
+	abstime.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	
+	if(abstime.tv_nsec >= 1000000000L) {
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000L;
+	}
+	
+	pthread_mutex_lock(&models_mutex);
+	
+	if(((current_models) ? current_models->version : 0) == version)
+		pthread_cond_timedwait(&models_cond, &models_mutex, &abstime);
+	
+	current_version = (current_models) ? current_models->version : 0;
+	
+	pthread_mutex_unlock(&models_mutex);
+	
+	return current_version;
+}
+
+void *classifier_training_loop(void *argp) {
+	int *terminate = (int*) argp;
+	struct timespec abstime;
+	int requested;
+	
+	while(!(*terminate)) {
+		clock_gettime(CLOCK_REALTIME, &abstime);
+		abstime.tv_sec += CLASSIFIER_TRAINING_WAIT_TIMEOUT / 1000;
+		
+		pthread_mutex_lock(&training_mutex);
+		
+		if(!training_requested)
+			pthread_cond_timedwait(&training_cond, &training_mutex, &abstime);
+		
+		requested = training_requested;
+		training_requested = 0;
+		training_running = requested;
+		
+		pthread_mutex_unlock(&training_mutex);
+		
+		if(!requested)
+			continue;
+		
+		if(classifier_retrain(terminate) < 0)
+			LOG_ERROR("Failed to retrain appliance classifier.");
+		
+		pthread_mutex_lock(&training_mutex);
+		training_running = 0;
+		pthread_mutex_unlock(&training_mutex);
+	}
+	
+	models_publish(NULL);
+	
+	return NULL;
+}
+
+static void model_classify(const classifier_model_t *model, load_event_t *load_event) {
+	struct svm_node nodes[SVM_PARAM_QTY_ON + 1];
+	double features[SVM_PARAM_QTY_ON];
+	double *prob_estimates;
+	int feature_qty;
+	int top_qty;
+	
+	if(model->single_label > 0) {
+		load_event->top_appliance_id = model->single_label;
+		load_event->appliance_ids[0] = model->single_label;
+		load_event->appliance_probs[0] = 1.0;
+		load_event->prob_avg = 1.0;
+		
+		return;
+	}
+	
+	if((prob_estimates = (double*) malloc(sizeof(double) * model->class_qty)) == NULL)
+		return;
+	
+	feature_qty = classifier_extract_features(load_event->delta_pt, load_event->peak_pt, load_event->delta_p, load_event->delta_q, features);
+	
+	for(int f = 0; f < feature_qty; f++) {
+		nodes[f].index = f + 1;
+		nodes[f].value = model_scale(model, f, features[f]);
+	}
+	
+	nodes[feature_qty].index = -1;
+	
+	svm_predict_probability(model->svm_model, nodes, prob_estimates);
+	
+	top_qty = MIN(LOAD_EVENT_APPLIANCE_QTY, model->class_qty);
+	
+	/* Seleção parcial dos mais prováveis, a quantidade de classes é pequena */
+	for(int c = 0; c < model->class_qty; c++) {
+		for(int t = 0; t < top_qty; t++) {
+			if(load_event->appliance_ids[t] < 0 || prob_estimates[c] > load_event->appliance_probs[t]) {
+				memmove(&load_event->appliance_ids[t + 1], &load_event->appliance_ids[t], sizeof(int) * (top_qty - t - 1));
+				memmove(&load_event->appliance_probs[t + 1], &load_event->appliance_probs[t], sizeof(double) * (top_qty - t - 1));
+				
+				load_event->appliance_ids[t] = model->labels[c];
+				load_event->appliance_probs[t] = prob_estimates[c];
+				
+				break;
+			}
+		}
+	}
+	
+	free(prob_estimates);
+	
+	load_event->top_appliance_id = load_event->appliance_ids[0];
+	
+	for(int t = 0; t < top_qty; t++)
+		load_event->prob_avg += load_event->appliance_probs[t];
+	
+	load_event->prob_avg /= top_qty;
+	
+	for(int t = 0; t < top_qty; t++)
+		load_event->prob_sd += pow(load_event->appliance_probs[t] - load_event->prob_avg, 2);
+	
+	load_event->prob_sd = sqrt(load_event->prob_sd / top_qty);
+}
+
+/* Classifica o evento, preenchendo os três aparelhos mais prováveis. Retorna 1 se não há modelo para o tipo de evento.
+ * Nunca espera pelo treinamento, o conjunto de modelos usado é o publicado no momento da chamada. */
+int classifier_classify(load_event_t *load_event) {
+	classifier_models_t *models;
+	const classifier_model_t *model;
+	
+	if(load_event == NULL)
+		return -1;
+	
+	for(int i = 0; i < LOAD_EVENT_APPLIANCE_QTY; i++) {
+		load_event->appliance_ids[i] = -1;
+		load_event->appliance_probs[i] = 0.0;
+	}
+	
+	load_event->top_appliance_id = -1;
+	load_event->prob_avg = 0.0;
+	load_event->prob_sd = 0.0;
+	load_event->model_version = 0;
+	
+	if((models = models_acquire()) == NULL)
+		return 1;
+	
+	if((model = (load_event->delta_pt > 0.0) ? models->on : models->off) == NULL) {
+		models_release(models);
+		return 1;
+	}
+	
+	model_classify(model, load_event);
+	
+	load_event->model_version = models->version;
+	
+	models_release(models);
+	
+	return 0;
+}
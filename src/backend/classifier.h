@@ -0,0 +1,54 @@
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include <time.h>
+
+#include "disaggregation.h"
+
+#define SVM_PARAM_QTY_ON 5
+#define SVM_PARAM_QTY_OFF 4
+#define SVM_CROSSV_FOLD_NUM 5
+
+#define CLASSIFIER_HASH_SIZE 32
+
+typedef struct load_signature_s {
+	int appliance_id;
+	double delta_pt;
+	double peak_pt;
+	double delta_p[2];
+	double delta_q[2];
+	double delta_s[2];
+	double features[SVM_PARAM_QTY_ON];
+} load_signature_t;
+
+typedef struct classifier_model_status_s {
+	int available;
+	int sample_qty;
+	int class_qty;
+	double c;
+	double gamma;
+	double cv_accuracy;
+	int sv_qty;
+	int full_sample_qty;
+	double full_accuracy;
+	double training_time;
+} classifier_model_status_t;
+
+typedef struct classifier_status_s {
+	int version;
+	int training;
+	classifier_model_status_t on;
+	classifier_model_status_t off;
+} classifier_status_t;
+
+int classifier_extract_features(double delta_pt, double peak_pt, const double *delta_p, const double *delta_q, double *features);
+int classifier_load_signatures(load_signature_t **signatures_ptr);
+int classifier_reduce_signatures(const load_signature_t *signatures, int signature_qty, int max_per_group, load_signature_t **reduced_ptr);
+int classifier_init();
+void classifier_request_retrain();
+int classifier_get_version();
+int classifier_wait_version_change(int version, int timeout_ms);
+int classifier_get_status(classifier_status_t *status);
+int classifier_classify(load_event_t *load_event);
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "common.h"
+#include "logger.h"
+#include "classifier.h"
+
+#define REDUCTION_MAX_ITERATIONS 20
+
+/* Assinaturas de um aparelho com um tipo de evento (ligamento ou desligamento), com os parâmetros escalados para [0, 1] */
+typedef struct reduction_group_s {
+	int appliance_id;
+	int on;
+	int feature_qty;
+	int qty;
+	int *indexes;
+	double *points;
+} reduction_group_t;
+
+static double point_distance(const double *a, const double *b, int feature_qty) {
+	double distance = 0.0;
+	
+	for(int f = 0; f < feature_qty; f++)
+		distance += (a[f] - b[f]) * (a[f] - b[f]);
+	
+	return distance;
+}
+
+static int group_prepare(const load_signature_t *signatures, int signature_qty, reduction_group_t *group) {
+	double feature_min[SVM_PARAM_QTY_ON], feature_max[SVM_PARAM_QTY_ON];
+	
+	group->feature_qty = (group->on) ? SVM_PARAM_QTY_ON : SVM_PARAM_QTY_OFF;
+	group->qty = 0;
+	
+	if((group->indexes = (int*) malloc(sizeof(int) * signature_qty)) == NULL)
+		return -1;
+	
+	for(int i = 0; i < signature_qty; i++) {
+		if(signatures[i].appliance_id == group->appliance_id && (signatures[i].delta_pt > 0.0) == group->on)
+			group->indexes[group->qty++] = i;
+	}
+	
+	if((group->points = (double*) malloc(sizeof(double) * group->qty * group->feature_qty)) == NULL) {
+		free(group->indexes);
+		return -1;
+	}
+	
+	for(int f = 0; f < group->feature_qty; f++) {
+		feature_min[f] = DBL_MAX;
+		feature_max[f] = -DBL_MAX;
+		
+		for(int i = 0; i < group->qty; i++) {
+			feature_min[f] = MIN(feature_min[f], signatures[group->indexes[i]].features[f]);
+			feature_max[f] = MAX(feature_max[f], signatures[group->indexes[i]].features[f]);
+		}
+		
+		for(int i = 0; i < group->qty; i++) {
+			if(feature_max[f] > feature_min[f])
+				group->points[i * group->feature_qty + f] = (signatures[group->indexes[i]].features[f] - feature_min[f]) / (feature_max[f] - feature_min[f]);
+			else
+				group->points[i * group->feature_qty + f] = 0.0;
+		}
+	}
+	
+	return 0;
+}
+
+/* k-means com inicialização determinística pelo ponto mais distante, para que o mesmo conjunto de assinaturas sempre
+ * gere o mesmo subconjunto (e portanto o mesmo hash de modelo). Cada grupo é representado pela assinatura mais próxima
+ * do seu centróide (medóide), assim o treinamento usa apenas medidas reais. Grava em selected os índices escolhidos. */
+static int group_select_medoids(const reduction_group_t *group, int cluster_qty, int *selected) {
+	double *centroids, *distances;
+	int *assignments, *counts;
+	int changed = 1;
+	int fq = group->feature_qty;
+	
+	centroids = (double*) malloc(sizeof(double) * cluster_qty * fq);
+	distances = (double*) malloc(sizeof(double) * group->qty);
+	assignments = (int*) malloc(sizeof(int) * group->qty);
+	counts = (int*) malloc(sizeof(int) * cluster_qty);
+	
+	if(centroids == NULL || distances == NULL || assignments == NULL || counts == NULL) {
+		free(centroids);
+		free(distances);
+		free(assignments);
+		free(counts);
+		
+		return -1;
+	}
+	
+	memcpy(&centroids[0], &group->points[0], sizeof(double) * fq);
+	
+	for(int i = 0; i < group->qty; i++)
+		distances[i] = point_distance(&group->points[i * fq], &centroids[0], fq);
+	
+	for(int c = 1; c < cluster_qty; c++) {
+		int farthest = 0;
+		
+		for(int i = 1; i < group->qty; i++) {
+			if(distances[i] > distances[farthest])
+				farthest = i;
+		}
+		
+		memcpy(&centroids[c * fq], &group->points[farthest * fq], sizeof(double) * fq);
+		
+		for(int i = 0; i < group->qty; i++)
+			distances[i] = MIN(distances[i], point_distance(&group->points[i * fq], &centroids[c * fq], fq));
+	}
+	
+	for(int iteration = 0; changed && iteration < REDUCTION_MAX_ITERATIONS; iteration++) {
+		changed = 0;
+		
+		for(int i = 0; i < group->qty; i++) {
+			int nearest = 0;
+			double nearest_distance = DBL_MAX;
+			
+			for(int c = 0; c < cluster_qty; c++) {
+				double distance = point_distance(&group->points[i * fq], &centroids[c * fq], fq);
+				
+				if(distance < nearest_distance) {
+					nearest_distance = distance;
+					nearest = c;
+				}
+			}
+			
+			if(iteration == 0 || assignments[i] != nearest) {
+				assignments[i] = nearest;
+				changed = 1;
+			}
+		}
+		
+		memset(centroids, 0, sizeof(double) * cluster_qty * fq);
+		memset(counts, 0, sizeof(int) * cluster_qty);
+		
+		for(int i = 0; i < group->qty; i++) {
+			counts[assignments[i]]++;
+			
+			for(int f = 0; f < fq; f++)
+				centroids[assignments[i] * fq + f] += group->points[i * fq + f];
+		}
+		
+		for(int c = 0; c < cluster_qty; c++) {
+			for(int f = 0; f < fq && counts[c]; f++)
+				centroids[c * fq + f] /= counts[c];
+		}
+	}
+	
+	for(int c = 0; c < cluster_qty; c++) {
+		selected[c] = -1;
+		distances[c] = DBL_MAX;
+	}
+	
+	for(int i = 0; i < group->qty; i++) {
+		double distance = point_distance(&group->points[i * fq], &centroids[assignments[i] * fq], fq);
+		
+		if(distance < distances[assignments[i]]) {
+			distances[assignments[i]] = distance;
+			selected[assignments[i]] = group->indexes[i];
+		}
+	}
+	
+	free(centroids);
+	free(distances);
+	free(assignments);
+	free(counts);
+	
+	return 0;
+}
+
+static int index_compare(const void *a, const void *b) {
+	return *((const int*) a) - *((const int*) b);
+}
+
+/* Reduz o conjunto de treinamento a no máximo max_per_group assinaturas por aparelho e tipo de evento, escolhidas por
+ * agrupamento. A tabela de assinaturas não é alterada, o subconjunto existe apenas em memória. Retorna a quantidade
+ * de assinaturas em reduced_ptr (que deve ser liberado com free()) ou negativo em caso de falha. */
+int classifier_reduce_signatures(const load_signature_t *signatures, int signature_qty, int max_per_group, load_signature_t **reduced_ptr) {
+	load_signature_t *reduced;
+	int *selected;
+	int selected_qty = 0;
+	
+	if(signatures == NULL || reduced_ptr == NULL || max_per_group < 1)
+		return -1;
+	
+	if((selected = (int*) malloc(sizeof(int) * MAX(1, signature_qty))) == NULL)
+		return -1;
+	
+	for(int i = 0; i < signature_qty; i++) {
+		reduction_group_t group;
+		int first_of_group = 1;
+		
+		group.appliance_id = signatures[i].appliance_id;
+		group.on = (signatures[i].delta_pt > 0.0);
+		
+		// Cada grupo é processado na sua primeira assinatura
+		for(int j = 0; j < i && first_of_group; j++) {
+			if(signatures[j].appliance_id == group.appliance_id && (signatures[j].delta_pt > 0.0) == group.on)
+				first_of_group = 0;
+		}
+		
+		if(!first_of_group)
+			continue;
+		
+		if(group_prepare(signatures, signature_qty, &group)) {
+			free(selected);
+			return -1;
+		}
+		
+		if(group.qty <= max_per_group) {
+			memcpy(&selected[selected_qty], group.indexes, sizeof(int) * group.qty);
+			selected_qty += group.qty;
+		} else if(group_select_medoids(&group, max_per_group, &selected[selected_qty]) == 0) {
+			int write_pos = selected_qty;
+			
+			// Grupos que ficaram vazios não têm medóide
+			for(int c = 0; c < max_per_group; c++) {
+				if(selected[selected_qty + c] >= 0)
+					selected[write_pos++] = selected[selected_qty + c];
+			}
+			
+			selected_qty = write_pos;
+		} else {
+			free(group.indexes);
+			free(group.points);
+			free(selected);
+			
+			return -1;
+		}
+		
+		free(group.indexes);
+		free(group.points);
+	}
+	
+	// Mantém a ordem original das assinaturas
+	qsort(selected, selected_qty, sizeof(int), index_compare);
+	
+	if((reduced = (load_signature_t*) malloc(sizeof(load_signature_t) * MAX(1, selected_qty))) == NULL) {
+		free(selected);
+		return -1;
+	}
+	
+	for(int i = 0; i < selected_qty; i++)
+		memcpy(&reduced[i], &signatures[selected[i]], sizeof(load_signature_t));
+	
+	free(selected);
+	
+	*reduced_ptr = reduced;
+	
+	return selected_qty;
+}
@@ -18,18 +18,16 @@ int config_get_list(config_t **config_list_ptr) {
 	if(config_list_ptr == NULL)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_configs, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_configs, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -37,8 +35,8 @@ int config_get_list(config_t **config_list_ptr) {
 	*config_list_ptr = (config_t*) malloc(sizeof(config_t) * size);
 	
 	if(*config_list_ptr == NULL) {
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -2;
 	}
@@ -77,8 +75,8 @@ int config_get_list(config_t **config_list_ptr) {
 		
 	} while(result == SQLITE_ROW);
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to get the configuration list: %s", sqlite3_errstr(result));
@@ -115,26 +113,24 @@ int config_get_value(const char *key, char *value_buf, size_t buf_size) {
 	if(key == NULL)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_config_value, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_config_value, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if((result = sqlite3_bind_text(ppstmt, 1, key, -1, SQLITE_STATIC)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -154,8 +150,8 @@ int config_get_value(const char *key, char *value_buf, size_t buf_size) {
 		result = sqlite3_step(ppstmt);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read configuration: %s", sqlite3_errstr(result));
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <json-c/json.h>
+
+#include "common.h"
+#include "logger.h"
+#include "config.h"
+#include "database.h"
+#include "power.h"
+#include "http.h"
+#include "dashboard.h"
+
+#define DASHBOARD_WAIT_TIMEOUT 1000
+
+/* Protege a troca do snapshot publicado e os contadores de referência */
+static pthread_mutex_t dashboard_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static dashboard_snapshot_t *current_snapshot = NULL;
+
+/* Monta o conteúdo do dashboard, que é o mesmo para todos os clientes */
+static dashboard_snapshot_t *dashboard_build_snapshot() {
+	int result;
+	time_t last_power_timestamp = 0;
+	power_data_t pdata[5];
+	
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_energy_today[] = "SELECT year,month,day,second_count,active,cost FROM energy_days ORDER BY year DESC,month DESC,day DESC LIMIT 1;";
+	const char sql_get_energy_thismonth[] = "SELECT second_count,active,cost FROM energy_months ORDER BY year DESC,month DESC LIMIT 1;";
+	const char sql_get_energy_dailyavg[] = "SELECT AVG(days.active * days.comp_factor) as avg_active_energy,AVG(days.cost * days.comp_factor) as avg_cost FROM (SELECT (86400 / CAST(second_count AS REAL)) AS comp_factor,active,cost FROM energy_days WHERE second_count > 43200 ORDER BY year DESC,month DESC LIMIT 7 OFFSET 1) AS days;";
+	
+	json_object *response_object = NULL;
+	json_object *response_item = NULL;
+	json_object *response_subitem = NULL;
+	const char *response_str;
+	size_t response_len;
+	
+	dashboard_snapshot_t *snapshot;
+	
+	response_object = json_object_new_object();
+	
+	response_item = json_object_new_array_ext(5);
+	
+	json_object_object_add_ex(response_object, "power", response_item, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	last_power_timestamp = power_get_last_timestamp();
+	
+	if(last_power_timestamp) {
+		result = get_power_data(last_power_timestamp - 4, 0, pdata, 5);
+		
+		if(result < 0) {
+			json_object_put(response_object);
+			
+			return NULL;
+		}
+		
+		for(int i = 0; i < result; i++) {
+			response_subitem = json_object_new_object();
+			json_object_array_add(response_item, response_subitem);
+			
+			json_object_object_add_ex(response_subitem, "timestamp", json_object_new_int64(pdata[i].timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			
+			json_object_object_add_ex(response_subitem, "v1", json_object_new_double(pdata[i].v[0]), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			json_object_object_add_ex(response_subitem, "v2", json_object_new_double(pdata[i].v[1]), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			
+			json_object_object_add_ex(response_subitem, "p1", json_object_new_double(pdata[i].p[0]), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			json_object_object_add_ex(response_subitem, "p2", json_object_new_double(pdata[i].p[1]), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			
+			json_object_object_add_ex(response_subitem, "s1", json_object_new_double(pdata[i].s[0]), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			json_object_object_add_ex(response_subitem, "s2", json_object_new_double(pdata[i].s[1]), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		}
+	}
+	
+	json_object_object_add_ex(response_object, "kwh_rate", json_object_new_double(config_get_value_double("kwh_rate", 0, 10, 0)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_energy_today, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	response_item = json_object_new_object();
+	response_subitem = json_object_new_object();
+	
+	json_object_object_add_ex(response_object, "today", response_item, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "date", response_subitem, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	if((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		json_object_object_add_ex(response_subitem, "year", json_object_new_int(sqlite3_column_int(ppstmt, 0)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_subitem, "month", json_object_new_int(sqlite3_column_int(ppstmt, 1)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_subitem, "day", json_object_new_int(sqlite3_column_int(ppstmt, 2)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		json_object_object_add_ex(response_item, "second_count", json_object_new_int(sqlite3_column_int(ppstmt, 3)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "energy", json_object_new_double(sqlite3_column_double(ppstmt, 4)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "cost", json_object_new_double(sqlite3_column_double(ppstmt, 5)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		result = sqlite3_step(ppstmt);
+	
+	}
+	
+	database_finalize(ppstmt);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get today energy data for overview: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_energy_thismonth, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	response_item = json_object_new_object();
+	
+	json_object_object_add_ex(response_object, "thismonth", response_item, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	if((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		
+		json_object_object_add_ex(response_item, "second_count", json_object_new_int(sqlite3_column_int(ppstmt, 0)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "energy", json_object_new_double(sqlite3_column_double(ppstmt, 1)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "cost", json_object_new_double(sqlite3_column_double(ppstmt, 2)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		result = sqlite3_step(ppstmt);
+	
+	}
+	
+	database_finalize(ppstmt);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get energy data for overview: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_energy_dailyavg, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	response_item = json_object_new_object();
+	
+	json_object_object_add_ex(response_object, "dailyavg", response_item, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	if((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		
+		json_object_object_add_ex(response_item, "energy", json_object_new_double(sqlite3_column_double(ppstmt, 0)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "cost", json_object_new_double(sqlite3_column_double(ppstmt, 1)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		result = sqlite3_step(ppstmt);
+	
+	}
+	
+	database_finalize(ppstmt);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get daily average energy for overview: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	database_close(db_conn);
+	
+	response_str = json_object_get_string(response_object);
+	response_len = strlen(response_str);
+	
+	if((snapshot = (dashboard_snapshot_t*) malloc(sizeof(dashboard_snapshot_t) + response_len + 1)) == NULL) {
+		json_object_put(response_object);
+		
+		return NULL;
+	}
+	
+	snapshot->refcount = 1;
+	snapshot->timestamp = last_power_timestamp;
+	snapshot->size = response_len;
+	memcpy(snapshot->data, response_str, response_len + 1);
+	
+	json_object_put(response_object);
+	
+	snapshot->gzip_data = http_compress_data(snapshot->data, snapshot->size, 1, &snapshot->gzip_size);
+	
+	return snapshot;
+}
+
+/* Retorna o snapshot mais recente com uma referência a mais, que deve ser liberada com dashboard_snapshot_release(). */
+dashboard_snapshot_t *dashboard_snapshot_acquire() {
+	dashboard_snapshot_t *snapshot;
+	
+	if(pthread_mutex_lock(&dashboard_mutex))
+		return NULL;
+	
+	if((snapshot = current_snapshot) != NULL)
+		snapshot->refcount++;
+	
+	pthread_mutex_unlock(&dashboard_mutex);
+	
+	return snapshot;
+}
+
+void dashboard_snapshot_release(dashboard_snapshot_t *snapshot) {
+	int refcount;
+	
+	if(snapshot == NULL)
+		return;
+	
+	pthread_mutex_lock(&dashboard_mutex);
+	
+	refcount = --snapshot->refcount;
+	
+	pthread_mutex_unlock(&dashboard_mutex);
+	
+	if(refcount == 0) {
+		free(snapshot->gzip_data);
+		free(snapshot);
+	}
+}
+
+static void dashboard_publish(dashboard_snapshot_t *snapshot) {
+	dashboard_snapshot_t *old_snapshot;
+	
+	pthread_mutex_lock(&dashboard_mutex);
+	
+	old_snapshot = current_snapshot;
+	current_snapshot = snapshot;
+	
+	pthread_mutex_unlock(&dashboard_mutex);
+	
+	/* O snapshot antigo só é liberado quando a última requisição que o utiliza terminar */
+	dashboard_snapshot_release(old_snapshot);
+}
+
+/* Reconstrói o dashboard uma vez a cada novo dado de potência, independente da quantidade de clientes */
+void *dashboard_publisher_loop(void *argp) {
+	int *terminate = (int*) argp;
+	time_t last_timestamp = -1;
+	time_t timestamp;
+	dashboard_snapshot_t *snapshot;
+	
+	while(!(*terminate)) {
+		timestamp = power_wait_new_data(last_timestamp, DASHBOARD_WAIT_TIMEOUT);
+		
+		if(timestamp < 0 || timestamp == last_timestamp)
+			continue;
+		
+		last_timestamp = timestamp;
+		
+		if((snapshot = dashboard_build_snapshot()) == NULL) {
+			LOG_ERROR("Failed to build dashboard snapshot.");
+			continue;
+		}
+		
+		dashboard_publish(snapshot);
+	}
+	
+	dashboard_publish(NULL);
+	
+	return NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <stddef.h>
+#include <time.h>
+
+/* Conteúdo serializado do dashboard, imutável depois de publicado */
+typedef struct dashboard_snapshot_s {
+	int refcount;
+	time_t timestamp;
+	
+	// Mesmo conteúdo comprimido com gzip uma única vez na publicação, NULL se não houver ganho
+	char *gzip_data;
+	size_t gzip_size;
+	
+	size_t size;
+	char data[];
+} dashboard_snapshot_t;
+
+dashboard_snapshot_t *dashboard_snapshot_acquire();
+void dashboard_snapshot_release(dashboard_snapshot_t *snapshot);
+
+#endif
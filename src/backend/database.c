@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+
+#include "logger.h"
+#include "database.h"
+
+#define STMT_CACHE_SIZE 48
+
+/* Comando preparado mantido entre requisições, identificado pelo texto SQL */
+typedef struct cached_stmt_s {
+	char *sql;
+	unsigned int sql_hash;
+	sqlite3_stmt *ppstmt;
+	
+	int in_use;
+	unsigned long last_use;
+} cached_stmt_t;
+
+/* Conexão de cada thread, aberta na primeira chamada de database_open() e fechada quando a thread termina */
+typedef struct thread_db_s {
+	sqlite3 *db_conn;
+	
+	// Chamadas de database_open() ainda sem o database_close() correspondente, permite chamadas aninhadas
+	int open_count;
+	
+	cached_stmt_t stmts[STMT_CACHE_SIZE];
+	int stmt_qty;
+	unsigned long use_counter;
+} thread_db_t;
+
+static pthread_key_t thread_db_key;
+static pthread_once_t thread_db_key_once = PTHREAD_ONCE_INIT;
+
+static void thread_db_free(void *ptr) {
+	thread_db_t *thread_db = (thread_db_t*) ptr;
+	
+	for(int i = 0; i < thread_db->stmt_qty; i++) {
+		sqlite3_finalize(thread_db->stmts[i].ppstmt);
+		free(thread_db->stmts[i].sql);
+	}
+	
+	sqlite3_close(thread_db->db_conn);
+	
+	free(thread_db);
+}
+
+static void thread_db_key_create() {
+	pthread_key_create(&thread_db_key, thread_db_free);
+}
+
+static thread_db_t *thread_db_get(int create) {
+	thread_db_t *thread_db;
+	
+	pthread_once(&thread_db_key_once, thread_db_key_create);
+	
+	if((thread_db = (thread_db_t*) pthread_getspecific(thread_db_key)) != NULL || !create)
+		return thread_db;
+	
+	if((thread_db = (thread_db_t*) calloc(1, sizeof(thread_db_t))) == NULL)
+		return NULL;
+	
+	if(pthread_setspecific(thread_db_key, thread_db)) {
+		free(thread_db);
+		return NULL;
+	}
+	
+	return thread_db;
+}
+
+static unsigned int sql_hash(const char *sql) {
+	unsigned int hash = 5381;
+	
+	while(*sql)
+		hash = hash * 33 + (unsigned char) *sql++;
+	
+	return hash;
+}
+
+/*
+ * Retorna a conexão persistente da thread, abrindo-a na primeira chamada. Todas as configurações da conexão
+ * são feitas aqui. Cada chamada bem sucedida deve ter um database_close() correspondente.
+ */
+int database_open(sqlite3 **db_conn) {
+	thread_db_t *thread_db;
+	int result;
+	
+	*db_conn = NULL;
+	
+	if((thread_db = thread_db_get(1)) == NULL)
+		return SQLITE_NOMEM;
+	
+	if(thread_db->db_conn == NULL) {
+		if((result = sqlite3_open(DB_FILENAME, &thread_db->db_conn)) != SQLITE_OK) {
+			sqlite3_close(thread_db->db_conn);
+			thread_db->db_conn = NULL;
+			
+			return result;
+		}
+		
+		sqlite3_busy_timeout(thread_db->db_conn, DB_BUSY_TIMEOUT);
+		
+		// Tabelas temporárias de ordenação e agrupamento ficam em memória, evitando escrita no cartão SD
+		sqlite3_exec(thread_db->db_conn, "PRAGMA temp_store = MEMORY;", NULL, NULL, NULL);
+	}
+	
+	thread_db->open_count++;
+	*db_conn = thread_db->db_conn;
+	
+	return SQLITE_OK;
+}
+
+/*
+ * Libera a conexão obtida com database_open(). A conexão continua aberta, mas ao liberar a última referência
+ * o estado é restaurado como se ela tivesse sido fechada: comandos esquecidos em execução são reiniciados
+ * e uma transação que não foi concluída é desfeita.
+ */
+void database_close(sqlite3 *db_conn) {
+	thread_db_t *thread_db;
+	sqlite3_stmt *ppstmt = NULL;
+	
+	if(db_conn == NULL)
+		return;
+	
+	if((thread_db = thread_db_get(0)) == NULL || thread_db->db_conn != db_conn) {
+		LOG_ERROR("Database connection closed outside of the thread that opened it.");
+		return;
+	}
+	
+	if(--thread_db->open_count > 0)
+		return;
+	
+	thread_db->open_count = 0;
+	
+	while((ppstmt = sqlite3_next_stmt(db_conn, ppstmt)) != NULL) {
+		if(sqlite3_stmt_busy(ppstmt))
+			sqlite3_reset(ppstmt);
+	}
+	
+	for(int i = 0; i < thread_db->stmt_qty; i++)
+		thread_db->stmts[i].in_use = 0;
+	
+	if(!sqlite3_get_autocommit(db_conn))
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+}
+
+/*
+ * Equivalente a sqlite3_prepare_v2(), mas reaproveita o comando compilado em uma chamada anterior com o mesmo SQL.
+ * Se o comando em cache ainda estiver em uso (consultas aninhadas) um novo comando é compilado fora do cache.
+ * O comando deve ser liberado com database_finalize() na mesma thread.
+ */
+int database_prepare(sqlite3 *db_conn, const char *sql, sqlite3_stmt **ppstmt) {
+	thread_db_t *thread_db;
+	cached_stmt_t *entry = NULL;
+	unsigned int hash;
+	int result;
+	
+	*ppstmt = NULL;
+	
+	if((thread_db = thread_db_get(0)) == NULL || thread_db->db_conn != db_conn)
+		return sqlite3_prepare_v2(db_conn, sql, -1, ppstmt, NULL);
+	
+	hash = sql_hash(sql);
+	
+	for(int i = 0; i < thread_db->stmt_qty; i++) {
+		if(thread_db->stmts[i].sql_hash == hash && strcmp(thread_db->stmts[i].sql, sql) == 0) {
+			if(thread_db->stmts[i].in_use)
+				return sqlite3_prepare_v2(db_conn, sql, -1, ppstmt, NULL);
+			
+			entry = &thread_db->stmts[i];
+			break;
+		}
+	}
+	
+	if(entry == NULL) {
+		if((result = sqlite3_prepare_v2(db_conn, sql, -1, ppstmt, NULL)) != SQLITE_OK || *ppstmt == NULL)
+			return result;
+		
+		/* Com o cache cheio substitui o comando usado há mais tempo, se todos estiverem em uso o novo fica fora do cache */
+		if(thread_db->stmt_qty < STMT_CACHE_SIZE) {
+			entry = &thread_db->stmts[thread_db->stmt_qty++];
+		} else {
+			for(int i = 0; i < STMT_CACHE_SIZE; i++) {
+				if(!thread_db->stmts[i].in_use && (entry == NULL || thread_db->stmts[i].last_use < entry->last_use))
+					entry = &thread_db->stmts[i];
+			}
+			
+			if(entry == NULL)
+				return SQLITE_OK;
+			
+			sqlite3_finalize(entry->ppstmt);
+			free(entry->sql);
+		}
+		
+		if((entry->sql = strdup(sql)) == NULL) {
+			// Sem memória para a chave o comando é usado uma única vez, fora do cache
+			*entry = thread_db->stmts[--thread_db->stmt_qty];
+			
+			return SQLITE_OK;
+		}
+		
+		entry->sql_hash = hash;
+		entry->ppstmt = *ppstmt;
+	}
+	
+	entry->in_use = 1;
+	entry->last_use = ++thread_db->use_counter;
+	
+	*ppstmt = entry->ppstmt;
+	
+	return SQLITE_OK;
+}
+
+/* Equivalente a sqlite3_finalize(), comandos do cache são apenas reiniciados e ficam disponíveis para o próximo uso */
+void database_finalize(sqlite3_stmt *ppstmt) {
+	thread_db_t *thread_db;
+	
+	if(ppstmt == NULL)
+		return;
+	
+	if((thread_db = thread_db_get(0)) != NULL) {
+		for(int i = 0; i < thread_db->stmt_qty; i++) {
+			if(thread_db->stmts[i].ppstmt == ppstmt) {
+				sqlite3_reset(ppstmt);
+				sqlite3_clear_bindings(ppstmt);
+				thread_db->stmts[i].in_use = 0;
+				
+				return;
+			}
+		}
+	}
+	
+	sqlite3_finalize(ppstmt);
+}
+
+/*
+ * Trava o banco de dados para uso exclusivo do processo, feito pelo backend em execução e pela reconstrução das
+ * tabelas de energia, que não podem rodar ao mesmo tempo. A trava é liberada pelo sistema quando o processo termina.
+ * Retorna 1 se outro processo já mantém a trava.
+ */
+int database_lock_exclusive() {
+	static int lock_fd = -1;
+	
+	if(lock_fd >= 0)
+		return 0;
+	
+	if((lock_fd = open(DB_LOCK_FILENAME, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+		return -1;
+	
+	if(flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+		close(lock_fd);
+		lock_fd = -1;
+		
+		return 1;
+	}
+	
+	return 0;
+}
@@ -1,3 +1,16 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+
 #include <sqlite3.h>
 
 #define DB_FILENAME "db.sqlite"
+#define DB_LOCK_FILENAME "db.sqlite.lock"
+#define DB_BUSY_TIMEOUT 1000
+
+int database_open(sqlite3 **db_conn);
+void database_close(sqlite3 *db_conn);
+int database_prepare(sqlite3 *db_conn, const char *sql, sqlite3_stmt **ppstmt);
+void database_finalize(sqlite3_stmt *ppstmt);
+int database_lock_exclusive();
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
@@ -14,23 +15,18 @@
 #include "energy.h"
 #include "database.h"
 #include "disaggregation.h"
+#include "event_detector.h"
+#include "classifier.h"
+#include "signature_matrix.h"
+#include "appliance_tracker.h"
+#include "load_event_store.h"
+#include "replay.h"
 
 #define LOAD_EVENT_BUFFER_SIZE (24 * 3600)
-#define DISAGGREGATION_BUFFER_SIZE 10
-#define MAX_TIME_GAP 4
-#define SVM_PARAM_QTY_ON 5
-#define SVM_PARAM_QTY_OFF 4
-#define SVM_CROSSV_FOLD_NUM 5
-
-typedef struct load_signature_s {
-	int appliance_id;
-	double delta_pt;
-	double peak_pt;
-	double delta_p[2];
-	double delta_q[2];
-	double delta_s[2];
-	double features[SVM_PARAM_QTY_ON];
-} load_signature_t;
+#define DISAGGREGATION_BUFFER_SIZE 64
+#define DISAGGREGATION_WAIT_TIMEOUT 1000
+#define RECLASSIFICATION_BATCH_SIZE 256
+#define RECLASSIFICATION_WAIT_TIMEOUT 1000
 
 static pthread_mutex_t load_event_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -38,100 +34,239 @@ static load_event_t load_event_buffer[LOAD_EVENT_BUFFER_SIZE];
 static int load_event_buffer_pos = 0;
 static int load_event_buffer_count = 0;
 
-void svm_print_string_f(const char *s) {
-	LOG_DEBUG(s);
-}
-
 void *disaggregation_loop(void *argp) {
 	int *terminate = (int*) argp;
 	
 	int result;
 	double detection_threshold;
+	event_detector_type_t detector_type;
+	int knn_k;
 	time_t last_timestamp = 0;
 	power_data_t pd_buffer[DISAGGREGATION_BUFFER_SIZE];
-	double ptotal_buffer[DISAGGREGATION_BUFFER_SIZE];
+	event_detector_t detector;
 	load_event_t load_event;
-	int time_gap;
-	double pavg_before, pavg_after;
 	
 	srand(time(NULL));
-	svm_set_print_string_function(&svm_print_string_f);
 	
 	detection_threshold = config_get_value_double("load_event_detection_threshold", 10, 100, 50);
 	
 	LOG_INFO("Load event detection threshold: %.1lf W", detection_threshold);
 	
+	knn_k = config_get_value_int("knn_k", 1, SIGNATURE_KNN_MAX_K, 5);
+	
+	detector_type = event_detector_get_configured_type();
+	
+	LOG_INFO("Load event detector: %s", event_detector_type_name(detector_type));
+	
+	event_detector_init(&detector, detector_type, detection_threshold);
+	
 	while(!(*terminate)) {
-		if((result = get_power_data(last_timestamp, 0, pd_buffer, DISAGGREGATION_BUFFER_SIZE)) != DISAGGREGATION_BUFFER_SIZE) {
-			sleep(1);
+		/* Aguarda a chegada de novas amostras, sinalizada por store_power_data() */
+		if(power_wait_new_data(last_timestamp, DISAGGREGATION_WAIT_TIMEOUT) <= last_timestamp)
+			continue;
+		
+		if((result = get_power_data(last_timestamp + 1, 0, pd_buffer, DISAGGREGATION_BUFFER_SIZE)) <= 0)
 			continue;
+		
+		for(int i = 0; i < result; i++) {
+			if(event_detector_feed(&detector, &pd_buffer[i], &load_event) != 1)
+				continue;
+			
+			classify_load_event(&load_event, knn_k);
+			
+			appliance_tracker_feed(&load_event);
+			
+			load_event_store_add(&load_event);
+			
+			pthread_mutex_lock(&load_event_mutex);
+			
+			memcpy(&load_event_buffer[load_event_buffer_pos], &load_event, sizeof(load_event_t));
+			
+			load_event_buffer_pos = (load_event_buffer_pos + 1) % LOAD_EVENT_BUFFER_SIZE;
+			if(load_event_buffer_count < LOAD_EVENT_BUFFER_SIZE)
+				load_event_buffer_count++;
+			
+			pthread_mutex_unlock(&load_event_mutex);
 		}
 		
-		load_event.time_gap = (last_timestamp > 0) ? (pd_buffer[0].timestamp - last_timestamp) : 0;
+		last_timestamp = pd_buffer[result - 1].timestamp;
+		
+		appliance_tracker_update(last_timestamp);
+		
+		load_event_store_update(last_timestamp);
+	}
+	
+	appliance_tracker_flush();
+	
+	if(load_event_store_flush() < 0)
+		LOG_ERROR("Failed to store pending load events.");
+	
+	return NULL;
+}
+
+/* Índice (a partir do mais antigo) do primeiro evento do buffer com timestamp maior que o indicado, igual a
+ * load_event_buffer_count se não houver. Os eventos estão em ordem cronológica, então a busca é binária.
+ * Deve ser chamada com load_event_mutex travado. */
+static int load_event_buffer_find_after(time_t timestamp, int oldest_pos) {
+	int low = 0, high = load_event_buffer_count;
+	
+	while(low < high) {
+		int middle = (low + high) / 2;
+		
+		if(load_event_buffer[(oldest_pos + middle) % LOAD_EVENT_BUFFER_SIZE].timestamp > timestamp)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	
+	return low;
+}
+
+/* Reclassifica em lotes os eventos do buffer classificados com modelos anteriores a model_version. Cada lote é
+ * copiado com o buffer travado, classificado fora dele e gravado de volta campo a campo, apenas se a posição ainda
+ * contém o mesmo evento. Assim a detecção e as leituras de /power/events esperam no máximo a cópia de um lote. */
+static int reclassify_load_events(int model_version, int knn_k, volatile int *terminate) {
+	load_event_t batch[RECLASSIFICATION_BATCH_SIZE];
+	int positions[RECLASSIFICATION_BATCH_SIZE];
+	int batch_qty;
+	int reclassified_qty = 0;
+	int finished = 0;
+	time_t cursor = 0;
+	
+	while(!finished && !(*terminate)) {
+		int oldest_pos;
+		
+		batch_qty = 0;
+		
+		pthread_mutex_lock(&load_event_mutex);
 		
-		last_timestamp = pd_buffer[1].timestamp;
+		oldest_pos = (load_event_buffer_count < LOAD_EVENT_BUFFER_SIZE) ? 0 : load_event_buffer_pos;
+		finished = 1;
 		
-		time_gap = 0;
-		for(int i = 0; i < DISAGGREGATION_BUFFER_SIZE; i++) {
-			if(i != 0)
-				time_gap += (pd_buffer[i].timestamp - pd_buffer[i - 1].timestamp) - 1;
+		for(int index = load_event_buffer_find_after(cursor, oldest_pos); index < load_event_buffer_count; index++) {
+			int pos = (oldest_pos + index) % LOAD_EVENT_BUFFER_SIZE;
 			
-			ptotal_buffer[i] = pd_buffer[i].p[0] + pd_buffer[i].p[1];
+			if(batch_qty == RECLASSIFICATION_BATCH_SIZE) {
+				finished = 0;
+				break;
+			}
+			
+			cursor = load_event_buffer[pos].timestamp;
+			
+			if(load_event_buffer[pos].model_version >= model_version)
+				continue;
+			
+			memcpy(&batch[batch_qty], &load_event_buffer[pos], sizeof(load_event_t));
+			positions[batch_qty] = pos;
+			batch_qty++;
 		}
 		
-		if(time_gap > MAX_TIME_GAP)
-			continue;
+		pthread_mutex_unlock(&load_event_mutex);
 		
-		if(fabs(ptotal_buffer[1] - ptotal_buffer[0]) < (fabs(ptotal_buffer[3] - ptotal_buffer[1]) * 0.5) && fabs(ptotal_buffer[2] - ptotal_buffer[1]) > (detection_threshold * 0.2) && fabs(ptotal_buffer[3] - ptotal_buffer[1]) > (detection_threshold * 0.2)) {
-			pavg_before = (ptotal_buffer[0] + ptotal_buffer[1]) / 2.0;
-			
-			for(int k = 3; k < DISAGGREGATION_BUFFER_SIZE - 2; k++) {
-				pavg_after = (ptotal_buffer[k] + ptotal_buffer[k + 1]) / 2.0;
-				
-				if(fabs(pavg_after - pavg_before) > detection_threshold && fabs(ptotal_buffer[k + 1] - ptotal_buffer[k]) < (fabs(ptotal_buffer[3] - ptotal_buffer[1]) * 0.5) && ((pavg_after - pavg_before) * (ptotal_buffer[3] - ptotal_buffer[1]) > 0.0)) {
-					load_event.timestamp = pd_buffer[1].timestamp;
-					load_event.duration = k - 1;
-					load_event.delta_pt = (pavg_after - pavg_before);
-					load_event.delta_p[0] = ((pd_buffer[k].p[0] + pd_buffer[k + 1].p[0]) / 2.0) - ((pd_buffer[0].p[0] + pd_buffer[1].p[0]) / 2.0);
-					load_event.delta_p[1] = ((pd_buffer[k].p[1] + pd_buffer[k + 1].p[1]) / 2.0) - ((pd_buffer[0].p[1] + pd_buffer[1].p[1]) / 2.0);
-					load_event.delta_s[0] = ((pd_buffer[k].s[0] + pd_buffer[k + 1].s[0]) / 2.0) - ((pd_buffer[0].s[0] + pd_buffer[1].s[0]) / 2.0);
-					load_event.delta_s[1] = ((pd_buffer[k].s[1] + pd_buffer[k + 1].s[1]) / 2.0) - ((pd_buffer[0].s[1] + pd_buffer[1].s[1]) / 2.0);
-					load_event.delta_q[0] = ((pd_buffer[k].q[0] + pd_buffer[k + 1].q[0]) / 2.0) - ((pd_buffer[0].q[0] + pd_buffer[1].q[0]) / 2.0);
-					load_event.delta_q[1] = ((pd_buffer[k].q[1] + pd_buffer[k + 1].q[1]) / 2.0) - ((pd_buffer[0].q[1] + pd_buffer[1].q[1]) / 2.0);
-					
-					if(load_event.delta_pt > 0.0) {
-						load_event.peak_pt = load_event.delta_pt;
-						
-						for(int z = 2; z <= k; z++)
-							if((ptotal_buffer[z] - pavg_before) > load_event.peak_pt)
-								load_event.peak_pt = (ptotal_buffer[z] - pavg_before);
-					}
-					
-					load_event.top_appliance_id = -1;
-					pthread_mutex_lock(&load_event_mutex);
-					
-					memcpy(&load_event_buffer[load_event_buffer_pos], &load_event, sizeof(load_event_t));
-					
-					load_event_buffer_pos = (load_event_buffer_pos + 1) % LOAD_EVENT_BUFFER_SIZE;
-					if(load_event_buffer_count < LOAD_EVENT_BUFFER_SIZE)
-						load_event_buffer_count++;
-					
-					pthread_mutex_unlock(&load_event_mutex);
-					
-					last_timestamp = pd_buffer[k].timestamp;
-					
-					break;
-				}
-			}
+		for(int i = 0; i < batch_qty; i++)
+			classify_load_event(&batch[i], knn_k);
+		
+		pthread_mutex_lock(&load_event_mutex);
+		
+		for(int i = 0; i < batch_qty; i++) {
+			load_event_t *load_event = &load_event_buffer[positions[i]];
+			
+			// A posição pode ter sido sobrescrita por um evento novo enquanto o lote era classificado
+			if(load_event->timestamp != batch[i].timestamp || load_event->model_version >= batch[i].model_version)
+				continue;
+			
+			load_event->top_appliance_id = batch[i].top_appliance_id;
+			memcpy(load_event->appliance_ids, batch[i].appliance_ids, sizeof(load_event->appliance_ids));
+			memcpy(load_event->appliance_probs, batch[i].appliance_probs, sizeof(load_event->appliance_probs));
+			load_event->prob_avg = batch[i].prob_avg;
+			load_event->prob_sd = batch[i].prob_sd;
+			load_event->knn_appliance_id = batch[i].knn_appliance_id;
+			load_event->knn_confidence = batch[i].knn_confidence;
+			load_event->model_version = batch[i].model_version;
+			
+			load_event_store_add(load_event);
+			
+			reclassified_qty++;
 		}
+		
+		pthread_mutex_unlock(&load_event_mutex);
+	}
+	
+	return reclassified_qty;
+}
+
+/* Reclassifica em lotes lidos do banco de dados os eventos gravados anteriores ao evento mais antigo do buffer (ou
+ * todos, logo após uma reinicialização), que de outra forma manteriam a classificação de um modelo antigo */
+static int reclassify_stored_load_events(int model_version, int knn_k, volatile int *terminate) {
+	load_event_t batch[RECLASSIFICATION_BATCH_SIZE];
+	int batch_qty;
+	int reclassified_qty = 0;
+	time_t cursor = 0;
+	time_t timestamp_end;
+	int oldest_pos;
+	
+	pthread_mutex_lock(&load_event_mutex);
+	
+	oldest_pos = (load_event_buffer_count < LOAD_EVENT_BUFFER_SIZE) ? 0 : load_event_buffer_pos;
+	timestamp_end = (load_event_buffer_count > 0) ? load_event_buffer[oldest_pos].timestamp - 1 : replay_now();
+	
+	pthread_mutex_unlock(&load_event_mutex);
+	
+	while(!(*terminate)) {
+		if((batch_qty = load_event_store_get_outdated(cursor, timestamp_end, model_version, batch, RECLASSIFICATION_BATCH_SIZE)) <= 0)
+			break;
+		
+		for(int i = 0; i < batch_qty; i++)
+			classify_load_event(&batch[i], knn_k);
+		
+		if(load_event_store_update_classification(batch, batch_qty))
+			break;
+		
+		reclassified_qty += batch_qty;
+		cursor = batch[batch_qty - 1].timestamp + 1;
+		
+		if(batch_qty < RECLASSIFICATION_BATCH_SIZE)
+			break;
+	}
+	
+	return reclassified_qty;
+}
+
+/* Reclassifica os eventos já detectados sempre que uma nova versão dos modelos é publicada */
+void *reclassification_loop(void *argp) {
+	int *terminate = (int*) argp;
+	int model_version = 0;
+	int new_version;
+	int knn_k;
+	int result;
+	
+	knn_k = config_get_value_int("knn_k", 1, SIGNATURE_KNN_MAX_K, 5);
+	
+	while(!(*terminate)) {
+		if((new_version = classifier_wait_version_change(model_version, RECLASSIFICATION_WAIT_TIMEOUT)) == model_version)
+			continue;
+		
+		model_version = new_version;
+		
+		if((result = reclassify_load_events(model_version, knn_k, terminate)) > 0)
+			LOG_INFO("Reclassified %d load events with classifier version %d.", result, model_version);
+		
+		if((result = reclassify_stored_load_events(model_version, knn_k, terminate)) > 0)
+			LOG_INFO("Reclassified %d stored load events with classifier version %d.", result, model_version);
 	}
 	
+	load_event_store_flush();
+	
 	return NULL;
 }
 
+/* Os eventos mais recentes vêm do buffer em memória, a parte do intervalo anterior ao evento mais antigo do buffer
+ * (ou o intervalo inteiro, logo após uma reinicialização) é lida do banco de dados */
 int get_load_events(time_t timestamp_start, time_t timestamp_end, load_event_t *buffer, int buffer_len) {
 	int pos;
 	int output_count = 0;
+	time_t oldest_timestamp;
+	int result;
 	
 	if(buffer == NULL)
 		return -1;
@@ -139,6 +274,29 @@ int get_load_events(time_t timestamp_start, time_t timestamp_end, load_event_t *
 	if(buffer_len == 0 || timestamp_end < timestamp_start)
 		return 0;
 	
+	if(pthread_mutex_lock(&load_event_mutex))
+		return -2;
+	
+	pos = (load_event_buffer_count < LOAD_EVENT_BUFFER_SIZE) ? 0 : load_event_buffer_pos;
+	oldest_timestamp = (load_event_buffer_count > 0) ? load_event_buffer[pos].timestamp : 0;
+	
+	pthread_mutex_unlock(&load_event_mutex);
+	
+	if(oldest_timestamp == 0 || timestamp_start < oldest_timestamp) {
+		if(oldest_timestamp != 0 && (timestamp_end <= 0 || timestamp_end >= oldest_timestamp))
+			result = load_event_store_get(timestamp_start, oldest_timestamp - 1, buffer, buffer_len);
+		else
+			result = load_event_store_get(timestamp_start, (timestamp_end > 0) ? timestamp_end : replay_now(), buffer, buffer_len);
+		
+		if(result < 0)
+			return -2;
+		
+		output_count = result;
+		
+		if(oldest_timestamp == 0)
+			return output_count;
+	}
+	
 	if(pthread_mutex_lock(&load_event_mutex))
 		return -2;
 	
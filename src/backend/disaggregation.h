@@ -1,3 +1,10 @@
+#ifndef DISAGGREGATION_H
+#define DISAGGREGATION_H
+
+#include <time.h>
+
+#define LOAD_EVENT_APPLIANCE_QTY 3
+
 typedef struct load_event_s {
 	time_t timestamp;
 	int time_gap;
@@ -10,6 +17,23 @@ typedef struct load_event_s {
 	
 	int top_appliance_id;
 	
+	/* Aparelhos mais prováveis segundo o classificador, com a média e o desvio padrão das suas probabilidades */
+	int appliance_ids[LOAD_EVENT_APPLIANCE_QTY];
+	double appliance_probs[LOAD_EVENT_APPLIANCE_QTY];
+	double prob_avg;
+	double prob_sd;
+	
+	/* Aparelho dos vizinhos mais próximos entre as assinaturas, para conferência do classificador */
+	int knn_appliance_id;
+	double knn_confidence;
+	
+	// Versão dos modelos usada na classificação, zero se não havia modelo
+	int model_version;
 } load_event_t;
 
+void classify_load_event(load_event_t *load_event, int knn_k);
 int get_load_events(time_t timestamp_start, time_t timestamp_end, load_event_t *buffer, int buffer_len);
+
+int disaggregation_batch(time_t timestamp_start, time_t timestamp_end, int thread_qty);
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "logger.h"
+#include "config.h"
+#include "power.h"
+#include "archive.h"
+#include "database.h"
+#include "disaggregation.h"
+#include "event_detector.h"
+#include "classifier.h"
+#include "signature_matrix.h"
+#include "load_event_store.h"
+
+/* Eventos detectados em um arquivo diário, alocados em um único bloco */
+typedef struct batch_day_result_s {
+	int event_qty;
+	load_event_t events[];
+} batch_day_result_t;
+
+typedef struct batch_ctx_s {
+	event_detector_type_t detector_type;
+	double detection_threshold;
+	int knn_k;
+	time_t timestamp_start;
+	time_t timestamp_end;
+	sqlite3 *db_conn;
+	sqlite3_stmt *stmt_delete;
+	sqlite3_stmt *stmt_insert;
+	int day_file_qty;
+	long sample_qty;
+	long event_qty;
+} batch_ctx_t;
+
+/* Executada nas threads de trabalho, cada dia é varrido pelo detector em lote. Eventos cujo transitório cruza a
+ * meia-noite UTC (divisão dos arquivos) não são detectados. */
+static void *batch_process_day(time_t day_start, const power_data_t *data, int count, void *arg) {
+	batch_ctx_t *ctx = (batch_ctx_t*) arg;
+	batch_day_result_t *result;
+	load_event_t *events;
+	int event_qty;
+	
+	if((event_qty = event_detector_detect_batch(ctx->detector_type, ctx->detection_threshold, data, count, &events)) < 0) {
+		LOG_ERROR("Failed to detect load events in day starting at %ld.", day_start);
+		return NULL;
+	}
+	
+	// O resultado deve ser um único bloco, liberado com free() caso não seja consumido
+	if((result = (batch_day_result_t*) malloc(sizeof(batch_day_result_t) + sizeof(load_event_t) * event_qty)) == NULL) {
+		LOG_ERROR("Failed to allocate memory for batch disaggregation.");
+		free(events);
+		
+		return NULL;
+	}
+	
+	result->event_qty = event_qty;
+	
+	for(int i = 0; i < event_qty; i++) {
+		classify_load_event(&events[i], ctx->knn_k);
+		
+		memcpy(&result->events[i], &events[i], sizeof(load_event_t));
+	}
+	
+	free(events);
+	
+	return result;
+}
+
+/* Executada na thread principal, na ordem dos dias. Os eventos de cada dia são substituídos em uma transação curta,
+ * para que as gravações do backend em execução não fiquem bloqueadas durante todo o processamento. */
+static int batch_consume_day(time_t day_start, void *result_ptr, void *arg) {
+	batch_ctx_t *ctx = (batch_ctx_t*) arg;
+	batch_day_result_t *result = (batch_day_result_t*) result_ptr;
+	
+	if(sqlite3_exec(ctx->db_conn, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL) != SQLITE_OK) {
+		LOG_ERROR("Failed to begin SQL transaction: %s", sqlite3_errmsg(ctx->db_conn));
+		free(result);
+		
+		return -1;
+	}
+	
+	// Dias sem arquivo (ou com falha na detecção) também têm os eventos antigos removidos
+	if(sqlite3_bind_int64(ctx->stmt_delete, 1, MAX(day_start, ctx->timestamp_start)) != SQLITE_OK
+		|| sqlite3_bind_int64(ctx->stmt_delete, 2, MIN(day_start + 24 * 3600, ctx->timestamp_end)) != SQLITE_OK
+		|| sqlite3_step(ctx->stmt_delete) != SQLITE_DONE) {
+		
+		LOG_ERROR("Failed to delete old load events: %s", sqlite3_errmsg(ctx->db_conn));
+		sqlite3_exec(ctx->db_conn, "ROLLBACK", NULL, NULL, NULL);
+		free(result);
+		
+		return -1;
+	}
+	
+	sqlite3_reset(ctx->stmt_delete);
+	
+	for(int i = 0; result && i < result->event_qty; i++) {
+		if(load_event_store_insert(ctx->stmt_insert, &result->events[i])) {
+			LOG_ERROR("Failed to store load event: %s", sqlite3_errmsg(ctx->db_conn));
+			sqlite3_exec(ctx->db_conn, "ROLLBACK", NULL, NULL, NULL);
+			free(result);
+			
+			return -1;
+		}
+	}
+	
+	if(sqlite3_exec(ctx->db_conn, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+		LOG_ERROR("Failed to commit load events: %s", sqlite3_errmsg(ctx->db_conn));
+		sqlite3_exec(ctx->db_conn, "ROLLBACK", NULL, NULL, NULL);
+		free(result);
+		
+		return -1;
+	}
+	
+	if(result == NULL)
+		return 0;
+	
+	ctx->day_file_qty++;
+	ctx->event_qty += result->event_qty;
+	
+	LOG_DEBUG("Detected %d load events in day starting at %ld.", result->event_qty, day_start);
+	
+	free(result);
+	
+	return 0;
+}
+
+/*
+ * Executa a detecção de eventos de carga (e a classificação, se houver modelos salvos ou assinaturas) sobre os
+ * arquivos pd-*.csv no intervalo [timestamp_start, timestamp_end), um dia por thread, substituindo os eventos
+ * gravados nesse intervalo. Roda como um processo separado e pode ser executado com o backend em funcionamento:
+ * cada dia é gravado em sua própria transação, então as gravações do backend esperam no máximo uma delas
+ * (DB_BUSY_TIMEOUT). O intervalo não deve incluir o dia atual, cujos eventos ainda estão sendo gravados pela
+ * desagregação em tempo real. Em caso de falha os dias já gravados são mantidos.
+ */
+int disaggregation_batch(time_t timestamp_start, time_t timestamp_end, int thread_qty) {
+	int result;
+	batch_ctx_t ctx;
+	time_t batch_start_time;
+	const char sql_delete_events[] = "DELETE FROM load_events WHERE timestamp >= ?1 AND timestamp < ?2;";
+	
+	if(timestamp_end <= timestamp_start)
+		return -1;
+	
+	memset(&ctx, 0, sizeof(batch_ctx_t));
+	
+	ctx.timestamp_start = timestamp_start;
+	ctx.timestamp_end = timestamp_end;
+	ctx.detector_type = event_detector_get_configured_type();
+	ctx.detection_threshold = config_get_value_double("load_event_detection_threshold", 10, 100, 50);
+	ctx.knn_k = config_get_value_int("knn_k", 1, SIGNATURE_KNN_MAX_K, 5);
+	
+	if(load_event_store_init())
+		return -1;
+	
+	// Sem modelos ou assinaturas os eventos são gravados sem classificação
+	if(classifier_init() < 0)
+		LOG_WARN("Failed to initialize appliance classifier, load events will not be classified.");
+	
+	if(signature_matrix_load() < 0)
+		LOG_WARN("Failed to load signature matrix.");
+	
+	LOG_INFO("Detecting load events from %ld to %ld using %s detector.", timestamp_start, timestamp_end, event_detector_type_name(ctx.detector_type));
+	
+	if((result = database_open(&ctx.db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(ctx.db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(ctx.db_conn, sql_delete_events, &ctx.stmt_delete)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(ctx.db_conn);
+		
+		return -1;
+	}
+	
+	if(load_event_store_prepare_insert(ctx.db_conn, &ctx.stmt_insert)) {
+		database_finalize(ctx.stmt_delete);
+		database_close(ctx.db_conn);
+		
+		return -1;
+	}
+	
+	batch_start_time = time(NULL);
+	
+	result = archive_process_days(timestamp_start, timestamp_end, thread_qty, batch_process_day, batch_consume_day, &ctx);
+	
+	database_finalize(ctx.stmt_insert);
+	database_finalize(ctx.stmt_delete);
+	database_close(ctx.db_conn);
+	
+	if(result) {
+		LOG_ERROR("Batch disaggregation failed after %d power data files, the days already processed were kept.", ctx.day_file_qty);
+		return -2;
+	}
+	
+	LOG_INFO("Detected %ld load events from %d power data files in %ld s.", ctx.event_qty, ctx.day_file_qty, (long)(time(NULL) - batch_start_time));
+	
+	return 0;
+}
@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "logger.h"
+#include "disaggregation.h"
+#include "classifier.h"
+#include "signature_matrix.h"
+
+/* Classificação compartilhada pela desagregação contínua, em lote, pela reclassificação e pelo tcc-benchmark */
+void classify_load_event(load_event_t *load_event, int knn_k) {
+	load_event->knn_appliance_id = -1;
+	load_event->knn_confidence = 0.0;
+	
+	/* Sem modelo SVM (ainda em treinamento ou sem assinaturas suficientes) o resultado do k-NN é usado */
+	if(classifier_classify(load_event) != 0 || load_event->top_appliance_id < 0) {
+		if(signature_matrix_classify(load_event, knn_k, &load_event->knn_appliance_id, &load_event->knn_confidence) == 0) {
+			load_event->top_appliance_id = load_event->knn_appliance_id;
+			load_event->appliance_ids[0] = load_event->knn_appliance_id;
+			load_event->appliance_probs[0] = load_event->knn_confidence;
+		}
+	} else if(signature_matrix_classify(load_event, knn_k, &load_event->knn_appliance_id, &load_event->knn_confidence) == 0
+				&& load_event->knn_appliance_id != load_event->top_appliance_id) {
+		LOG_DEBUG("Classifiers disagree on load event at %ld: SVM %d, k-NN %d.", load_event->timestamp, load_event->top_appliance_id, load_event->knn_appliance_id);
+	}
+}
@@ -1,14 +1,206 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "logger.h"
 #include "config.h"
 #include "power.h"
+#include "energy.h"
 #include "database.h"
+#include "replay.h"
+
+#define MINUTE_CACHE_DEFAULT_DAYS 2
+#define MINUTE_CACHE_MAX_DAYS 7
+
+/* Cache dos minutos mais recentes, cada minuto ocupa a posição (timestamp / 60) % minute_cache_size. Uma posição
+ * cujo timestamp não é o do minuto procurado indica que não há dados para aquele minuto. */
+static pthread_rwlock_t minute_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static energy_minute_t *minute_cache = NULL;
+static int minute_cache_size = 0;
+static time_t minute_cache_start = 0;
+static time_t minute_cache_last = 0;
+
+static void minute_cache_add(time_t timestamp_minute, time_t latest_second, double active, double reactive, double min_p, double cost) {
+	energy_minute_t *minute;
+	
+	if(pthread_rwlock_wrlock(&minute_cache_lock))
+		return;
+	
+	if(minute_cache == NULL) {
+		pthread_rwlock_unlock(&minute_cache_lock);
+		return;
+	}
+	
+	/* Minutos atrasados anteriores à janela do cache são ignorados, ocupariam a posição de um minuto mais recente */
+	if(minute_cache_last - timestamp_minute >= (time_t) minute_cache_size * 60) {
+		pthread_rwlock_unlock(&minute_cache_lock);
+		return;
+	}
+	
+	minute = &minute_cache[(timestamp_minute / 60) % minute_cache_size];
+	
+	if(timestamp_minute > minute->timestamp) {
+		minute->timestamp = timestamp_minute;
+		minute->second_count = 1;
+		minute->latest_second = latest_second;
+		minute->active = active;
+		minute->reactive = reactive;
+		minute->min_p = min_p;
+		minute->cost = cost;
+	} else if(minute->timestamp == timestamp_minute && minute->latest_second < latest_second) {
+		/* Mesmo critério do "ON CONFLICT" usado na tabela energy_minutes */
+		minute->second_count++;
+		minute->latest_second = latest_second;
+		minute->active += active;
+		minute->reactive += reactive;
+		minute->min_p = MIN(minute->min_p, min_p);
+		minute->cost += cost;
+	}
+	
+	if(timestamp_minute > minute_cache_last)
+		minute_cache_last = timestamp_minute;
+	
+	pthread_rwlock_unlock(&minute_cache_lock);
+}
+
+/* Carrega os últimos dias da tabela energy_minutes para o cache, deve ser chamada antes de iniciar a aquisição de dados. */
+int energy_minute_cache_init() {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_energy_minutes[] = "SELECT timestamp,second_count,latest_second,active,reactive,min_p,cost FROM energy_minutes WHERE timestamp >= ?1;";
+	int cache_days;
+	time_t now_minute;
+	time_t cache_start;
+	energy_minute_t *cache;
+	int count = 0;
+	
+	cache_days = config_get_value_int("energy_minute_cache_days", 1, MINUTE_CACHE_MAX_DAYS, MINUTE_CACHE_DEFAULT_DAYS);
+	
+	if((cache = (energy_minute_t*) calloc(cache_days * 24 * 60, sizeof(energy_minute_t))) == NULL) {
+		LOG_ERROR("Failed to allocate memory for energy minute cache.");
+		return -1;
+	}
+	
+	now_minute = replay_now();
+	now_minute -= now_minute % 60;
+	
+	cache_start = now_minute - (cache_days * 24 * 60 - 1) * 60;
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		free(cache);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_energy_minutes, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		free(cache);
+		
+		return -1;
+	}
+	
+	if(sqlite3_bind_int64(ppstmt, 1, cache_start) != SQLITE_OK) {
+		LOG_ERROR("Failed to bind value to prepared statement.");
+		database_finalize(ppstmt);
+		database_close(db_conn);
+		free(cache);
+		
+		return -1;
+	}
+	
+	pthread_rwlock_wrlock(&minute_cache_lock);
+	
+	minute_cache = cache;
+	minute_cache_size = cache_days * 24 * 60;
+	minute_cache_last = 0;
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		time_t timestamp = sqlite3_column_int64(ppstmt, 0);
+		energy_minute_t *minute = &minute_cache[(timestamp / 60) % minute_cache_size];
+		
+		minute->timestamp = timestamp;
+		minute->second_count = sqlite3_column_int(ppstmt, 1);
+		minute->latest_second = sqlite3_column_int64(ppstmt, 2);
+		minute->active = sqlite3_column_double(ppstmt, 3);
+		minute->reactive = sqlite3_column_double(ppstmt, 4);
+		minute->min_p = sqlite3_column_double(ppstmt, 5);
+		minute->cost = sqlite3_column_double(ppstmt, 6);
+		
+		minute_cache_last = MAX(minute_cache_last, timestamp);
+		
+		count++;
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to load energy minute cache: %s", sqlite3_errstr(result));
+		
+		minute_cache = NULL;
+		minute_cache_size = 0;
+		
+		pthread_rwlock_unlock(&minute_cache_lock);
+		
+		free(cache);
+		
+		return -1;
+	}
+	
+	minute_cache_start = cache_start;
+	
+	pthread_rwlock_unlock(&minute_cache_lock);
+	
+	LOG_INFO("Loaded %d minutes into the energy minute cache (%d days).", count, cache_days);
+	
+	return count;
+}
+
+/* Retorna os minutos do intervalo [timestamp_start, timestamp_end] a partir do cache, ou -1 se o intervalo
+ * não estiver totalmente coberto pelo cache, nesse caso a consulta deve ser feita no banco de dados. */
+int energy_minute_cache_get(time_t timestamp_start, time_t timestamp_end, energy_minute_t *buffer, int buffer_len) {
+	time_t first_minute, window_start;
+	int output_count = 0;
+	
+	if(buffer == NULL)
+		return -2;
+	
+	if(pthread_rwlock_rdlock(&minute_cache_lock))
+		return -2;
+	
+	/* O cache só guarda os últimos minute_cache_size minutos, contando a partir do mais recente recebido */
+	window_start = MAX(minute_cache_start, minute_cache_last - (time_t)(minute_cache_size - 1) * 60);
+	
+	if(minute_cache == NULL || timestamp_start < window_start) {
+		pthread_rwlock_unlock(&minute_cache_lock);
+		return -1;
+	}
+	
+	first_minute = timestamp_start + ((60 - (timestamp_start % 60)) % 60);
+	
+	for(time_t timestamp = first_minute; timestamp <= timestamp_end && timestamp <= minute_cache_last && output_count < buffer_len; timestamp += 60) {
+		const energy_minute_t *minute = &minute_cache[(timestamp / 60) % minute_cache_size];
+		
+		if(minute->timestamp != timestamp)
+			continue;
+		
+		memcpy(&buffer[output_count++], minute, sizeof(energy_minute_t));
+	}
+	
+	pthread_rwlock_unlock(&minute_cache_lock);
+	
+	return output_count;
+}
 
 int energy_add_power(power_data_t *pd) {
 	int result;
@@ -45,18 +237,16 @@ int energy_add_power(power_data_t *pd) {
 	
 	cost = config_get_value_double("kwh_rate", 0, 10, 0) * active_energy_total;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
 	if(sqlite3_exec(db_conn, "BEGIN TRANSACTION", NULL, NULL, NULL) != SQLITE_OK) {
 		LOG_ERROR("Failed to begin SQL transaction: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -64,9 +254,9 @@ int energy_add_power(power_data_t *pd) {
 	/*
 	 * Minuto
 	 */
-	if((result = sqlite3_prepare_v2(db_conn, sql_store_minute, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_store_minute, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare the SQL statement for minute power data storage: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -81,19 +271,19 @@ int energy_add_power(power_data_t *pd) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to store power data as minute: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -101,9 +291,9 @@ int energy_add_power(power_data_t *pd) {
 	/*
 	 * Hora
 	 */
-	if((result = sqlite3_prepare_v2(db_conn, sql_store_hour, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_store_hour, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare the SQL statement for hour power data storage: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -120,19 +310,19 @@ int energy_add_power(power_data_t *pd) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to store power data as hour: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -140,9 +330,9 @@ int energy_add_power(power_data_t *pd) {
 	/*
 	 * Dia
 	 */
-	if((result = sqlite3_prepare_v2(db_conn, sql_store_day, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_store_day, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare the SQL statement for day power data storage: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -158,31 +348,34 @@ int energy_add_power(power_data_t *pd) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to store power data as day: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if(sqlite3_exec(db_conn, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
 		LOG_ERROR("Failed to commit power data to database: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -2;
 	}
 	
-	sqlite3_close(db_conn);
+	database_close(db_conn);
+	
+	minute_cache_add(timestamp_minute, pd->timestamp, active_energy_total, reactive_energy_total, p_total, cost);
+	energy_calendar_add(year, month, day, timestamp_minute);
 	
 	return 0;
 }
@@ -5,6 +5,9 @@
 
 #include "power.h"
 
+#define ENERGY_AGGREGATE_MAX_BUCKETS 4096
+#define ENERGY_CALENDAR_MAX_MONTHS 1200
+
 typedef struct energy_rate_s {
 	time_t start_timestamp;
 	double rate;
@@ -19,6 +22,37 @@ typedef struct energy_rate_s {
 	time_t modification_date;
 } energy_rate_t;
 
+typedef struct energy_minute_s {
+	time_t timestamp;
+	int second_count;
+	time_t latest_second;
+	double active;
+	double reactive;
+	double min_p;
+	double cost;
+} energy_minute_t;
+
+typedef struct energy_bucket_s {
+	time_t timestamp;
+	int second_count;
+	double active;
+	double reactive;
+	double cost;
+} energy_bucket_t;
+
+typedef struct energy_calendar_month_s {
+	int year;
+	int month;
+} energy_calendar_month_t;
+
+int energy_minute_cache_init();
+int energy_minute_cache_get(time_t timestamp_start, time_t timestamp_end, energy_minute_t *buffer, int buffer_len);
+int energy_calendar_init();
+void energy_calendar_add(int year, int month, int day, time_t timestamp_minute);
+int energy_calendar_get_months(energy_calendar_month_t *buffer, int buffer_len, time_t *minute_min_timestamp, time_t *minute_max_timestamp);
+int energy_calendar_get_month_coverage(int year, int month, int *day_seconds);
 int energy_add_power(power_data_t *pd);
+int energy_aggregate(time_t timestamp_start, time_t timestamp_end, int bucket_size, energy_bucket_t *buffer, int buffer_len);
+int energy_rebuild(time_t timestamp_start, time_t timestamp_end, int thread_qty);
 
 #endif
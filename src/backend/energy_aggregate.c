@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "logger.h"
+#include "energy.h"
+#include "database.h"
+
+#define AGGREGATE_MAX_SEGMENTS_PER_BUCKET 7
+
+typedef enum {
+	AGGREGATE_TIER_MINUTES = 0,
+	AGGREGATE_TIER_HOURS,
+	AGGREGATE_TIER_DAYS,
+	AGGREGATE_TIER_MONTHS,
+	AGGREGATE_TIER_QTY
+} aggregate_tier_t;
+
+/* Trecho do intervalo que será consultado em uma única tabela, sempre contido em um único bucket */
+typedef struct aggregate_segment_s {
+	aggregate_tier_t tier;
+	time_t start;
+	time_t end;
+} aggregate_segment_t;
+
+typedef struct aggregate_plan_s {
+	aggregate_segment_t *segments;
+	int segment_qty;
+	int segment_max;
+} aggregate_plan_t;
+
+/* Os intervalos são comparados como row values sobre as colunas da chave primária, para que o índice seja usado.
+ * Os parâmetros são os campos do início seguidos dos campos do fim, na quantidade de tier_key_fields. */
+static const char *sql_get_tier[AGGREGATE_TIER_QTY] = {
+	"SELECT timestamp,second_count,active,reactive,cost FROM energy_minutes WHERE timestamp >= ?1 AND timestamp < ?2;",
+	"SELECT year,month,day,hour,second_count,active,reactive,cost FROM energy_hours WHERE (year,month,day,hour) >= (?1,?2,?3,?4) AND (year,month,day,hour) < (?5,?6,?7,?8);",
+	"SELECT year,month,day,0,second_count,active,reactive,cost FROM energy_days WHERE (year,month,day) >= (?1,?2,?3) AND (year,month,day) < (?4,?5,?6);",
+	"SELECT year,month,1,0,second_count,active,reactive,cost FROM energy_months WHERE (year,month) >= (?1,?2) AND (year,month) < (?3,?4);"
+};
+
+/* Retorna o início (em horário local) do período do nível que contém o timestamp */
+static time_t tier_floor(time_t timestamp, aggregate_tier_t tier) {
+	struct tm time_tm;
+	
+	if(tier == AGGREGATE_TIER_MINUTES)
+		return timestamp - (timestamp % 60);
+	
+	localtime_r(&timestamp, &time_tm);
+	
+	time_tm.tm_sec = 0;
+	time_tm.tm_min = 0;
+	
+	if(tier >= AGGREGATE_TIER_DAYS)
+		time_tm.tm_hour = 0;
+	
+	if(tier == AGGREGATE_TIER_MONTHS)
+		time_tm.tm_mday = 1;
+	
+	time_tm.tm_isdst = -1;
+	
+	return mktime(&time_tm);
+}
+
+/* Retorna o início do primeiro período do nível que começa em timestamp ou depois dele */
+static time_t tier_ceil(time_t timestamp, aggregate_tier_t tier) {
+	struct tm time_tm;
+	time_t boundary = tier_floor(timestamp, tier);
+	
+	if(boundary >= timestamp)
+		return boundary;
+	
+	if(tier == AGGREGATE_TIER_MINUTES)
+		return boundary + 60;
+	
+	localtime_r(&boundary, &time_tm);
+	
+	switch(tier) {
+		case AGGREGATE_TIER_HOURS:
+			time_tm.tm_hour++;
+			break;
+		case AGGREGATE_TIER_DAYS:
+			time_tm.tm_mday++;
+			break;
+		default:
+			time_tm.tm_mon++;
+			break;
+	}
+	
+	time_tm.tm_isdst = -1;
+	
+	return tier_floor(mktime(&time_tm), tier);
+}
+
+/* Campos da chave de cada tabela (timestamp ou ano, mês, dia e hora), retorna a quantidade usada pelo nível */
+static int tier_key_fields(time_t timestamp, aggregate_tier_t tier, sqlite3_int64 *fields) {
+	struct tm time_tm;
+	
+	if(tier == AGGREGATE_TIER_MINUTES) {
+		fields[0] = timestamp;
+		return 1;
+	}
+	
+	localtime_r(&timestamp, &time_tm);
+	
+	fields[0] = time_tm.tm_year + 1900;
+	fields[1] = time_tm.tm_mon + 1;
+	fields[2] = time_tm.tm_mday;
+	fields[3] = time_tm.tm_hour;
+	
+	// Horas usam os quatro campos, dias os três primeiros e meses os dois primeiros
+	return 1 + AGGREGATE_TIER_QTY - tier;
+}
+
+static void plan_add_segment(aggregate_plan_t *plan, aggregate_tier_t tier, time_t start, time_t end) {
+	aggregate_segment_t *last;
+	
+	if(end <= start || plan->segment_qty >= plan->segment_max)
+		return;
+	
+	last = (plan->segment_qty > 0) ? &plan->segments[plan->segment_qty - 1] : NULL;
+	
+	if(last != NULL && last->tier == tier && last->end == start) {
+		last->end = end;
+		return;
+	}
+	
+	plan->segments[plan->segment_qty].tier = tier;
+	plan->segments[plan->segment_qty].start = start;
+	plan->segments[plan->segment_qty].end = end;
+	plan->segment_qty++;
+}
+
+/* Divide [start, end) usando o nível mais grosso possível no meio e níveis mais finos nas pontas */
+static void plan_range(aggregate_plan_t *plan, time_t start, time_t end, aggregate_tier_t tier) {
+	time_t inner_start, inner_end;
+	
+	if(end <= start)
+		return;
+	
+	if(tier == AGGREGATE_TIER_MINUTES) {
+		plan_add_segment(plan, tier, start, end);
+		return;
+	}
+	
+	inner_start = tier_ceil(start, tier);
+	inner_end = tier_floor(end, tier);
+	
+	if(inner_start >= inner_end) {
+		plan_range(plan, start, end, tier - 1);
+		return;
+	}
+	
+	plan_range(plan, start, inner_start, tier - 1);
+	plan_add_segment(plan, tier, inner_start, inner_end);
+	plan_range(plan, inner_end, end, tier - 1);
+}
+
+static void bucket_add(energy_bucket_t *buckets, int bucket_qty, time_t timestamp_start, int bucket_size, time_t timestamp, int second_count, double active, double reactive, double cost) {
+	int index;
+	
+	if(timestamp < timestamp_start)
+		return;
+	
+	if((index = (timestamp - timestamp_start) / bucket_size) >= bucket_qty)
+		return;
+	
+	buckets[index].second_count += second_count;
+	buckets[index].active += active;
+	buckets[index].reactive += reactive;
+	buckets[index].cost += cost;
+}
+
+/* Segmentos de minutos recentes são atendidos pelo cache, retorna -1 se o segmento não estiver coberto */
+static int aggregate_minutes_from_cache(const aggregate_segment_t *segment, energy_bucket_t *buckets, int bucket_qty, time_t timestamp_start, int bucket_size) {
+	energy_minute_t *minute_buffer;
+	int minute_qty = (segment->end - segment->start) / 60;
+	int count;
+	
+	if((minute_buffer = (energy_minute_t*) malloc(sizeof(energy_minute_t) * minute_qty)) == NULL)
+		return -1;
+	
+	if((count = energy_minute_cache_get(segment->start, segment->end - 1, minute_buffer, minute_qty)) >= 0) {
+		for(int i = 0; i < count; i++)
+			bucket_add(buckets, bucket_qty, timestamp_start, bucket_size, minute_buffer[i].timestamp, minute_buffer[i].second_count, minute_buffer[i].active, minute_buffer[i].reactive, minute_buffer[i].cost);
+	}
+	
+	free(minute_buffer);
+	
+	return count;
+}
+
+/* Soma a energia de [timestamp_start, timestamp_end) em buckets de bucket_size segundos (múltiplo de 60), consultando
+ * para cada trecho a tabela de nível mais grosso que cabe nele. O buffer deve ter espaço para todos os buckets.
+ * Retorna a quantidade de buckets preenchidos. */
+int energy_aggregate(time_t timestamp_start, time_t timestamp_end, int bucket_size, energy_bucket_t *buffer, int buffer_len) {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt[AGGREGATE_TIER_QTY] = {NULL};
+	aggregate_plan_t plan;
+	int bucket_qty;
+	int tier_usage[AGGREGATE_TIER_QTY] = {0};
+	sqlite3_int64 start_fields[4], end_fields[4];
+	int field_qty;
+	
+	if(buffer == NULL || bucket_size < 60 || (bucket_size % 60) != 0 || (timestamp_start % 60) != 0 || timestamp_end <= timestamp_start)
+		return -1;
+	
+	bucket_qty = (timestamp_end - timestamp_start + bucket_size - 1) / bucket_size;
+	
+	if(bucket_qty > buffer_len)
+		return -1;
+	
+	plan.segment_qty = 0;
+	plan.segment_max = bucket_qty * AGGREGATE_MAX_SEGMENTS_PER_BUCKET;
+	
+	if((plan.segments = (aggregate_segment_t*) malloc(sizeof(aggregate_segment_t) * plan.segment_max)) == NULL)
+		return -2;
+	
+	/* Cada bucket é planejado separadamente para que nenhum segmento cruze a fronteira entre buckets,
+	 * segmentos contíguos do mesmo nível são unidos em uma única consulta. */
+	for(int i = 0; i < bucket_qty; i++) {
+		buffer[i].timestamp = timestamp_start + (time_t) i * bucket_size;
+		buffer[i].second_count = 0;
+		buffer[i].active = 0;
+		buffer[i].reactive = 0;
+		buffer[i].cost = 0;
+		
+		plan_range(&plan, buffer[i].timestamp, MIN(buffer[i].timestamp + bucket_size, timestamp_end), AGGREGATE_TIER_MONTHS);
+	}
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		free(plan.segments);
+		
+		return -2;
+	}
+	
+	for(int i = 0; i < plan.segment_qty; i++) {
+		const aggregate_segment_t *segment = &plan.segments[i];
+		
+		tier_usage[segment->tier]++;
+		
+		if(segment->tier == AGGREGATE_TIER_MINUTES && aggregate_minutes_from_cache(segment, buffer, bucket_qty, timestamp_start, bucket_size) >= 0)
+			continue;
+		
+		if(ppstmt[segment->tier] == NULL) {
+			if((result = database_prepare(db_conn, sql_get_tier[segment->tier], &ppstmt[segment->tier])) != SQLITE_OK) {
+				LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+				break;
+			}
+		} else {
+			sqlite3_reset(ppstmt[segment->tier]);
+		}
+		
+		field_qty = tier_key_fields(segment->start, segment->tier, start_fields);
+		tier_key_fields(segment->end, segment->tier, end_fields);
+		
+		// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
+		result = SQLITE_OK;
+		
+		for(int field = 0; field < field_qty; field++) {
+			result += sqlite3_bind_int64(ppstmt[segment->tier], 1 + field, start_fields[field]);
+			result += sqlite3_bind_int64(ppstmt[segment->tier], 1 + field_qty + field, end_fields[field]);
+		}
+		
+		if(result) {
+			LOG_ERROR("Failed to bind value to prepared statement.");
+			result = SQLITE_ERROR;
+			break;
+		}
+		
+		while((result = sqlite3_step(ppstmt[segment->tier])) == SQLITE_ROW) {
+			time_t row_timestamp;
+			int column = 1;
+			
+			if(segment->tier == AGGREGATE_TIER_MINUTES) {
+				row_timestamp = sqlite3_column_int64(ppstmt[segment->tier], 0);
+			} else {
+				struct tm row_tm;
+				
+				memset(&row_tm, 0, sizeof(struct tm));
+				
+				row_tm.tm_year = sqlite3_column_int(ppstmt[segment->tier], 0) - 1900;
+				row_tm.tm_mon = sqlite3_column_int(ppstmt[segment->tier], 1) - 1;
+				row_tm.tm_mday = sqlite3_column_int(ppstmt[segment->tier], 2);
+				row_tm.tm_hour = sqlite3_column_int(ppstmt[segment->tier], 3);
+				row_tm.tm_isdst = -1;
+				
+				/* Em uma mudança de horário o início calculado pode cair fora do segmento, mas ainda dentro do bucket */
+				row_timestamp = MAX(segment->start, MIN(mktime(&row_tm), segment->end - 1));
+				
+				column = 4;
+			}
+			
+			bucket_add(buffer, bucket_qty, timestamp_start, bucket_size, row_timestamp,
+						sqlite3_column_int(ppstmt[segment->tier], column),
+						sqlite3_column_double(ppstmt[segment->tier], column + 1),
+						sqlite3_column_double(ppstmt[segment->tier], column + 2),
+						sqlite3_column_double(ppstmt[segment->tier], column + 3));
+		}
+		
+		if(result != SQLITE_DONE) {
+			LOG_ERROR("Failed to get energy data for aggregation: %s", sqlite3_errstr(result));
+			break;
+		}
+		
+		result = SQLITE_OK;
+	}
+	
+	for(int tier = 0; tier < AGGREGATE_TIER_QTY; tier++)
+		database_finalize(ppstmt[tier]);
+	
+	database_close(db_conn);
+	free(plan.segments);
+	
+	if(result != SQLITE_OK)
+		return -3;
+	
+	LOG_DEBUG("Aggregated %d buckets using %d month, %d day, %d hour and %d minute segments.", bucket_qty,
+				tier_usage[AGGREGATE_TIER_MONTHS], tier_usage[AGGREGATE_TIER_DAYS], tier_usage[AGGREGATE_TIER_HOURS], tier_usage[AGGREGATE_TIER_MINUTES]);
+	
+	return bucket_qty;
+}
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logger.h"
+#include "energy.h"
+#include "database.h"
+
+/* Segundos registrados em cada dia de um ano, indexados por [mês - 1][dia - 1] */
+typedef struct calendar_year_s {
+	int year;
+	int day_seconds[12][31];
+} calendar_year_t;
+
+static pthread_rwlock_t calendar_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Anos em ordem crescente */
+static calendar_year_t *calendar_years = NULL;
+static int calendar_year_qty = 0;
+static int calendar_loaded = 0;
+
+static time_t calendar_minute_min = 0;
+static time_t calendar_minute_max = 0;
+
+/* Com create diferente de zero deve ser chamada com calendar_lock travado para escrita */
+static calendar_year_t *calendar_get_year(int year, int create) {
+	calendar_year_t *new_years;
+	int position;
+	
+	for(position = 0; position < calendar_year_qty && calendar_years[position].year <= year; position++) {
+		if(calendar_years[position].year == year)
+			return &calendar_years[position];
+	}
+	
+	if(!create)
+		return NULL;
+	
+	if((new_years = (calendar_year_t*) realloc(calendar_years, sizeof(calendar_year_t) * (calendar_year_qty + 1))) == NULL)
+		return NULL;
+	
+	calendar_years = new_years;
+	
+	memmove(&calendar_years[position + 1], &calendar_years[position], sizeof(calendar_year_t) * (calendar_year_qty - position));
+	memset(&calendar_years[position], 0, sizeof(calendar_year_t));
+	
+	calendar_years[position].year = year;
+	
+	calendar_year_qty++;
+	
+	return &calendar_years[position];
+}
+
+static void calendar_add_seconds(int year, int month, int day, int second_count) {
+	calendar_year_t *calendar_year;
+	
+	if(month < 1 || month > 12 || day < 1 || day > 31)
+		return;
+	
+	if((calendar_year = calendar_get_year(year, 1)) == NULL) {
+		LOG_ERROR("Failed to allocate memory for energy calendar.");
+		return;
+	}
+	
+	calendar_year->day_seconds[month - 1][day - 1] += second_count;
+}
+
+/* Monta o calendário a partir das tabelas energy_days e energy_minutes, deve ser chamada antes de iniciar a aquisição de dados. */
+int energy_calendar_init() {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_energy_days[] = "SELECT year,month,day,second_count FROM energy_days;";
+	const char sql_get_energy_minute_bounds[] = "SELECT MIN(timestamp),MAX(timestamp) FROM energy_minutes;";
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	pthread_rwlock_wrlock(&calendar_lock);
+	
+	free(calendar_years);
+	calendar_years = NULL;
+	calendar_year_qty = 0;
+	calendar_loaded = 0;
+	
+	if((result = database_prepare(db_conn, sql_get_energy_days, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&calendar_lock);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW)
+		calendar_add_seconds(sqlite3_column_int(ppstmt, 0), sqlite3_column_int(ppstmt, 1), sqlite3_column_int(ppstmt, 2), sqlite3_column_int(ppstmt, 3));
+	
+	database_finalize(ppstmt);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get energy days from database: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&calendar_lock);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_energy_minute_bounds, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&calendar_lock);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		calendar_minute_min = sqlite3_column_int64(ppstmt, 0);
+		calendar_minute_max = sqlite3_column_int64(ppstmt, 1);
+		
+		result = sqlite3_step(ppstmt);
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get energy minute bounds from database: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&calendar_lock);
+		
+		return -1;
+	}
+	
+	calendar_loaded = 1;
+	
+	pthread_rwlock_unlock(&calendar_lock);
+	
+	return 0;
+}
+
+/* Registra um segundo gravado nas tabelas de energia, chamada por energy_add_power() após o commit */
+void energy_calendar_add(int year, int month, int day, time_t timestamp_minute) {
+	if(pthread_rwlock_wrlock(&calendar_lock))
+		return;
+	
+	if(calendar_loaded) {
+		calendar_add_seconds(year, month, day, 1);
+		
+		if(calendar_minute_min == 0 || timestamp_minute < calendar_minute_min)
+			calendar_minute_min = timestamp_minute;
+		
+		if(timestamp_minute > calendar_minute_max)
+			calendar_minute_max = timestamp_minute;
+	}
+	
+	pthread_rwlock_unlock(&calendar_lock);
+}
+
+/* Preenche o buffer com os meses que possuem dados, em ordem crescente. Retorna -1 se o calendário não foi carregado. */
+int energy_calendar_get_months(energy_calendar_month_t *buffer, int buffer_len, time_t *minute_min_timestamp, time_t *minute_max_timestamp) {
+	int output_count = 0;
+	
+	if(buffer == NULL)
+		return -2;
+	
+	if(pthread_rwlock_rdlock(&calendar_lock))
+		return -2;
+	
+	if(!calendar_loaded) {
+		pthread_rwlock_unlock(&calendar_lock);
+		return -1;
+	}
+	
+	for(int y = 0; y < calendar_year_qty; y++) {
+		for(int m = 0; m < 12 && output_count < buffer_len; m++) {
+			for(int d = 0; d < 31; d++) {
+				if(calendar_years[y].day_seconds[m][d] > 0) {
+					buffer[output_count].year = calendar_years[y].year;
+					buffer[output_count].month = m + 1;
+					output_count++;
+					
+					break;
+				}
+			}
+		}
+	}
+	
+	if(minute_min_timestamp)
+		*minute_min_timestamp = calendar_minute_min;
+	
+	if(minute_max_timestamp)
+		*minute_max_timestamp = calendar_minute_max;
+	
+	pthread_rwlock_unlock(&calendar_lock);
+	
+	return output_count;
+}
+
+/* Copia a quantidade de segundos registrados em cada dia do mês para day_seconds (31 posições).
+ * Retorna -1 se o calendário não foi carregado. */
+int energy_calendar_get_month_coverage(int year, int month, int *day_seconds) {
+	calendar_year_t *calendar_year;
+	
+	if(day_seconds == NULL || month < 1 || month > 12)
+		return -2;
+	
+	if(pthread_rwlock_rdlock(&calendar_lock))
+		return -2;
+	
+	if(!calendar_loaded) {
+		pthread_rwlock_unlock(&calendar_lock);
+		return -1;
+	}
+	
+	if((calendar_year = calendar_get_year(year, 0)) != NULL)
+		memcpy(day_seconds, calendar_year->day_seconds[month - 1], sizeof(int) * 31);
+	else
+		memset(day_seconds, 0, sizeof(int) * 31);
+	
+	pthread_rwlock_unlock(&calendar_lock);
+	
+	return 0;
+}
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "logger.h"
+#include "config.h"
+#include "power.h"
+#include "energy.h"
+#include "archive.h"
+#include "database.h"
+
+#define REBUILD_MINUTES_PER_DAY (24 * 60)
+#define REBUILD_MAX_HOURS 32
+#define REBUILD_MAX_DAYS 4
+
+typedef struct rebuild_minute_s {
+	time_t timestamp;
+	time_t latest_second;
+	int second_count;
+	double active;
+	double reactive;
+	double min_p;
+	double cost;
+} rebuild_minute_t;
+
+typedef struct rebuild_period_s {
+	int year;
+	int month;
+	int day;
+	int hour;
+	int second_count;
+	double active;
+	double reactive;
+	double min_p;
+	double cost;
+} rebuild_period_t;
+
+/* Resultado do processamento de um arquivo diário, alocado em um único bloco */
+typedef struct rebuild_day_result_s {
+	int minute_qty;
+	int hour_qty;
+	int day_qty;
+	rebuild_period_t hours[REBUILD_MAX_HOURS];
+	rebuild_period_t days[REBUILD_MAX_DAYS];
+	rebuild_minute_t minutes[REBUILD_MINUTES_PER_DAY];
+} rebuild_day_result_t;
+
+typedef struct rebuild_ctx_s {
+	double kwh_rate;
+	sqlite3 *db_conn;
+	sqlite3_stmt *stmt_minute;
+	sqlite3_stmt *stmt_hour;
+	sqlite3_stmt *stmt_day;
+	int day_file_qty;
+	long second_qty;
+	long minute_qty;
+} rebuild_ctx_t;
+
+static void rebuild_add_period(rebuild_period_t *periods, int *qty, int max_qty, const struct tm *time_tm, int use_hour, const rebuild_minute_t *minute) {
+	rebuild_period_t *period = NULL;
+	int hour = use_hour ? time_tm->tm_hour : 0;
+	
+	/* Os minutos chegam em ordem, então normalmente o período procurado é o último */
+	for(int i = *qty - 1; i >= 0; i--) {
+		if(periods[i].year == time_tm->tm_year + 1900 && periods[i].month == time_tm->tm_mon + 1 && periods[i].day == time_tm->tm_mday && periods[i].hour == hour) {
+			period = &periods[i];
+			break;
+		}
+	}
+	
+	if(period == NULL) {
+		if(*qty >= max_qty)
+			return;
+		
+		period = &periods[(*qty)++];
+		
+		period->year = time_tm->tm_year + 1900;
+		period->month = time_tm->tm_mon + 1;
+		period->day = time_tm->tm_mday;
+		period->hour = hour;
+		period->second_count = 0;
+		period->active = 0.0;
+		period->reactive = 0.0;
+		period->min_p = minute->min_p;
+		period->cost = 0.0;
+	}
+	
+	period->second_count += minute->second_count;
+	period->active += minute->active;
+	period->reactive += minute->reactive;
+	period->min_p = MIN(period->min_p, minute->min_p);
+	period->cost += minute->cost;
+}
+
+/* Executada nas threads de trabalho, integra os dados de um dia da mesma forma que energy_add_power() */
+static void *rebuild_process_day(time_t day_start, const power_data_t *data, int count, void *arg) {
+	rebuild_ctx_t *ctx = (rebuild_ctx_t*) arg;
+	rebuild_day_result_t *result;
+	rebuild_minute_t *minute = NULL;
+	struct tm time_tm;
+	
+	if((result = (rebuild_day_result_t*) malloc(sizeof(rebuild_day_result_t))) == NULL) {
+		LOG_ERROR("Failed to allocate memory for energy rebuild.");
+		return NULL;
+	}
+	
+	result->minute_qty = 0;
+	result->hour_qty = 0;
+	result->day_qty = 0;
+	
+	for(int i = 0; i < count; i++) {
+		time_t timestamp_minute = data[i].timestamp - (data[i].timestamp % 60);
+		double p_total = data[i].p[0] + data[i].p[1];
+		double active_energy_total = p_total / (3600.0 * 1000.0);
+		
+		if(minute == NULL || minute->timestamp != timestamp_minute) {
+			if(result->minute_qty >= REBUILD_MINUTES_PER_DAY)
+				break;
+			
+			minute = &result->minutes[result->minute_qty++];
+			
+			minute->timestamp = timestamp_minute;
+			minute->second_count = 0;
+			minute->active = 0.0;
+			minute->reactive = 0.0;
+			minute->min_p = p_total;
+			minute->cost = 0.0;
+		}
+		
+		minute->second_count++;
+		minute->latest_second = data[i].timestamp;
+		minute->active += active_energy_total;
+		minute->reactive += (data[i].q[0] + data[i].q[1]) / (3600.0 * 1000.0);
+		minute->min_p = MIN(minute->min_p, p_total);
+		minute->cost += ctx->kwh_rate * active_energy_total;
+	}
+	
+	/* Horas e dias são em horário local, que só muda na virada de um minuto, então basta converter cada minuto */
+	for(int i = 0; i < result->minute_qty; i++) {
+		localtime_r(&result->minutes[i].timestamp, &time_tm);
+		
+		rebuild_add_period(result->hours, &result->hour_qty, REBUILD_MAX_HOURS, &time_tm, 1, &result->minutes[i]);
+		rebuild_add_period(result->days, &result->day_qty, REBUILD_MAX_DAYS, &time_tm, 0, &result->minutes[i]);
+	}
+	
+	return result;
+}
+
+static int rebuild_store_period(sqlite3_stmt *ppstmt, const rebuild_period_t *period, int use_hour) {
+	int result;
+	int pos = 1;
+	
+	// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
+	result = sqlite3_bind_int(ppstmt, pos++, period->year);
+	result += sqlite3_bind_int(ppstmt, pos++, period->month);
+	result += sqlite3_bind_int(ppstmt, pos++, period->day);
+	
+	if(use_hour)
+		result += sqlite3_bind_int(ppstmt, pos++, period->hour);
+	
+	result += sqlite3_bind_int(ppstmt, pos++, period->second_count);
+	result += sqlite3_bind_double(ppstmt, pos++, period->active);
+	result += sqlite3_bind_double(ppstmt, pos++, period->reactive);
+	result += sqlite3_bind_double(ppstmt, pos++, period->min_p);
+	result += sqlite3_bind_double(ppstmt, pos++, period->cost);
+	
+	if(result) {
+		LOG_ERROR("Failed to bind value to prepared statement.");
+		sqlite3_reset(ppstmt);
+		
+		return -1;
+	}
+	
+	result = sqlite3_step(ppstmt);
+	
+	sqlite3_reset(ppstmt);
+	
+	return (result == SQLITE_DONE) ? 0 : -1;
+}
+
+/* Executada na thread principal, na ordem dos dias, grava o resultado de um dia usando as consultas já preparadas */
+static int rebuild_consume_day(time_t day_start, void *result_ptr, void *arg) {
+	rebuild_ctx_t *ctx = (rebuild_ctx_t*) arg;
+	rebuild_day_result_t *result = (rebuild_day_result_t*) result_ptr;
+	int error = 0;
+	
+	// Dia sem arquivo, os dados apagados no início do intervalo continuam vazios
+	if(result == NULL)
+		return 0;
+	
+	for(int i = 0; i < result->minute_qty && !error; i++) {
+		const rebuild_minute_t *minute = &result->minutes[i];
+		int bind_result;
+		
+		// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
+		bind_result = sqlite3_bind_int64(ctx->stmt_minute, 1, minute->timestamp);
+		bind_result += sqlite3_bind_int(ctx->stmt_minute, 2, minute->second_count);
+		bind_result += sqlite3_bind_int64(ctx->stmt_minute, 3, minute->latest_second);
+		bind_result += sqlite3_bind_double(ctx->stmt_minute, 4, minute->active);
+		bind_result += sqlite3_bind_double(ctx->stmt_minute, 5, minute->reactive);
+		bind_result += sqlite3_bind_double(ctx->stmt_minute, 6, minute->min_p);
+		bind_result += sqlite3_bind_double(ctx->stmt_minute, 7, minute->cost);
+		
+		if(bind_result || sqlite3_step(ctx->stmt_minute) != SQLITE_DONE)
+			error = 1;
+		
+		sqlite3_reset(ctx->stmt_minute);
+		
+		ctx->second_qty += minute->second_count;
+	}
+	
+	for(int i = 0; i < result->hour_qty && !error; i++)
+		if(rebuild_store_period(ctx->stmt_hour, &result->hours[i], 1))
+			error = 1;
+	
+	for(int i = 0; i < result->day_qty && !error; i++)
+		if(rebuild_store_period(ctx->stmt_day, &result->days[i], 0))
+			error = 1;
+	
+	if(error) {
+		LOG_ERROR("Failed to store rebuilt energy data: %s", sqlite3_errmsg(ctx->db_conn));
+		free(result);
+		
+		return -1;
+	}
+	
+	ctx->day_file_qty++;
+	ctx->minute_qty += result->minute_qty;
+	
+	LOG_DEBUG("Rebuilt %d minutes from day starting at %ld.", result->minute_qty, day_start);
+	
+	free(result);
+	
+	return 0;
+}
+
+static int rebuild_delete_range(sqlite3 *db_conn, const char *sql, sqlite3_int64 first, sqlite3_int64 last) {
+	sqlite3_stmt *ppstmt = NULL;
+	int result;
+	
+	if((result = database_prepare(db_conn, sql, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		
+		return -1;
+	}
+	
+	if(sqlite3_bind_int64(ppstmt, 1, first) != SQLITE_OK || sqlite3_bind_int64(ppstmt, 2, last) != SQLITE_OK) {
+		LOG_ERROR("Failed to bind value to prepared statement.");
+		database_finalize(ppstmt);
+		
+		return -1;
+	}
+	
+	result = sqlite3_step(ppstmt);
+	
+	database_finalize(ppstmt);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to delete old energy data: %s", sqlite3_errstr(result));
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+/*
+ * Reconstrói as tabelas energy_minutes, energy_hours e energy_days para os dias locais no intervalo
+ * [timestamp_start, timestamp_end) a partir dos arquivos pd-*.csv. Como as horas e dias são em horário local e
+ * os arquivos são divididos por dia em UTC, as linhas de horas e dias são acumuladas com "ON CONFLICT DO UPDATE",
+ * somando as partes vindas de arquivos diferentes. Tudo é feito em uma única transação, que é desfeita se algum
+ * arquivo existente não puder ser lido ou processado. Como a transação bloqueia as gravações durante todo o
+ * processamento, main() só chama esta função depois de database_lock_exclusive(), com o backend parado.
+ */
+int energy_rebuild(time_t timestamp_start, time_t timestamp_end, int thread_qty) {
+	int result;
+	rebuild_ctx_t ctx;
+	struct tm first_tm, last_tm;
+	time_t last_second = timestamp_end - 1;
+	sqlite3_int64 first_date, last_date;
+	time_t rebuild_start_time;
+	const char sql_delete_minutes[] = "DELETE FROM energy_minutes WHERE timestamp >= ?1 AND timestamp <= ?2;";
+	const char sql_delete_hours[] = "DELETE FROM energy_hours WHERE (year * 10000 + month * 100 + day) BETWEEN ?1 AND ?2;";
+	const char sql_delete_days[] = "DELETE FROM energy_days WHERE (year * 10000 + month * 100 + day) BETWEEN ?1 AND ?2;";
+	const char sql_store_minute[] = "INSERT INTO energy_minutes(timestamp,second_count,latest_second,active,reactive,min_p,cost) VALUES(?1,?2,?3,?4,?5,?6,?7);";
+	const char sql_store_hour[] = "INSERT INTO energy_hours(year,month,day,hour,second_count,active,reactive,min_p,cost) VALUES(?1,?2,?3,?4,?5,?6,?7,?8,?9)"
+									" ON CONFLICT(year,month,day,hour) DO UPDATE SET second_count = second_count + excluded.second_count, active = active + excluded.active, reactive = reactive + excluded.reactive, min_p = min(min_p, excluded.min_p), cost = cost + excluded.cost;";
+	const char sql_store_day[] = "INSERT INTO energy_days(year,month,day,second_count,active,reactive,min_p,cost) VALUES(?1,?2,?3,?4,?5,?6,?7,?8)"
+									" ON CONFLICT(year,month,day) DO UPDATE SET second_count = second_count + excluded.second_count, active = active + excluded.active, reactive = reactive + excluded.reactive, min_p = min(min_p, excluded.min_p), cost = cost + excluded.cost;";
+	
+	if(timestamp_end <= timestamp_start)
+		return -1;
+	
+	memset(&ctx, 0, sizeof(rebuild_ctx_t));
+	
+	ctx.kwh_rate = config_get_value_double("kwh_rate", 0, 10, 0);
+	
+	localtime_r(&timestamp_start, &first_tm);
+	localtime_r(&last_second, &last_tm);
+	
+	first_date = (first_tm.tm_year + 1900) * 10000 + (first_tm.tm_mon + 1) * 100 + first_tm.tm_mday;
+	last_date = (last_tm.tm_year + 1900) * 10000 + (last_tm.tm_mon + 1) * 100 + last_tm.tm_mday;
+	
+	LOG_INFO("Rebuilding energy data from %lld to %lld.", first_date, last_date);
+	
+	if((result = database_open(&ctx.db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(ctx.db_conn);
+		
+		return -1;
+	}
+	
+	if(sqlite3_exec(ctx.db_conn, "BEGIN IMMEDIATE TRANSACTION", NULL, NULL, NULL) != SQLITE_OK) {
+		LOG_ERROR("Failed to begin SQL transaction: %s", sqlite3_errmsg(ctx.db_conn));
+		database_close(ctx.db_conn);
+		
+		return -1;
+	}
+	
+	if(rebuild_delete_range(ctx.db_conn, sql_delete_minutes, timestamp_start, last_second)
+		|| rebuild_delete_range(ctx.db_conn, sql_delete_hours, first_date, last_date)
+		|| rebuild_delete_range(ctx.db_conn, sql_delete_days, first_date, last_date)) {
+		
+		sqlite3_exec(ctx.db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(ctx.db_conn);
+		
+		return -1;
+	}
+	
+	if(database_prepare(ctx.db_conn, sql_store_minute, &ctx.stmt_minute) != SQLITE_OK
+		|| database_prepare(ctx.db_conn, sql_store_hour, &ctx.stmt_hour) != SQLITE_OK
+		|| database_prepare(ctx.db_conn, sql_store_day, &ctx.stmt_day) != SQLITE_OK) {
+		
+		LOG_ERROR("Failed to prepare the SQL statements for energy rebuild: %s", sqlite3_errmsg(ctx.db_conn));
+		
+		database_finalize(ctx.stmt_minute);
+		database_finalize(ctx.stmt_hour);
+		database_finalize(ctx.stmt_day);
+		sqlite3_exec(ctx.db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(ctx.db_conn);
+		
+		return -1;
+	}
+	
+	rebuild_start_time = time(NULL);
+	
+	result = archive_process_days(timestamp_start, timestamp_end, thread_qty, rebuild_process_day, rebuild_consume_day, &ctx);
+	
+	database_finalize(ctx.stmt_minute);
+	database_finalize(ctx.stmt_hour);
+	database_finalize(ctx.stmt_day);
+	
+	if(result) {
+		LOG_ERROR("Energy rebuild failed, rolling back.");
+		
+		sqlite3_exec(ctx.db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(ctx.db_conn);
+		
+		return -2;
+	}
+	
+	if(sqlite3_exec(ctx.db_conn, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+		LOG_ERROR("Failed to commit rebuilt energy data: %s", sqlite3_errmsg(ctx.db_conn));
+		
+		sqlite3_exec(ctx.db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(ctx.db_conn);
+		
+		return -2;
+	}
+	
+	database_close(ctx.db_conn);
+	
+	LOG_INFO("Rebuilt %ld minutes (%ld seconds) from %d power data files in %ld s.", ctx.minute_qty, ctx.second_qty, ctx.day_file_qty, (long)(time(NULL) - rebuild_start_time));
+	
+	return 0;
+}
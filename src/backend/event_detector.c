@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "common.h"
+#include "logger.h"
+#include "config.h"
+#include "power.h"
+#include "disaggregation.h"
+#include "event_detector.h"
+
+#define MAX_TIME_GAP 4
+
+/* O CUSUM acumula os desvios em relação ao patamar que excedem metade do limiar e dispara quando a soma passa
+ * do dobro do limiar, enquanto não há mudança o patamar de referência acompanha lentamente a potência */
+#define CUSUM_DRIFT_FACTOR 0.5
+#define CUSUM_DECISION_FACTOR 2.0
+#define CUSUM_REFERENCE_RATE 0.05
+
+/* A variação total de uma janela é comparada com uma pequena folga, para que erros de arredondamento da soma
+ * nunca descartem uma janela que os detectores aceitariam */
+#define BATCH_TV_TOLERANCE 0.999
+#define BATCH_INITIAL_EVENT_QTY 64
+
+/* Bloco de amostras processado por instrução na varredura em lote, as extensões de vetor do GCC geram SSE
+ * ou NEON conforme a arquitetura. Comparações entre blocos resultam em máscaras de inteiros do mesmo tamanho. */
+typedef double sample_block_t __attribute__((vector_size(16)));
+typedef long long mask_block_t __attribute__((vector_size(16)));
+
+#define SAMPLE_BLOCK_SIZE ((int) (sizeof(sample_block_t) / sizeof(double)))
+
+/* Acesso à i-ésima amostra da janela, a partir da mais antiga */
+#define WINDOW_PD(detector, i) ((detector)->window[((detector)->window_start + (i)) % EVENT_DETECTOR_WINDOW_SIZE])
+#define WINDOW_PT(detector, i) ((detector)->ptotal[((detector)->window_start + (i)) % EVENT_DETECTOR_WINDOW_SIZE])
+#define WINDOW_QT(detector, i) ((detector)->qtotal[((detector)->window_start + (i)) % EVENT_DETECTOR_WINDOW_SIZE])
+
+/* Janela em ordem linear a partir da amostra mais antiga, montada a partir do buffer circular na detecção em tempo
+ * real ou apontando diretamente para os vetores do dia na detecção em lote */
+typedef struct window_view_s {
+	const power_data_t *pd[EVENT_DETECTOR_WINDOW_SIZE];
+	const double *pt;
+	const double *qt;
+} window_view_t;
+
+/* Analisa uma janela completa, retorna quantas amostras podem ser descartadas (1 se não houve evento) */
+typedef int (*window_detect_func_t)(const window_view_t *view, double threshold, cusum_state_t *cusum, load_event_t *load_event, int *detected);
+
+static const char *detector_type_names[EVENT_DETECTOR_TYPE_QTY] = {"step", "cusum", "glr", "edge"};
+
+int event_detector_type_from_name(const char *name) {
+	if(name == NULL)
+		return -1;
+	
+	for(int i = 0; i < EVENT_DETECTOR_TYPE_QTY; i++) {
+		if(strcmp(name, detector_type_names[i]) == 0)
+			return i;
+	}
+	
+	return -1;
+}
+
+const char *event_detector_type_name(event_detector_type_t type) {
+	if(type < 0 || type >= EVENT_DETECTOR_TYPE_QTY)
+		return NULL;
+	
+	return detector_type_names[type];
+}
+
+/* Lê o algoritmo da configuração load_event_detector, o detector de degraus é usado por padrão */
+event_detector_type_t event_detector_get_configured_type() {
+	char name[16];
+	int type;
+	
+	if(config_get_value("load_event_detector", name, sizeof(name)) <= 0)
+		return EVENT_DETECTOR_STEP;
+	
+	if((type = event_detector_type_from_name(name)) < 0) {
+		LOG_WARN("Invalid load event detector \"%s\", using step detector.", name);
+		return EVENT_DETECTOR_STEP;
+	}
+	
+	return (event_detector_type_t) type;
+}
+
+/* Monta o evento a partir dos patamares de duas amostras que começam em before_start e after_start */
+static void build_load_event(const window_view_t *view, int before_start, int after_start, load_event_t *load_event) {
+	const power_data_t *pd_before[2] = {view->pd[before_start], view->pd[before_start + 1]};
+	const power_data_t *pd_after[2] = {view->pd[after_start], view->pd[after_start + 1]};
+	const double pavg_before = (view->pt[before_start] + view->pt[before_start + 1]) / 2.0;
+	const double pavg_after = (view->pt[after_start] + view->pt[after_start + 1]) / 2.0;
+	
+	memset(load_event, 0, sizeof(load_event_t));
+	
+	load_event->timestamp = pd_before[1]->timestamp;
+	load_event->duration = after_start - (before_start + 1);
+	load_event->delta_pt = (pavg_after - pavg_before);
+	
+	for(int l = 0; l < 2; l++) {
+		load_event->delta_p[l] = ((pd_after[0]->p[l] + pd_after[1]->p[l]) / 2.0) - ((pd_before[0]->p[l] + pd_before[1]->p[l]) / 2.0);
+		load_event->delta_s[l] = ((pd_after[0]->s[l] + pd_after[1]->s[l]) / 2.0) - ((pd_before[0]->s[l] + pd_before[1]->s[l]) / 2.0);
+		load_event->delta_q[l] = ((pd_after[0]->q[l] + pd_after[1]->q[l]) / 2.0) - ((pd_before[0]->q[l] + pd_before[1]->q[l]) / 2.0);
+	}
+	
+	if(load_event->delta_pt > 0.0) {
+		load_event->peak_pt = load_event->delta_pt;
+		
+		for(int z = before_start + 2; z <= after_start; z++)
+			if((view->pt[z] - pavg_before) > load_event->peak_pt)
+				load_event->peak_pt = (view->pt[z] - pavg_before);
+	}
+	
+	load_event->top_appliance_id = -1;
+	load_event->knn_appliance_id = -1;
+	load_event->knn_confidence = 0.0;
+	load_event->model_version = 0;
+	
+	for(int l = 0; l < LOAD_EVENT_APPLIANCE_QTY; l++)
+		load_event->appliance_ids[l] = -1;
+}
+
+/* Os pares de amostras usados como patamares devem ser estáveis em relação à mudança, o que descarta picos isolados */
+static int levels_stable(const window_view_t *view, int before_start, int after_start, double delta) {
+	return fabs(view->pt[before_start + 1] - view->pt[before_start]) < fabs(delta) * 0.5 && fabs(view->pt[after_start + 1] - view->pt[after_start]) < fabs(delta) * 0.5;
+}
+
+/* Degrau entre as duas primeiras amostras e um par de amostras estáveis após o transitório */
+static int detect_step(const window_view_t *view, double threshold, cusum_state_t *cusum, load_event_t *load_event, int *detected) {
+	const double *pt = view->pt;
+	double pavg_before, pavg_after;
+	
+	if(!(fabs(pt[1] - pt[0]) < (fabs(pt[3] - pt[1]) * 0.5) && fabs(pt[2] - pt[1]) > (threshold * 0.2) && fabs(pt[3] - pt[1]) > (threshold * 0.2)))
+		return 1;
+	
+	pavg_before = (pt[0] + pt[1]) / 2.0;
+	
+	for(int k = 3; k < EVENT_DETECTOR_WINDOW_SIZE - 2; k++) {
+		pavg_after = (pt[k] + pt[k + 1]) / 2.0;
+		
+		if(fabs(pavg_after - pavg_before) > threshold && fabs(pt[k + 1] - pt[k]) < (fabs(pt[3] - pt[1]) * 0.5) && ((pavg_after - pavg_before) * (pt[3] - pt[1]) > 0.0)) {
+			build_load_event(view, 0, k, load_event);
+			
+			*detected = 1;
+			
+			// A próxima janela começa no fim do transitório
+			return k;
+		}
+	}
+	
+	return 1;
+}
+
+/* CUSUM bilateral sobre a potência ativa total. A mudança é datada pela última amostra em que a soma que disparou
+ * estava zerada e o evento é montado quando há amostras suficientes para o transitório e o novo patamar. */
+static int detect_cusum(const window_view_t *view, double threshold, cusum_state_t *cusum, load_event_t *load_event, int *detected) {
+	const double drift = threshold * CUSUM_DRIFT_FACTOR;
+	const double decision = threshold * CUSUM_DECISION_FACTOR;
+	const int after_start = EVENT_DETECTOR_WINDOW_SIZE - 2;
+	double pavg_before, pavg_after;
+	int change;
+	
+	for(int i = 0; i < EVENT_DETECTOR_WINDOW_SIZE; i++) {
+		const time_t timestamp = view->pd[i]->timestamp;
+		const double x = view->pt[i];
+		
+		if(timestamp <= cusum->last_timestamp)
+			continue;
+		
+		// No início ou após uma falha na aquisição o patamar de referência é reiniciado
+		if(cusum->last_timestamp == 0 || timestamp - cusum->last_timestamp > MAX_TIME_GAP + 1) {
+			memset(cusum, 0, sizeof(cusum_state_t));
+			
+			cusum->reference = x;
+			cusum->zero_pos_timestamp = timestamp;
+			cusum->zero_neg_timestamp = timestamp;
+			cusum->last_timestamp = timestamp;
+			
+			continue;
+		}
+		
+		cusum->last_timestamp = timestamp;
+		
+		// Com o alarme disparado as amostras pertencem ao transitório ou ao novo patamar
+		if(cusum->alarm)
+			continue;
+		
+		cusum->sum_pos = MAX(0.0, cusum->sum_pos + (x - cusum->reference) - drift);
+		cusum->sum_neg = MAX(0.0, cusum->sum_neg - (x - cusum->reference) - drift);
+		
+		if(cusum->sum_pos == 0.0)
+			cusum->zero_pos_timestamp = timestamp;
+		
+		if(cusum->sum_neg == 0.0)
+			cusum->zero_neg_timestamp = timestamp;
+		
+		if(cusum->sum_pos > decision) {
+			cusum->alarm = 1;
+			cusum->change_timestamp = cusum->zero_pos_timestamp;
+		} else if(cusum->sum_neg > decision) {
+			cusum->alarm = -1;
+			cusum->change_timestamp = cusum->zero_neg_timestamp;
+		} else if(cusum->sum_pos == 0.0 && cusum->sum_neg == 0.0) {
+			cusum->reference += (x - cusum->reference) * CUSUM_REFERENCE_RATE;
+		}
+	}
+	
+	if(!cusum->alarm)
+		return 1;
+	
+	// Primeira amostra após a mudança, com pelo menos duas amostras do patamar anterior antes dela
+	for(change = 0; change < EVENT_DETECTOR_WINDOW_SIZE && view->pd[change]->timestamp <= cusum->change_timestamp; change++);
+	
+	change = MAX(change, 2);
+	
+	if(change > after_start - 2)
+		return 1;
+	
+	pavg_before = (view->pt[change - 2] + view->pt[change - 1]) / 2.0;
+	pavg_after = (view->pt[after_start] + view->pt[after_start + 1]) / 2.0;
+	
+	// Picos curtos disparam o alarme sem mudar o patamar e são descartados
+	if(fabs(pavg_after - pavg_before) > drift && (pavg_after - pavg_before) * cusum->alarm > 0.0 && levels_stable(view, change - 2, after_start, pavg_after - pavg_before)) {
+		build_load_event(view, change - 2, after_start, load_event);
+		
+		*detected = 1;
+	}
+	
+	cusum->reference = pavg_after;
+	cusum->sum_pos = 0.0;
+	cusum->sum_neg = 0.0;
+	cusum->zero_pos_timestamp = cusum->last_timestamp;
+	cusum->zero_neg_timestamp = cusum->last_timestamp;
+	cusum->alarm = 0;
+	
+	return after_start;
+}
+
+/* Razão de verossimilhança generalizada para uma mudança de média com ponto desconhecido. O evento é aceito quando
+ * a divisão mais provável está na primeira metade da janela, deixando amostras para o novo patamar. */
+static int detect_glr(const window_view_t *view, double threshold, cusum_state_t *cusum, load_event_t *load_event, int *detected) {
+	const int window_size = EVENT_DETECTOR_WINDOW_SIZE;
+	const int after_start = EVENT_DETECTOR_WINDOW_SIZE - 2;
+	double sum[EVENT_DETECTOR_WINDOW_SIZE + 1];
+	double best_stat = 0.0, best_delta = 0.0;
+	double pavg_before, pavg_after;
+	int best_split = 0;
+	
+	sum[0] = 0.0;
+	
+	for(int i = 0; i < window_size; i++)
+		sum[i + 1] = sum[i] + view->pt[i];
+	
+	for(int m = 2; m <= window_size - 2; m++) {
+		double delta = ((sum[window_size] - sum[m]) / (window_size - m)) - (sum[m] / m);
+		double stat = (delta * delta) * m * (window_size - m) / window_size;
+		
+		if(stat > best_stat) {
+			best_stat = stat;
+			best_delta = delta;
+			best_split = m;
+		}
+	}
+	
+	if(best_split == 0 || best_split > window_size / 2 || fabs(best_delta) <= threshold)
+		return 1;
+	
+	// Os patamares do evento usam as duas amostras antes da mudança e as duas últimas da janela, já estabilizadas
+	pavg_before = (view->pt[best_split - 2] + view->pt[best_split - 1]) / 2.0;
+	pavg_after = (view->pt[after_start] + view->pt[after_start + 1]) / 2.0;
+	
+	if(fabs(pavg_after - pavg_before) <= threshold || (pavg_after - pavg_before) * best_delta <= 0.0 || !levels_stable(view, best_split - 2, after_start, pavg_after - pavg_before))
+		return 1;
+	
+	build_load_event(view, best_split - 2, after_start, load_event);
+	
+	*detected = 1;
+	
+	return after_start;
+}
+
+/* Intensidade da borda entre as amostras i e i + 1 no plano P-Q, com médias de duas amostras de cada lado */
+static double edge_strength(const window_view_t *view, int i) {
+	const double dp = ((view->pt[i + 1] + view->pt[i + 2]) - (view->pt[i - 1] + view->pt[i])) / 2.0;
+	const double dq = ((view->qt[i + 1] + view->qt[i + 2]) - (view->qt[i - 1] + view->qt[i])) / 2.0;
+	
+	return sqrt(dp * dp + dq * dq);
+}
+
+/* Detecção de bordas sobre as potências ativa e reativa juntas, o que encontra aparelhos cuja mudança é
+ * principalmente reativa. A borda deve ser um máximo local entre as amostras 2 e 3. */
+static int detect_edge(const window_view_t *view, double threshold, cusum_state_t *cusum, load_event_t *load_event, int *detected) {
+	const int after_start = EVENT_DETECTOR_WINDOW_SIZE - 2;
+	double edge = edge_strength(view, 2);
+	double settled_dp, settled_dq;
+	
+	if(edge <= threshold || edge < edge_strength(view, 1) || edge <= edge_strength(view, 3) || !levels_stable(view, 1, after_start, edge))
+		return 1;
+	
+	// A mudança deve permanecer após o transitório, senão a borda era apenas um pico
+	settled_dp = ((view->pt[after_start] + view->pt[after_start + 1]) - (view->pt[1] + view->pt[2])) / 2.0;
+	settled_dq = ((view->qt[after_start] + view->qt[after_start + 1]) - (view->qt[1] + view->qt[2])) / 2.0;
+	
+	if(sqrt(settled_dp * settled_dp + settled_dq * settled_dq) <= threshold)
+		return 1;
+	
+	build_load_event(view, 1, after_start, load_event);
+	
+	*detected = 1;
+	
+	return after_start;
+}
+
+static const window_detect_func_t detect_funcs[EVENT_DETECTOR_TYPE_QTY] = {detect_step, detect_cusum, detect_glr, detect_edge};
+
+void event_detector_init(event_detector_t *detector, event_detector_type_t type, double detection_threshold) {
+	memset(detector, 0, sizeof(event_detector_t));
+	
+	detector->type = (type >= 0 && type < EVENT_DETECTOR_TYPE_QTY) ? type : EVENT_DETECTOR_STEP;
+	detector->detection_threshold = detection_threshold;
+}
+
+/* Remove as amostras mais antigas da janela, mantendo a soma dos intervalos atualizada */
+static void window_drop(event_detector_t *detector, int qty) {
+	for(int i = 0; i < qty && detector->window_count > 0; i++) {
+		if(detector->window_count > 1)
+			detector->window_time_gap -= (WINDOW_PD(detector, 1).timestamp - WINDOW_PD(detector, 0).timestamp) - 1;
+		
+		detector->window_start = (detector->window_start + 1) % EVENT_DETECTOR_WINDOW_SIZE;
+		detector->window_count--;
+	}
+	
+	if(detector->window_count > 0)
+		detector->last_timestamp = WINDOW_PD(detector, 0).timestamp;
+}
+
+/* Analisa a janela cheia, retorna quantas amostras podem ser descartadas (1 se não houve evento) */
+static int window_detect(event_detector_t *detector, load_event_t *load_event, int *detected) {
+	window_view_t view;
+	double pt[EVENT_DETECTOR_WINDOW_SIZE];
+	double qt[EVENT_DETECTOR_WINDOW_SIZE];
+	
+	*detected = 0;
+	
+	if(detector->window_time_gap > MAX_TIME_GAP)
+		return 1;
+	
+	for(int i = 0; i < EVENT_DETECTOR_WINDOW_SIZE; i++) {
+		view.pd[i] = &WINDOW_PD(detector, i);
+		pt[i] = WINDOW_PT(detector, i);
+		qt[i] = WINDOW_QT(detector, i);
+	}
+	
+	view.pt = pt;
+	view.qt = qt;
+	
+	return detect_funcs[detector->type](&view, detector->detection_threshold, &detector->cusum, load_event, detected);
+}
+
+/* Adiciona uma amostra à janela, que deve estar em ordem crescente de timestamp. Retorna 1 quando um evento
+ * foi detectado e copiado para load_event, 0 caso contrário e um valor negativo em caso de erro. */
+int event_detector_feed(event_detector_t *detector, const power_data_t *pd, load_event_t *load_event) {
+	int slot;
+	int detected = 0;
+	int time_gap;
+	
+	if(detector == NULL || pd == NULL || load_event == NULL)
+		return -1;
+	
+	if(detector->window_count > 0 && pd->timestamp <= WINDOW_PD(detector, detector->window_count - 1).timestamp)
+		return 0;
+	
+	if(detector->window_count > 0)
+		detector->window_time_gap += (pd->timestamp - WINDOW_PD(detector, detector->window_count - 1).timestamp) - 1;
+	
+	slot = (detector->window_start + detector->window_count) % EVENT_DETECTOR_WINDOW_SIZE;
+	
+	memcpy(&detector->window[slot], pd, sizeof(power_data_t));
+	detector->ptotal[slot] = pd->p[0] + pd->p[1];
+	detector->qtotal[slot] = pd->q[0] + pd->q[1];
+	detector->window_count++;
+	
+	if(detector->window_count < EVENT_DETECTOR_WINDOW_SIZE)
+		return 0;
+	
+	time_gap = (detector->last_timestamp > 0) ? (WINDOW_PD(detector, 0).timestamp - detector->last_timestamp) : 0;
+	
+	window_drop(detector, window_detect(detector, load_event, &detected));
+	
+	if(detected)
+		load_event->time_gap = time_gap;
+	
+	return detected;
+}
+
+static inline sample_block_t load_block(const double *ptr) {
+	sample_block_t block;
+	
+	memcpy(&block, ptr, sizeof(sample_block_t));
+	
+	return block;
+}
+
+static inline sample_block_t block_abs(sample_block_t block) {
+	return (sample_block_t) ((mask_block_t) block & 0x7FFFFFFFFFFFFFFFLL);
+}
+
+/* Marca as janelas em que a condição inicial do detector de degraus é satisfeita, as demais retornariam 1 */
+static void batch_mask_step(const double *pt, int window_qty, double threshold, unsigned char *mask) {
+	const double min_step = threshold * 0.2;
+	int i;
+	
+	for(i = 0; i + SAMPLE_BLOCK_SIZE <= window_qty; i += SAMPLE_BLOCK_SIZE) {
+		const sample_block_t pt0 = load_block(&pt[i]);
+		const sample_block_t pt1 = load_block(&pt[i + 1]);
+		const sample_block_t pt2 = load_block(&pt[i + 2]);
+		const sample_block_t pt3 = load_block(&pt[i + 3]);
+		const sample_block_t rise = block_abs(pt3 - pt1);
+		
+		mask_block_t result = (block_abs(pt1 - pt0) < (rise * 0.5)) & (block_abs(pt2 - pt1) > min_step) & (rise > min_step);
+		
+		for(int l = 0; l < SAMPLE_BLOCK_SIZE; l++)
+			mask[i + l] = (result[l] != 0);
+	}
+	
+	for(; i < window_qty; i++)
+		mask[i] = (fabs(pt[i + 1] - pt[i]) < (fabs(pt[i + 3] - pt[i + 1]) * 0.5) && fabs(pt[i + 2] - pt[i + 1]) > min_step && fabs(pt[i + 3] - pt[i + 1]) > min_step);
+}
+
+/* Marca as janelas cuja variação total (soma das diferenças absolutas entre amostras consecutivas) passa do limiar.
+ * Toda diferença entre médias de amostras da janela é limitada pela variação total, então as janelas descartadas
+ * não teriam eventos nos detectores GLR e de bordas. O vetor diff tem uma posição a menos que as amostras. */
+static void batch_mask_variation(const double *diff, int window_qty, double threshold, unsigned char *mask) {
+	const double min_variation = threshold * BATCH_TV_TOLERANCE;
+	int i;
+	
+	for(i = 0; i + SAMPLE_BLOCK_SIZE <= window_qty; i += SAMPLE_BLOCK_SIZE) {
+		sample_block_t variation = load_block(&diff[i]);
+		mask_block_t result;
+		
+		for(int j = 1; j < EVENT_DETECTOR_WINDOW_SIZE - 1; j++)
+			variation += load_block(&diff[i + j]);
+		
+		result = (variation > min_variation);
+		
+		for(int l = 0; l < SAMPLE_BLOCK_SIZE; l++)
+			mask[i + l] = (result[l] != 0);
+	}
+	
+	for(; i < window_qty; i++) {
+		double variation = 0.0;
+		
+		for(int j = 0; j < EVENT_DETECTOR_WINDOW_SIZE - 1; j++)
+			variation += diff[i + j];
+		
+		mask[i] = (variation > min_variation);
+	}
+}
+
+/* Calcula as diferenças absolutas entre amostras consecutivas, somando as da potência reativa se qt não for nulo */
+static void batch_abs_diff(const double *pt, const double *qt, int count, double *diff) {
+	int i;
+	
+	for(i = 0; i + SAMPLE_BLOCK_SIZE < count; i += SAMPLE_BLOCK_SIZE) {
+		sample_block_t result = block_abs(load_block(&pt[i + 1]) - load_block(&pt[i]));
+		
+		if(qt)
+			result += block_abs(load_block(&qt[i + 1]) - load_block(&qt[i]));
+		
+		memcpy(&diff[i], &result, sizeof(sample_block_t));
+	}
+	
+	for(; i < count - 1; i++)
+		diff[i] = fabs(pt[i + 1] - pt[i]) + ((qt) ? fabs(qt[i + 1] - qt[i]) : 0.0);
+}
+
+/*
+ * Detecta os eventos de um vetor de amostras em ordem estritamente crescente de timestamp, como um dia inteiro
+ * lido de um arquivo, com o mesmo resultado de alimentar um detector novo amostra por amostra. As potências totais
+ * ficam em vetores contíguos e um filtro vetorizado descarta as janelas sem mudança antes do detector, de maneira
+ * que a varredura é limitada pela leitura da memória. O CUSUM depende de todas as amostras e não usa o filtro.
+ * Retorna a quantidade de eventos, alocados em *events_ptr (que deve ser liberado com free), ou negativo em erro.
+ */
+int event_detector_detect_batch(event_detector_type_t type, double detection_threshold, const power_data_t *data, int count, load_event_t **events_ptr) {
+	const int window_qty = count - EVENT_DETECTOR_WINDOW_SIZE + 1;
+	double *pt, *qt, *diff;
+	unsigned char *mask;
+	load_event_t *events, *new_events;
+	int event_qty = 0;
+	int event_max = BATCH_INITIAL_EVENT_QTY;
+	window_view_t view;
+	cusum_state_t cusum;
+	int detected;
+	int drop;
+	
+	if(data == NULL || events_ptr == NULL || count < 0 || type < 0 || type >= EVENT_DETECTOR_TYPE_QTY)
+		return -1;
+	
+	*events_ptr = NULL;
+	
+	if(window_qty <= 0)
+		return 0;
+	
+	pt = (double*) malloc(sizeof(double) * count);
+	qt = (double*) malloc(sizeof(double) * count);
+	diff = (double*) malloc(sizeof(double) * count);
+	mask = (unsigned char*) malloc(window_qty);
+	events = (load_event_t*) malloc(sizeof(load_event_t) * event_max);
+	
+	if(pt == NULL || qt == NULL || diff == NULL || mask == NULL || events == NULL) {
+		free(pt);
+		free(qt);
+		free(diff);
+		free(mask);
+		free(events);
+		
+		return -2;
+	}
+	
+	for(int i = 0; i < count; i++) {
+		pt[i] = data[i].p[0] + data[i].p[1];
+		qt[i] = data[i].q[0] + data[i].q[1];
+	}
+	
+	switch(type) {
+		case EVENT_DETECTOR_STEP:
+			batch_mask_step(pt, window_qty, detection_threshold, mask);
+			break;
+		case EVENT_DETECTOR_GLR:
+			batch_abs_diff(pt, NULL, count, diff);
+			batch_mask_variation(diff, window_qty, detection_threshold, mask);
+			break;
+		case EVENT_DETECTOR_EDGE:
+			batch_abs_diff(pt, qt, count, diff);
+			batch_mask_variation(diff, window_qty, detection_threshold, mask);
+			break;
+		default:
+			memset(mask, 1, window_qty);
+			break;
+	}
+	
+	memset(&cusum, 0, sizeof(cusum_state_t));
+	
+	for(int i = 0; i < window_qty; i += drop) {
+		drop = 1;
+		
+		if(!mask[i] || (data[i + EVENT_DETECTOR_WINDOW_SIZE - 1].timestamp - data[i].timestamp) - (EVENT_DETECTOR_WINDOW_SIZE - 1) > MAX_TIME_GAP)
+			continue;
+		
+		for(int j = 0; j < EVENT_DETECTOR_WINDOW_SIZE; j++)
+			view.pd[j] = &data[i + j];
+		
+		view.pt = &pt[i];
+		view.qt = &qt[i];
+		
+		detected = 0;
+		
+		drop = detect_funcs[type](&view, detection_threshold, &cusum, &events[event_qty], &detected);
+		
+		if(!detected)
+			continue;
+		
+		// Cada janela começa onde a anterior terminou de ser descartada, como em event_detector_feed()
+		events[event_qty++].time_gap = 0;
+		
+		if(event_qty == event_max) {
+			if((new_events = (load_event_t*) realloc(events, sizeof(load_event_t) * event_max * 2)) == NULL) {
+				LOG_ERROR("Failed to allocate memory for load events.");
+				
+				free(pt);
+				free(qt);
+				free(diff);
+				free(mask);
+				free(events);
+				
+				return -2;
+			}
+			
+			events = new_events;
+			event_max *= 2;
+		}
+	}
+	
+	free(pt);
+	free(qt);
+	free(diff);
+	free(mask);
+	
+	*events_ptr = events;
+	
+	return event_qty;
+}
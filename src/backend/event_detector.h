@@ -0,0 +1,64 @@
+#ifndef EVENT_DETECTOR_H
+#define EVENT_DETECTOR_H
+
+#include <time.h>
+
+#include "power.h"
+#include "disaggregation.h"
+
+#define EVENT_DETECTOR_WINDOW_SIZE 10
+
+/* Algoritmos de detecção de mudança de patamar, selecionados pela configuração load_event_detector */
+typedef enum event_detector_type_e {
+	EVENT_DETECTOR_STEP = 0,
+	EVENT_DETECTOR_CUSUM,
+	EVENT_DETECTOR_GLR,
+	EVENT_DETECTOR_EDGE,
+	EVENT_DETECTOR_TYPE_QTY
+} event_detector_type_t;
+
+/* Estado do CUSUM bilateral, que processa cada amostra uma única vez mesmo com a janela deslizando mais de uma posição */
+typedef struct cusum_state_s {
+	double reference;
+	double sum_pos;
+	double sum_neg;
+	
+	// Últimas amostras em que cada soma estava zerada, a mudança começa logo depois
+	time_t zero_pos_timestamp;
+	time_t zero_neg_timestamp;
+	
+	time_t change_timestamp;
+	int alarm;
+	
+	time_t last_timestamp;
+} cusum_state_t;
+
+/* Estado do detector de eventos de carga, alimentado uma amostra por vez */
+typedef struct event_detector_s {
+	event_detector_type_t type;
+	double detection_threshold;
+	
+	/* Janela deslizante circular com as últimas amostras e suas potências ativa e reativa totais */
+	power_data_t window[EVENT_DETECTOR_WINDOW_SIZE];
+	double ptotal[EVENT_DETECTOR_WINDOW_SIZE];
+	double qtotal[EVENT_DETECTOR_WINDOW_SIZE];
+	int window_start;
+	int window_count;
+	
+	/* Soma dos segundos faltantes entre amostras consecutivas da janela */
+	int window_time_gap;
+	
+	time_t last_timestamp;
+	
+	cusum_state_t cusum;
+} event_detector_t;
+
+int event_detector_type_from_name(const char *name);
+const char *event_detector_type_name(event_detector_type_t type);
+event_detector_type_t event_detector_get_configured_type();
+
+void event_detector_init(event_detector_t *detector, event_detector_type_t type, double detection_threshold);
+int event_detector_feed(event_detector_t *detector, const power_data_t *pd, load_event_t *load_event);
+int event_detector_detect_batch(event_detector_type_t type, double detection_threshold, const power_data_t *data, int count, load_event_t **events_ptr);
+
+#endif
@@ -2,9 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <strings.h>
 
 #include <microhttpd.h>
+#include <zlib.h>
 
+#include "common.h"
 #include "http.h"
 #include "logger.h"
 #include "auth.h"
@@ -21,6 +26,15 @@
 #define CONNECTION_LIMIT 200
 #define CONNECTION_TIMEOUT 5
 
+// Respostas menores que isso são enviadas sem compressão, o ganho não compensa o processamento
+#define COMPRESSION_MIN_SIZE 1024
+
+// Tamanho dos blocos das respostas enviadas em partes
+#define STREAM_BLOCK_SIZE (32 * 1024)
+
+// Validade no navegador de recursos fechados, depois disso são revalidados com o ETag
+#define CLOSED_RESOURCE_CACHE_CONTROL "private, max-age=3600"
+
 typedef struct http_req_ctx {
 	char *data;
 	size_t data_size;
@@ -37,6 +51,35 @@ typedef unsigned int
 							size_t *resp_data_size,
 							void *arg);
 
+/* Handler de GET com resposta gerada durante o envio, o stream só é usado se o status retornado for 200 */
+typedef unsigned int
+(*http_stream_handler_func_t)(struct MHD_Connection *conn,
+							int logged_user_id,
+							path_parameter_t *path_parameters,
+							char **resp_content_type,
+							http_stream_t *resp_stream,
+							void *arg);
+
+/* Handler de GET com resposta compartilhada, o buffer só é usado se o status retornado for 200 */
+typedef unsigned int
+(*http_shared_handler_func_t)(struct MHD_Connection *conn,
+							int logged_user_id,
+							path_parameter_t *path_parameters,
+							char **resp_content_type,
+							http_shared_buffer_t *resp_buffer,
+							void *arg);
+
+/* Contexto de uma resposta em partes, com o estado da compressão se o cliente aceitar */
+typedef struct http_stream_ctx_s {
+	http_stream_t stream;
+	
+	int compress;
+	z_stream zstream;
+	char *in_buffer;
+	int in_end;
+	int zstream_end;
+} http_stream_ctx_t;
+
 typedef struct path_segment_s {
 	const char *text;
 	void *arg;
@@ -46,10 +89,27 @@ typedef struct path_segment_s {
 	http_handler_func_t post_handler;
 	http_handler_func_t delete_handler;
 	
+	/* Se definido, é usado no lugar do get_handler para respostas grandes, enviadas em partes */
+	http_stream_handler_func_t get_stream_handler;
+	
+	/* Se definido, é usado no lugar do get_handler para respostas montadas uma vez e enviadas a todos os clientes */
+	http_shared_handler_func_t get_shared_handler;
+	
+	/* Se definida, as respostas do GET recebem ETag e podem ser respondidas com 304 sem chamar o handler */
+	http_version_func_t get_version;
+	
+	/* Cabeçalhos da requisição que mudam o formato da resposta, enviados no cabeçalho "Vary" */
+	const char *vary;
+	
 	const struct path_segment_s *children;
 } path_segment_t;
 
 
+/* Incluído nos ETags, pois uma reconstrução das tabelas de energia (-r) pode mudar os valores mantendo a mesma
+ * quantidade de segundos. A reconstrução só roda com o servidor parado, o que é garantido pela trava de
+ * database_lock_exclusive(), então ela sempre é seguida de um novo server_start_time. */
+static time_t server_start_time;
+
 static const path_segment_t url_path_tree = {
 	.children = (const path_segment_t[]) {
 		{
@@ -98,6 +158,18 @@ static const path_segment_t url_path_tree = {
 						{}
 					}
 				},
+				{
+					.text = "classifier",
+					.get_handler = http_handler_get_classifier_status,
+				},
+				{
+					.text = "states",
+					.get_handler = http_handler_get_appliance_states,
+				},
+				{
+					.text = "energy",
+					.get_handler = http_handler_get_appliance_energy,
+				},
 				{
 					.text = "*",
 					.get_handler = http_handler_get_appliance,
@@ -136,14 +208,15 @@ static const path_segment_t url_path_tree = {
 			}
 		},{
 			.text = "dashboard",
-			.get_handler = http_handler_get_dashboard_data
+			.get_shared_handler = http_handler_get_dashboard_data
 		},{
 			.text = "power",
-			.get_handler = http_handler_get_power_data,
+			.get_stream_handler = http_handler_get_power_data,
+			.vary = MHD_HTTP_HEADER_ACCEPT,
 			.children = (const path_segment_t[]) {
 				{
 					.text = "events",
-					.get_handler = http_handler_get_load_events,
+					.get_stream_handler = http_handler_get_load_events,
 				},
 				{}
 			}
@@ -158,14 +231,25 @@ static const path_segment_t url_path_tree = {
 				{
 					.text = "hours",
 					.get_handler = http_handler_get_energy_hours,
+					.get_version = http_version_energy_hours,
 				},
 				{
 					.text = "days",
 					.get_handler = http_handler_get_energy_days,
+					.get_version = http_version_energy_days,
 				},
 				{
 					.text = "months",
 					.get_handler = http_handler_get_energy_months,
+					.get_version = http_version_energy_months,
+				},
+				{
+					.text = "aggregate",
+					.get_handler = http_handler_get_energy_aggregate,
+				},
+				{
+					.text = "coverage",
+					.get_handler = http_handler_get_energy_coverage,
 				},
 				{}
 			}
@@ -240,6 +324,252 @@ static const path_segment_t *resolve_url_path(const char *url_path, path_paramet
 	return child_ptr;
 }
 
+/* Verifica se a codificação está no cabeçalho Accept-Encoding, diretamente ou por "*", sem ter sido recusada com q=0 */
+static int accepts_encoding(const char *accept_encoding, const char *coding) {
+	const char *token = accept_encoding, *token_end, *params;
+	size_t coding_len = strlen(coding), token_len;
+	int accepted = 0;
+	
+	while(token && *token) {
+		while(*token == ' ' || *token == ',')
+			token++;
+		
+		token_end = token + strcspn(token, ",");
+		token_len = strcspn(token, " ;,");
+		params = token + token_len;
+		
+		if((token_len == coding_len && strncasecmp(token, coding, coding_len) == 0) || (token_len == 1 && *token == '*')) {
+			const char *q = strstr(params, "q=");
+			
+			// Uma codificação recusada explicitamente tem prioridade sobre "*"
+			if(q && q < token_end && atof(q + 2) <= 0.0) {
+				if(token_len == coding_len)
+					return 0;
+			} else {
+				accepted = 1;
+			}
+		}
+		
+		token = token_end;
+	}
+	
+	return accepted;
+}
+
+/* Comprime os dados no formato gzip ou zlib (deflate no HTTP), com o nível mais rápido. Retorna NULL se não houver ganho. */
+char *http_compress_data(const char *data, size_t data_size, int gzip, size_t *compressed_size) {
+	z_stream stream;
+	char *compressed;
+	uLong bound;
+	
+	memset(&stream, 0, sizeof(z_stream));
+	
+	if(deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+	
+	bound = deflateBound(&stream, data_size);
+	
+	if((compressed = (char*) malloc(bound)) == NULL) {
+		deflateEnd(&stream);
+		return NULL;
+	}
+	
+	stream.next_in = (Bytef*) data;
+	stream.avail_in = data_size;
+	stream.next_out = (Bytef*) compressed;
+	stream.avail_out = bound;
+	
+	if(deflate(&stream, Z_FINISH) != Z_STREAM_END || stream.total_out >= data_size) {
+		deflateEnd(&stream);
+		free(compressed);
+		
+		return NULL;
+	}
+	
+	*compressed_size = stream.total_out;
+	
+	deflateEnd(&stream);
+	
+	return compressed;
+}
+
+/* Escolhe a codificação da resposta pelo cabeçalho Accept-Encoding, dando preferência ao gzip */
+static const char *select_content_encoding(struct MHD_Connection *connection) {
+	const char *accept_encoding = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+	
+	if(accept_encoding && accepts_encoding(accept_encoding, "gzip"))
+		return "gzip";
+	else if(accept_encoding && accepts_encoding(accept_encoding, "deflate"))
+		return "deflate";
+	
+	return NULL;
+}
+
+static ssize_t stream_reader(void *cls, uint64_t pos, char *buf, size_t max) {
+	http_stream_ctx_t *stream_ctx = (http_stream_ctx_t*) cls;
+	ssize_t result;
+	
+	if(!stream_ctx->compress) {
+		result = stream_ctx->stream.read(stream_ctx->stream.ctx, buf, max);
+		
+		if(result < 0)
+			return MHD_CONTENT_READER_END_WITH_ERROR;
+		
+		return (result > 0) ? result : MHD_CONTENT_READER_END_OF_STREAM;
+	}
+	
+	stream_ctx->zstream.next_out = (Bytef*) buf;
+	stream_ctx->zstream.avail_out = max;
+	
+	/* O deflate guarda os dados internamente até ter o suficiente para um bloco, então é preciso ler até
+	 * produzir alguma saída, zero bytes retornados seria interpretado pelo MHD como "tente novamente" */
+	while(stream_ctx->zstream.avail_out == max) {
+		if(stream_ctx->zstream_end)
+			return MHD_CONTENT_READER_END_OF_STREAM;
+		
+		if(stream_ctx->zstream.avail_in == 0 && !stream_ctx->in_end) {
+			if((result = stream_ctx->stream.read(stream_ctx->stream.ctx, stream_ctx->in_buffer, STREAM_BLOCK_SIZE)) < 0)
+				return MHD_CONTENT_READER_END_WITH_ERROR;
+			
+			stream_ctx->in_end = (result == 0);
+			stream_ctx->zstream.next_in = (Bytef*) stream_ctx->in_buffer;
+			stream_ctx->zstream.avail_in = result;
+		}
+		
+		result = deflate(&stream_ctx->zstream, stream_ctx->in_end ? Z_FINISH : Z_NO_FLUSH);
+		
+		if(result == Z_STREAM_END)
+			stream_ctx->zstream_end = 1;
+		else if(result != Z_OK && result != Z_BUF_ERROR)
+			return MHD_CONTENT_READER_END_WITH_ERROR;
+	}
+	
+	return max - stream_ctx->zstream.avail_out;
+}
+
+static void stream_free(void *cls) {
+	http_stream_ctx_t *stream_ctx = (http_stream_ctx_t*) cls;
+	
+	if(stream_ctx->stream.free)
+		stream_ctx->stream.free(stream_ctx->stream.ctx);
+	
+	if(stream_ctx->compress)
+		deflateEnd(&stream_ctx->zstream);
+	
+	free(stream_ctx->in_buffer);
+	free(stream_ctx);
+}
+
+/* Cria a resposta em partes (chunked) a partir do stream do handler, que passa a ser liberado pelo MHD. Sem
+ * o tamanho total a compressão é sempre usada se o cliente aceitar. Em caso de falha o stream é liberado. */
+static struct MHD_Response *create_stream_response(struct MHD_Connection *connection, http_stream_t *stream, const char **content_encoding) {
+	http_stream_ctx_t *stream_ctx;
+	struct MHD_Response *response;
+	
+	*content_encoding = select_content_encoding(connection);
+	
+	if((stream_ctx = (http_stream_ctx_t*) calloc(1, sizeof(http_stream_ctx_t))) == NULL) {
+		if(stream->free)
+			stream->free(stream->ctx);
+		
+		return NULL;
+	}
+	
+	stream_ctx->stream = *stream;
+	
+	if(*content_encoding) {
+		if((stream_ctx->in_buffer = (char*) malloc(STREAM_BLOCK_SIZE)) != NULL &&
+			deflateInit2(&stream_ctx->zstream, Z_BEST_SPEED, Z_DEFLATED, (*content_encoding)[0] == 'g' ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+			stream_ctx->compress = 1;
+		} else {
+			*content_encoding = NULL;
+		}
+	}
+	
+	response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, STREAM_BLOCK_SIZE, &stream_reader, stream_ctx, &stream_free);
+	
+	if(response == NULL) {
+		*content_encoding = NULL;
+		stream_free(stream_ctx);
+	}
+	
+	return response;
+}
+
+#if (MHD_VERSION < 0x00097300)
+/* Sem MHD_create_response_from_buffer_with_free_callback_cls() o buffer compartilhado é lido por um callback */
+typedef struct http_shared_ctx_s {
+	http_shared_buffer_t shared;
+	const char *data;
+	size_t size;
+} http_shared_ctx_t;
+
+static ssize_t shared_reader(void *cls, uint64_t pos, char *buf, size_t max) {
+	http_shared_ctx_t *shared_ctx = (http_shared_ctx_t*) cls;
+	size_t length;
+	
+	if(pos >= shared_ctx->size)
+		return MHD_CONTENT_READER_END_OF_STREAM;
+	
+	length = MIN(max, shared_ctx->size - pos);
+	memcpy(buf, shared_ctx->data + pos, length);
+	
+	return length;
+}
+
+static void shared_free(void *cls) {
+	http_shared_ctx_t *shared_ctx = (http_shared_ctx_t*) cls;
+	
+	shared_ctx->shared.release(shared_ctx->shared.ctx);
+	free(shared_ctx);
+}
+#endif
+
+/* Cria a resposta a partir do buffer compartilhado do handler, que passa a ser liberado pelo MHD. A versão
+ * comprimida é usada se existir e o cliente aceitar gzip. Em caso de falha o buffer é liberado. */
+static struct MHD_Response *create_shared_response(struct MHD_Connection *connection, http_shared_buffer_t *shared, const char **content_encoding) {
+	const char *accept_encoding = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+	const char *data = shared->data;
+	size_t size = shared->size;
+	struct MHD_Response *response;
+#if (MHD_VERSION < 0x00097300)
+	http_shared_ctx_t *shared_ctx;
+#endif
+	
+	*content_encoding = NULL;
+	
+	if(shared->gzip_data && accept_encoding && accepts_encoding(accept_encoding, "gzip")) {
+		*content_encoding = "gzip";
+		data = shared->gzip_data;
+		size = shared->gzip_size;
+	}
+
+#if (MHD_VERSION < 0x00097300)
+	if((shared_ctx = (http_shared_ctx_t*) malloc(sizeof(http_shared_ctx_t))) == NULL) {
+		shared->release(shared->ctx);
+		*content_encoding = NULL;
+		
+		return NULL;
+	}
+	
+	shared_ctx->shared = *shared;
+	shared_ctx->data = data;
+	shared_ctx->size = size;
+	
+	if((response = MHD_create_response_from_callback(size, STREAM_BLOCK_SIZE, &shared_reader, shared_ctx, &shared_free)) == NULL) {
+		*content_encoding = NULL;
+		shared_free(shared_ctx);
+	}
+#else
+	if((response = MHD_create_response_from_buffer_with_free_callback_cls(size, data, shared->release, shared->ctx)) == NULL) {
+		*content_encoding = NULL;
+		shared->release(shared->ctx);
+	}
+#endif
+	
+	return response;
+}
+
 #if (MHD_VERSION < 0x00097002)
 static int
 #else
@@ -261,6 +591,11 @@ http_global_handler(void *cls, struct MHD_Connection *connection,
 	char *resp_content_type = NULL;
 	char *resp_data = NULL;
 	size_t resp_data_size = 0;
+	http_stream_t resp_stream = {0};
+	http_shared_buffer_t resp_shared = {0};
+	char etag[64] = "\0";
+	int etag_weak = 0;
+	const char *content_encoding = NULL;
 	int result;
 	
 	/* Na primeira chamada do callback con_cls é NULL e apenas os headers HTTP estão disponíveis */
@@ -301,11 +636,17 @@ http_global_handler(void *cls, struct MHD_Connection *connection,
 	
 	if(status == MHD_HTTP_OK) {
 		http_handler_func_t handler_f = NULL;
+		http_stream_handler_func_t stream_handler_f = NULL;
+		http_shared_handler_func_t shared_handler_f = NULL;
 		
 		path_seg = resolve_url_path(url_path, &path_parameters);
 		
 		if(path_seg == NULL)
 			status = MHD_HTTP_NOT_FOUND;
+		else if(strcmp(method, MHD_HTTP_METHOD_GET) == 0 && path_seg->get_stream_handler)
+			stream_handler_f = path_seg->get_stream_handler;
+		else if(strcmp(method, MHD_HTTP_METHOD_GET) == 0 && path_seg->get_shared_handler)
+			shared_handler_f = path_seg->get_shared_handler;
 		else if(strcmp(method, MHD_HTTP_METHOD_GET) == 0 && path_seg->get_handler)
 			handler_f = path_seg->get_handler;
 		else if(strcmp(method, MHD_HTTP_METHOD_POST) == 0 && path_seg->post_handler)
@@ -319,7 +660,7 @@ http_global_handler(void *cls, struct MHD_Connection *connection,
 		else
 			status = MHD_HTTP_METHOD_NOT_ALLOWED;
 		
-		if(handler_f) {
+		if(handler_f || stream_handler_f || shared_handler_f) {
 			const char *authorization_value = NULL;
 			int logged_user_id = -1;
 			
@@ -328,7 +669,34 @@ http_global_handler(void *cls, struct MHD_Connection *connection,
 			if(authorization_value && strncmp(authorization_value, "Bearer ", 7) == 0)
 				logged_user_id = auth_verify_key(authorization_value + 7);
 			
-			status = (handler_f)(connection, logged_user_id, path_parameters, req_context->data, req_context->data_size, &resp_content_type, &resp_data, &resp_data_size, path_seg->arg);
+			/* Recursos que não mudam mais são identificados pela versão do conteúdo, se o cliente já tem a mesma
+			 * versão responde apenas com 304, sem consultar o banco de dados */
+			if(handler_f && handler_f == path_seg->get_handler && path_seg->get_version && logged_user_id > 0) {
+				int64_t version = path_seg->get_version(connection);
+				
+				if(version >= 0) {
+					const char *if_none_match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH);
+					
+					snprintf(etag, sizeof(etag), "\"%lx-%" PRIx64 "\"", (unsigned long) server_start_time, version);
+					
+					const char *etag_match = if_none_match ? strstr(if_none_match, etag) : NULL;
+					
+					if(etag_match || (if_none_match && strcmp(if_none_match, "*") == 0)) {
+						status = MHD_HTTP_NOT_MODIFIED;
+						handler_f = NULL;
+						
+						// Devolve o ETag na mesma forma que o cliente guardou, fraco se a resposta original foi comprimida
+						etag_weak = (etag_match && etag_match - if_none_match >= 2 && strncmp(etag_match - 2, "W/", 2) == 0);
+					}
+				}
+			}
+			
+			if(handler_f)
+				status = (handler_f)(connection, logged_user_id, path_parameters, req_context->data, req_context->data_size, &resp_content_type, &resp_data, &resp_data_size, path_seg->arg);
+			else if(stream_handler_f)
+				status = (stream_handler_f)(connection, logged_user_id, path_parameters, &resp_content_type, &resp_stream, path_seg->arg);
+			else if(shared_handler_f)
+				status = (shared_handler_f)(connection, logged_user_id, path_parameters, &resp_content_type, &resp_shared, path_seg->arg);
 		}
 		
 		if(path_parameters)
@@ -338,13 +706,60 @@ http_global_handler(void *cls, struct MHD_Connection *connection,
 	free(req_context->data);
 	free(req_context);
 	
-	response = MHD_create_response_from_buffer(resp_data_size, resp_data, resp_data ? MHD_RESPMEM_MUST_FREE : MHD_RESPMEM_PERSISTENT);
+	if(resp_stream.read && status != MHD_HTTP_OK) {
+		if(resp_stream.free)
+			resp_stream.free(resp_stream.ctx);
+		
+		resp_stream.read = NULL;
+	}
+	
+	if(resp_shared.data && status != MHD_HTTP_OK) {
+		resp_shared.release(resp_shared.ctx);
+		resp_shared.data = NULL;
+	}
+	
+	/* Respostas grandes são comprimidas se o cliente aceitar, dando preferência ao gzip */
+	if(status == MHD_HTTP_OK && resp_data && resp_data_size >= COMPRESSION_MIN_SIZE) {
+		char *compressed_data = NULL;
+		size_t compressed_size;
+		
+		content_encoding = select_content_encoding(connection);
+		
+		if(content_encoding && (compressed_data = http_compress_data(resp_data, resp_data_size, content_encoding[0] == 'g', &compressed_size)) != NULL) {
+			free(resp_data);
+			resp_data = compressed_data;
+			resp_data_size = compressed_size;
+		} else {
+			content_encoding = NULL;
+		}
+	}
+	
+	if(resp_stream.read) {
+		if((response = create_stream_response(connection, &resp_stream, &content_encoding)) == NULL) {
+			LOG_ERROR("Failed to create streamed HTTP response.");
+			
+			resp_stream.read = NULL;
+			status = MHD_HTTP_INTERNAL_SERVER_ERROR;
+		}
+	}
+	
+	if(resp_shared.data) {
+		if((response = create_shared_response(connection, &resp_shared, &content_encoding)) == NULL) {
+			LOG_ERROR("Failed to create shared HTTP response.");
+			
+			resp_shared.data = NULL;
+			status = MHD_HTTP_INTERNAL_SERVER_ERROR;
+		}
+	}
+	
+	if(resp_stream.read == NULL && resp_shared.data == NULL)
+		response = MHD_create_response_from_buffer(resp_data_size, resp_data, resp_data ? MHD_RESPMEM_MUST_FREE : MHD_RESPMEM_PERSISTENT);
 	
 	/* Se um método não suportado foi recebido, envia o cabeçalho "Allow" com os métodos permitidos pela URL */
 	if (status == MHD_HTTP_METHOD_NOT_ALLOWED || options_request) {
 		char allow_str[32] = "\0";
 		
-		if(path_seg->get_handler)
+		if(path_seg->get_handler || path_seg->get_stream_handler || path_seg->get_shared_handler)
 			strcat(allow_str, "GET, ");
 		if(path_seg->put_handler)
 			strcat(allow_str, "PUT, ");
@@ -358,19 +773,45 @@ http_global_handler(void *cls, struct MHD_Connection *connection,
 		} else {
 			/* Remove virgula e espaço */
 			allow_str[strlen(allow_str) - 2] = '\0';
-
+			
 			MHD_add_response_header(response, MHD_HTTP_HEADER_ALLOW, allow_str);
 		}
 	}
 	
 	/* Se dados forem retornados, adiciona o cabeçalho "Content-Type" com o tipo MIME da resposta */
-	if(resp_data && resp_data_size) {
-		if(resp_content_type) {
+	if((resp_data && resp_data_size) || resp_stream.read || resp_shared.data) {
+		if(resp_content_type)
 			MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, resp_content_type);
-			free(resp_content_type);
-		} else {
+		else
 			MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+	}
+	
+	free(resp_content_type);
+	
+	if(content_encoding)
+		MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING, content_encoding);
+	
+	if(path_seg && path_seg->vary && (status == MHD_HTTP_OK || status == MHD_HTTP_NOT_MODIFIED)) {
+		char vary_str[128];
+		
+		snprintf(vary_str, sizeof(vary_str), "%s%s%s", path_seg->vary, content_encoding ? ", " : "", content_encoding ? MHD_HTTP_HEADER_ACCEPT_ENCODING : "");
+		MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, vary_str);
+	} else if(content_encoding) {
+		MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+	}
+	
+	if(etag[0] != '\0' && (status == MHD_HTTP_OK || status == MHD_HTTP_NOT_MODIFIED)) {
+		char weak_etag[sizeof(etag) + 2];
+		
+		/* O conteúdo comprimido é diferente byte a byte, então o ETag passa a ser fraco (mesmo conteúdo, outra codificação) */
+		if(content_encoding || etag_weak) {
+			snprintf(weak_etag, sizeof(weak_etag), "W/%s", etag);
+			MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, weak_etag);
+		} else {
+			MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG, etag);
 		}
+		
+		MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL, CLOSED_RESOURCE_CACHE_CONTROL);
 	}
 	
 	/* Adiciona cabeçalhos para permitir multiplas requisições em uma mesma conexão TCP */
@@ -388,15 +829,33 @@ http_global_handler(void *cls, struct MHD_Connection *connection,
 	return result;
 }
 
-struct MHD_Daemon* http_init(uint16_t port) {
+struct MHD_Daemon* http_init(uint16_t port, int thread_qty) {
 	struct MHD_Daemon *httpd;
+	unsigned int flags = MHD_USE_ERROR_LOG;
 	struct MHD_OptionItem opta[] = {
 		{ MHD_OPTION_CONNECTION_LIMIT,		CONNECTION_LIMIT,	NULL },
 		{ MHD_OPTION_CONNECTION_TIMEOUT,	CONNECTION_TIMEOUT,	NULL },
+		{ MHD_OPTION_THREAD_POOL_SIZE,		thread_qty,			NULL },
 		{ MHD_OPTION_END, 0, NULL }
 	};
 	
-	httpd = MHD_start_daemon(MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_THREAD_PER_CONNECTION | MHD_USE_ERROR_LOG, port,
+	/* Com thread_qty igual a zero é criada uma thread para cada conexão, caso contrário as conexões são
+	 * distribuídas entre um conjunto fixo de threads, cada uma com seu próprio laço de eventos. */
+	if(thread_qty > 0) {
+		if(MHD_is_feature_supported(MHD_FEATURE_EPOLL) == MHD_YES)
+			flags |= MHD_USE_EPOLL_INTERNAL_THREAD;
+		else
+			flags |= MHD_USE_AUTO_INTERNAL_THREAD;
+	} else {
+		flags |= MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_THREAD_PER_CONNECTION;
+		
+		// A opção de tamanho do conjunto de threads não pode ser usada com uma thread por conexão
+		opta[2].option = MHD_OPTION_END;
+	}
+	
+	server_start_time = time(NULL);
+	
+	httpd = MHD_start_daemon(flags, port,
 		NULL, NULL, /* access control */
  		&http_global_handler, NULL, /* request handler */
 		MHD_OPTION_ARRAY, opta,
@@ -407,7 +866,10 @@ struct MHD_Daemon* http_init(uint16_t port) {
 		return NULL;
 	}
 	
-	LOG_INFO("HTTP server started on port %hu.", port);
+	if(thread_qty > 0)
+		LOG_INFO("HTTP server started on port %hu with %d worker threads.", port, thread_qty);
+	else
+		LOG_INFO("HTTP server started on port %hu with one thread per connection.", port);
 	
 	return httpd;
 }
@@ -1,10 +1,14 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include <stdint.h>
+#include <sys/types.h>
 #include <microhttpd.h>
 
 #define DEFAULT_HTTP_PORT 8081
+#define DEFAULT_HTTP_THREAD_QTY 4
 #define JSON_CONTENT_TYPE "application/json"
+#define BINARY_CONTENT_TYPE "application/octet-stream"
 
 typedef struct path_parameter_s {
 	int pos;
@@ -13,9 +17,33 @@ typedef struct path_parameter_s {
 	struct path_parameter_s *next;
 } path_parameter_t;
 
+/* Retorna a versão do conteúdo de um recurso que não muda mais, usada para gerar o ETag, ou um valor negativo
+ * se o recurso ainda pode mudar e não deve ser guardado em cache. */
+typedef int64_t (*http_version_func_t)(struct MHD_Connection *conn);
+
+/* Resposta gerada em partes durante o envio (chunked), sem precisar ficar inteira em memória */
+typedef struct http_stream_s {
+	/* Escreve até max bytes em buffer, retorna a quantidade escrita, zero no fim dos dados ou um valor negativo em caso de erro */
+	ssize_t (*read)(void *ctx, char *buffer, size_t max);
+	void (*free)(void *ctx);
+	void *ctx;
+} http_stream_t;
+
+/* Resposta pronta em memória, compartilhada entre requisições e enviada sem cópia. release(ctx) é chamada quando
+ * o MHD termina o envio. Se gzip_data não for NULL, é o mesmo conteúdo já comprimido, enviado se o cliente aceitar. */
+typedef struct http_shared_buffer_s {
+	const char *data;
+	size_t size;
+	const char *gzip_data;
+	size_t gzip_size;
+	void (*release)(void *ctx);
+	void *ctx;
+} http_shared_buffer_t;
+
 const char *http_parameter_get_value(const path_parameter_t *parameters, int position);
+char *http_compress_data(const char *data, size_t data_size, int gzip, size_t *compressed_size);
 
-struct MHD_Daemon* http_init(uint16_t port);
+struct MHD_Daemon* http_init(uint16_t port, int thread_qty);
 void http_stop(struct MHD_Daemon *httpd);
 
 #endif
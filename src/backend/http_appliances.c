@@ -9,6 +9,9 @@
 #include "database.h"
 #include "logger.h"
 #include "users.h"
+#include "classifier.h"
+#include "signature_matrix.h"
+#include "appliance_tracker.h"
 
 static int check_appliance_id(int appliance_id) {
 	int result;
@@ -20,26 +23,24 @@ static int check_appliance_id(int appliance_id) {
 	if(appliance_id <= 0)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_check_appliance_id, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_check_appliance_id, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if(sqlite3_bind_int(ppstmt, 1, appliance_id) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind appliance ID to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -47,8 +48,8 @@ static int check_appliance_id(int appliance_id) {
 	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW)
 		count++;
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to check appliance ID: %s", sqlite3_errstr(result));
@@ -69,26 +70,24 @@ static int update_appliance_modification_date(int appliance_id) {
 	if(appliance_id <= 0)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_update_appliance_mod_date, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_update_appliance_mod_date, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if(sqlite3_bind_int(ppstmt, 1, appliance_id) != SQLITE_OK || sqlite3_bind_int64(ppstmt, 2, time(NULL)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -96,8 +95,8 @@ static int update_appliance_modification_date(int appliance_id) {
 	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW)
 		count++;
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to update the appliance modification date: %s", sqlite3_errstr(result));
@@ -130,18 +129,16 @@ unsigned int http_handler_get_appliance_list(struct MHD_Connection *conn,
 	if(logged_user_id <= 0)
 		return MHD_HTTP_UNAUTHORIZED;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_appliances, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_appliances, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -168,8 +165,8 @@ unsigned int http_handler_get_appliance_list(struct MHD_Connection *conn,
 		json_object_object_add_ex(json_appliance_item, "signature_qty", json_object_new_int(sqlite3_column_int(ppstmt, 8)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read appliances: %s", sqlite3_errstr(result));
@@ -224,26 +221,24 @@ unsigned int http_handler_get_appliance(struct MHD_Connection *conn,
 	if(sscanf(appliance_id_str, "%d", &appliance_id) != 1 || appliance_id <= 0)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_appliance, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_appliance, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if((result = sqlite3_bind_int(ppstmt, 1, appliance_id)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -269,8 +264,8 @@ unsigned int http_handler_get_appliance(struct MHD_Connection *conn,
 		json_object_object_add_ex(json_response, "signature_qty", json_object_new_int(sqlite3_column_int(ppstmt, 7)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read appliances: %s", sqlite3_errstr(result));
@@ -318,6 +313,7 @@ unsigned int http_handler_create_appliance(struct MHD_Connection *conn,
 	sqlite3_stmt *ppstmt = NULL;
 	const char sql_get_appliance[] = "INSERT INTO appliances(name,creator_id,is_active,power,is_hardwired,creation_date,modification_date) VALUES(?1, ?2, ?3, ?4, ?5, ?5, ?6);";
 	int new_appliance_id;
+	int is_active;
 	
 	if(logged_user_id <= 0 || users_check_admin(logged_user_id) == 0)
 		return MHD_HTTP_UNAUTHORIZED;
@@ -345,19 +341,19 @@ unsigned int http_handler_create_appliance(struct MHD_Connection *conn,
 		return MHD_HTTP_BAD_REQUEST;
 	}
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	is_active = json_object_get_boolean(json_is_active);
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_appliance, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_appliance, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -366,15 +362,15 @@ unsigned int http_handler_create_appliance(struct MHD_Connection *conn,
 	// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
 	result = sqlite3_bind_text(ppstmt, 1, json_object_get_string(json_name), -1, SQLITE_STATIC);
 	result += sqlite3_bind_int(ppstmt, 2, logged_user_id);
-	result += sqlite3_bind_int(ppstmt, 3, json_object_get_boolean(json_is_active));
+	result += sqlite3_bind_int(ppstmt, 3, is_active);
 	result += sqlite3_bind_double(ppstmt, 4, json_object_get_double(json_power));
 	result += sqlite3_bind_int(ppstmt, 5, json_object_get_boolean(json_is_hardwired));
 	result += sqlite3_bind_int64(ppstmt, 6, time(NULL));
 	
 	if(result) {
 		LOG_ERROR("Failed to bind appliance values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -384,8 +380,8 @@ unsigned int http_handler_create_appliance(struct MHD_Connection *conn,
 	
 	new_appliance_id = sqlite3_last_insert_rowid(db_conn);
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	json_object_put(received_json);
 	
@@ -398,6 +394,9 @@ unsigned int http_handler_create_appliance(struct MHD_Connection *conn,
 	if((*resp_data = malloc(sizeof(char) * 128)) == NULL)
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	
+	if(new_appliance_id > 0 && !is_active)
+		signature_matrix_set_appliance_active(new_appliance_id, 0);
+	
 	if(new_appliance_id > 0)
 		*resp_data_size = sprintf(*resp_data, "{\"result\":\"success\",\"appliance_id\":%d}", new_appliance_id);
 	else
@@ -428,6 +427,7 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 	sqlite3_stmt *ppstmt = NULL;
 	const char sql_update_appliance[] = "UPDATE appliances SET (name,is_active,power,is_hardwired,modification_date) = (IFNULL(?2, current_values.name), IFNULL(?3, current_values.is_active), IFNULL(?4, current_values.power), IFNULL(?5, current_values.is_hardwired), ?6) FROM (SELECT name,is_active,power,is_hardwired FROM appliances WHERE id = ?1) AS current_values WHERE id = ?1;";
 	int changes;
+	int is_active = -1;
 	
 	if(logged_user_id <= 0 || users_check_admin(logged_user_id) == 0)
 		return MHD_HTTP_UNAUTHORIZED;
@@ -461,19 +461,17 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 		return MHD_HTTP_BAD_REQUEST;
 	}
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_update_appliance, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_update_appliance, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -487,7 +485,7 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 		result += sqlite3_bind_null(ppstmt, 2);
 	
 	if(json_is_active)
-		result += sqlite3_bind_int(ppstmt, 3, json_object_get_boolean(json_is_active));
+		result += sqlite3_bind_int(ppstmt, 3, (is_active = json_object_get_boolean(json_is_active)));
 	else
 		result += sqlite3_bind_null(ppstmt, 3);
 	
@@ -505,8 +503,8 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 	
 	if(result) {
 		LOG_ERROR("Failed to bind appliance values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -516,8 +514,8 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 	
 	changes = sqlite3_changes(db_conn);
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	json_object_put(received_json);
 	
@@ -528,13 +526,19 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 	}
 	
 	if(changes == 1) {
+		/* Ativar ou desativar um aparelho muda o conjunto de treinamento, o hash evita retreinar nos outros casos */
+		classifier_request_retrain();
+		
+		if(is_active >= 0)
+			signature_matrix_set_appliance_active(appliance_id, is_active);
+		
 		*resp_data = strdup("{\"result\":\"success\"}");
 		
 		if(*resp_data)
 			*resp_data_size = strlen(*resp_data);
 		else
 			return MHD_HTTP_INTERNAL_SERVER_ERROR;
-		
+	
 	} else {
 		return MHD_HTTP_NOT_FOUND;
 	}
@@ -544,6 +548,173 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 	return MHD_HTTP_OK;
 }
 
+static struct json_object *classifier_model_status_to_json(const classifier_model_status_t *model_status) {
+	struct json_object* json_model;
+	
+	if(!model_status->available)
+		return NULL;
+	
+	json_model = json_object_new_object();
+	
+	json_object_object_add_ex(json_model, "sample_qty", json_object_new_int(model_status->sample_qty), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "class_qty", json_object_new_int(model_status->class_qty), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "c", json_object_new_double(model_status->c), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "gamma", json_object_new_double(model_status->gamma), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "cv_accuracy", (model_status->cv_accuracy >= 0) ? json_object_new_double(model_status->cv_accuracy) : NULL, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "sv_qty", json_object_new_int(model_status->sv_qty), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "full_sample_qty", json_object_new_int(model_status->full_sample_qty), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "full_accuracy", (model_status->full_accuracy >= 0) ? json_object_new_double(model_status->full_accuracy) : NULL, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_model, "training_time", json_object_new_double(model_status->training_time), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	return json_model;
+}
+
+unsigned int http_handler_get_classifier_status(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg) {
+	
+	classifier_status_t status;
+	struct json_object* json_response = NULL;
+	
+	if(logged_user_id <= 0)
+		return MHD_HTTP_UNAUTHORIZED;
+	
+	if(classifier_get_status(&status))
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	json_response = json_object_new_object();
+	
+	json_object_object_add_ex(json_response, "version", json_object_new_int(status.version), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_response, "training", json_object_new_boolean(status.training), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_response, "on", classifier_model_status_to_json(&status.on), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(json_response, "off", classifier_model_status_to_json(&status.off), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	*resp_data = strdup(json_object_get_string(json_response));
+	
+	json_object_put(json_response);
+	
+	if(*resp_data == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	*resp_data_size = strlen(*resp_data);
+	
+	*resp_content_type = strdup(JSON_CONTENT_TYPE);
+	
+	return MHD_HTTP_OK;
+}
+
+unsigned int http_handler_get_appliance_states(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg) {
+	
+	appliance_interval_t intervals[APPLIANCE_TRACKER_MAX_APPLIANCES];
+	int interval_qty;
+	
+	json_object *response_array = NULL;
+	json_object *response_item = NULL;
+	
+	if(logged_user_id <= 0)
+		return MHD_HTTP_UNAUTHORIZED;
+	
+	if((interval_qty = appliance_tracker_get_intervals(intervals, APPLIANCE_TRACKER_MAX_APPLIANCES)) < 0)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	response_array = json_object_new_array();
+	
+	for(int i = 0; i < interval_qty; i++) {
+		response_item = json_object_new_object();
+		
+		json_object_object_add_ex(response_item, "appliance_id", json_object_new_int(intervals[i].appliance_id), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "on_timestamp", json_object_new_int64(intervals[i].on_timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "power", json_object_new_double(intervals[i].power), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		json_object_array_add(response_array, response_item);
+	}
+	
+	*resp_data = strdup(json_object_get_string(response_array));
+	
+	json_object_put(response_array);
+	
+	if(*resp_data == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	*resp_data_size = strlen(*resp_data);
+	
+	*resp_content_type = strdup(JSON_CONTENT_TYPE);
+	
+	return MHD_HTTP_OK;
+}
+
+unsigned int http_handler_get_appliance_energy(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg) {
+	const char *start_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "start");
+	const char *end_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "end");
+	time_t start_timestamp, end_timestamp;
+	
+	appliance_energy_t energy_buffer[APPLIANCE_TRACKER_MAX_APPLIANCES];
+	int energy_qty;
+	
+	json_object *response_array = NULL;
+	json_object *response_item = NULL;
+	
+	if(logged_user_id <= 0)
+		return MHD_HTTP_UNAUTHORIZED;
+	
+	if(start_timestamp_str == NULL || sscanf(start_timestamp_str, "%ld", &start_timestamp) != 1 || start_timestamp < 0)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if(end_timestamp_str == NULL || sscanf(end_timestamp_str, "%ld", &end_timestamp) != 1 || end_timestamp <= start_timestamp)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if((energy_qty = appliance_energy_get(start_timestamp, end_timestamp, energy_buffer, APPLIANCE_TRACKER_MAX_APPLIANCES)) < 0)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	response_array = json_object_new_array();
+	
+	for(int i = 0; i < energy_qty; i++) {
+		response_item = json_object_new_object();
+		
+		json_object_object_add_ex(response_item, "appliance_id", json_object_new_int(energy_buffer[i].appliance_id), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "on_seconds", json_object_new_int(energy_buffer[i].on_seconds), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "active", json_object_new_double(energy_buffer[i].active), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "cost", json_object_new_double(energy_buffer[i].cost), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		json_object_array_add(response_array, response_item);
+	}
+	
+	*resp_data = strdup(json_object_get_string(response_array));
+	
+	json_object_put(response_array);
+	
+	if(*resp_data == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	*resp_data_size = strlen(*resp_data);
+	
+	*resp_content_type = strdup(JSON_CONTENT_TYPE);
+	
+	return MHD_HTTP_OK;
+}
+
 /*
  * 
  * 
@@ -590,26 +761,24 @@ unsigned int http_handler_get_appliance_signature_list(struct MHD_Connection *co
 			return MHD_HTTP_NOT_FOUND;
 	}
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_signatures, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_signatures, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if(sqlite3_bind_int(ppstmt, 1, appliance_id) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind appliance ID to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -646,8 +815,8 @@ unsigned int http_handler_get_appliance_signature_list(struct MHD_Connection *co
 		json_object_object_add_ex(json_signature_item, "duration", json_object_new_int(sqlite3_column_int(ppstmt, 11)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read appliance signatures: %s", sqlite3_errstr(result));
@@ -702,26 +871,24 @@ unsigned int http_handler_get_appliance_signature(struct MHD_Connection *conn,
 	if(sscanf(signature_timestamp_str, "%ld", &signature_timestamp) != 1 || signature_timestamp <= 0)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_signature, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_signature, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if((result = sqlite3_bind_int64(ppstmt, 1, signature_timestamp)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -757,8 +924,8 @@ unsigned int http_handler_get_appliance_signature(struct MHD_Connection *conn,
 		json_object_object_add_ex(json_response, "duration", json_object_new_int(sqlite3_column_int(ppstmt, 10)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read appliances: %s", sqlite3_errstr(result));
@@ -812,6 +979,7 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 	sqlite3_stmt *ppstmt = NULL;
 	const char sql_insert_signature[] = "INSERT OR REPLACE INTO signatures(appliance_id,creator_id,timestamp,delta_pt,peak_pt,delta_pa,delta_pb,delta_sa,delta_sb,delta_qa,delta_qb,duration) VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12);";
 	int insert_counter = 0;
+	load_event_t signature;
 	
 	if(logged_user_id <= 0 || users_check_admin(logged_user_id) == 0)
 		return MHD_HTTP_UNAUTHORIZED;
@@ -841,19 +1009,17 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 		return MHD_HTTP_BAD_REQUEST;
 	}
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_insert_signature, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_insert_signature, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -864,8 +1030,8 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 	
 	if(result) {
 		LOG_ERROR("Failed to bind appliance values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		json_object_put(received_json);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -875,8 +1041,8 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 		received_json_item = json_object_array_get_idx(received_json, index);
 		
 		if(json_object_get_type(received_json_item) != json_type_object) {
-			sqlite3_finalize(ppstmt);
-			sqlite3_close(db_conn);
+			database_finalize(ppstmt);
+			database_close(db_conn);
 			json_object_put(received_json);
 			
 			return MHD_HTTP_BAD_REQUEST;
@@ -898,8 +1064,8 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 			|| json_object_get_type(json_delta_q) != json_type_array || json_object_array_length(json_delta_q) != 2
 			|| json_object_get_type(json_duration) != json_type_int) {
 			
-			sqlite3_finalize(ppstmt);
-			sqlite3_close(db_conn);
+			database_finalize(ppstmt);
+			database_close(db_conn);
 			json_object_put(received_json);
 			
 			return MHD_HTTP_BAD_REQUEST;
@@ -919,8 +1085,8 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 			||	(json_object_get_type(json_delta_qa) != json_type_double && json_object_get_type(json_delta_qa) != json_type_int)
 			||	(json_object_get_type(json_delta_qb) != json_type_double && json_object_get_type(json_delta_qb) != json_type_int)) {
 			
-			sqlite3_finalize(ppstmt);
-			sqlite3_close(db_conn);
+			database_finalize(ppstmt);
+			database_close(db_conn);
 			json_object_put(received_json);
 			
 			return MHD_HTTP_BAD_REQUEST;
@@ -940,8 +1106,8 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 		
 		if(result) {
 			LOG_ERROR("Failed to bind appliance values to prepared statement.");
-			sqlite3_finalize(ppstmt);
-			sqlite3_close(db_conn);
+			database_finalize(ppstmt);
+			database_close(db_conn);
 			json_object_put(received_json);
 			
 			return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -949,8 +1115,8 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 		
 		if((result = sqlite3_step(ppstmt)) != SQLITE_DONE) {
 			LOG_ERROR("Failed to add new appliance signature: %s", sqlite3_errstr(result));
-			sqlite3_finalize(ppstmt);
-			sqlite3_close(db_conn);
+			database_finalize(ppstmt);
+			database_close(db_conn);
 			json_object_put(received_json);
 			
 			return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -959,15 +1125,30 @@ unsigned int http_handler_add_appliance_signatures(struct MHD_Connection *conn,
 		insert_counter += sqlite3_changes(db_conn);
 		
 		sqlite3_reset(ppstmt);
+		
+		signature.timestamp = json_object_get_int64(json_timestamp);
+		signature.duration = json_object_get_int(json_duration);
+		signature.delta_pt = json_object_get_double(json_delta_pt);
+		signature.peak_pt = json_object_get_double(json_peak_pt);
+		signature.delta_p[0] = json_object_get_double(json_delta_pa);
+		signature.delta_p[1] = json_object_get_double(json_delta_pb);
+		signature.delta_s[0] = json_object_get_double(json_delta_sa);
+		signature.delta_s[1] = json_object_get_double(json_delta_sb);
+		signature.delta_q[0] = json_object_get_double(json_delta_qa);
+		signature.delta_q[1] = json_object_get_double(json_delta_qb);
+		
+		signature_matrix_add(appliance_id, &signature);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	json_object_put(received_json);
 	
-	if(insert_counter > 0)
+	if(insert_counter > 0) {
 		update_appliance_modification_date(appliance_id);
+		classifier_request_retrain();
+	}
 	
 	if((*resp_data = malloc(sizeof(char) * 128)) == NULL)
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -1011,26 +1192,24 @@ unsigned int http_handler_delete_appliance_signature(struct MHD_Connection *conn
 	if(sscanf(signature_timestamp_str, "%ld", &signature_timestamp) != 1 || signature_timestamp <= 0)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_delete_signature, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_delete_signature, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if((result = sqlite3_bind_int64(ppstmt, 1, signature_timestamp)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -1040,8 +1219,8 @@ unsigned int http_handler_delete_appliance_signature(struct MHD_Connection *conn
 	
 	changes = sqlite3_changes(db_conn);
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to delete appliance signature: %s", sqlite3_errstr(result));
@@ -1053,6 +1232,8 @@ unsigned int http_handler_delete_appliance_signature(struct MHD_Connection *conn
 		return MHD_HTTP_NOT_FOUND;
 	
 	update_appliance_modification_date(deleted_signature_appliance_id);
+	signature_matrix_remove(signature_timestamp);
+	classifier_request_retrain();
 	
 	return MHD_HTTP_OK;
 }
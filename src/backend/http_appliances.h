@@ -40,6 +40,36 @@ unsigned int http_handler_update_appliance(struct MHD_Connection *conn,
 											size_t *resp_data_size,
 											void *arg);
 
+unsigned int http_handler_get_classifier_status(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg);
+
+unsigned int http_handler_get_appliance_states(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg);
+
+unsigned int http_handler_get_appliance_energy(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg);
+
 unsigned int http_handler_get_appliance_signature_list(struct MHD_Connection *conn,
 														int logged_user_id,
 														path_parameter_t *path_parameters,
@@ -32,18 +32,16 @@ unsigned int http_handler_get_config_list(struct MHD_Connection *conn,
 	if(logged_user_id <= 0)
 		return MHD_HTTP_UNAUTHORIZED;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_configs, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_configs, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -78,8 +76,8 @@ unsigned int http_handler_get_config_list(struct MHD_Connection *conn,
 		json_object_object_add_ex(json_config_item, "modification_date", json_object_new_int64(sqlite3_column_int64(ppstmt, 4)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to fetch config list from database: %s", sqlite3_errstr(result));
@@ -130,26 +128,24 @@ unsigned int http_handler_get_config(struct MHD_Connection *conn,
 	if((config_key_str = http_parameter_get_value(path_parameters, 2)) == NULL || strlen(config_key_str) < 1)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_config, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_config, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if((result = sqlite3_bind_text(ppstmt, 1, config_key_str, -1, SQLITE_STATIC)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -180,8 +176,8 @@ unsigned int http_handler_get_config(struct MHD_Connection *conn,
 		json_object_object_add_ex(json_response, "modification_date", json_object_new_int64(sqlite3_column_int64(ppstmt, 4)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to fetch config from database: %s", sqlite3_errstr(result));
@@ -245,18 +241,16 @@ unsigned int http_handler_update_config(struct MHD_Connection *conn,
 	if(json_object_get_type(received_json) != json_type_string)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_update_config, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_update_config, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -268,8 +262,8 @@ unsigned int http_handler_update_config(struct MHD_Connection *conn,
 		
 	if(result) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -278,8 +272,8 @@ unsigned int http_handler_update_config(struct MHD_Connection *conn,
 		
 	changes = sqlite3_changes(db_conn);
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to update config value in database: %s", sqlite3_errstr(result));
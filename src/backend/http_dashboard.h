@@ -1,9 +1,8 @@
+#include "http.h"
+
 unsigned int http_handler_get_dashboard_data(struct MHD_Connection *conn,
 												int logged_user_id,
 												path_parameter_t *path_parameters,
-												char *req_data,
-												size_t req_data_size,
 												char **resp_content_type,
-												char **resp_data,
-												size_t *resp_data_size,
+												http_shared_buffer_t *resp_buffer,
 												void *arg);
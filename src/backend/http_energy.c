@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <time.h>
 
@@ -9,6 +10,8 @@
 #include "logger.h"
 #include "http.h"
 #include "database.h"
+#include "energy.h"
+#include "replay.h"
 
 unsigned int http_handler_get_energy_overview(struct MHD_Connection *conn,
 												int logged_user_id,
@@ -31,21 +34,70 @@ unsigned int http_handler_get_energy_overview(struct MHD_Connection *conn,
 	json_object *year_item = NULL;
 	json_object *month_array = NULL;
 	
+	energy_calendar_month_t *calendar_months = NULL;
+	time_t minute_min_timestamp, minute_max_timestamp;
+	int month_count;
+	
 	if(logged_user_id <= 0)
 		return MHD_HTTP_UNAUTHORIZED;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((calendar_months = (energy_calendar_month_t*) malloc(sizeof(energy_calendar_month_t) * ENERGY_CALENDAR_MAX_MONTHS)) == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	/* O calendário em memória evita as consultas ao banco de dados, que ficam mais lentas conforme o histórico cresce */
+	if((month_count = energy_calendar_get_months(calendar_months, ENERGY_CALENDAR_MAX_MONTHS, &minute_min_timestamp, &minute_max_timestamp)) >= 0) {
+		response_object = json_object_new_object();
+		
+		year_array = json_object_new_array();
+		
+		json_object_object_add_ex(response_object, "years", year_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		for(int i = 0; i < month_count; i++) {
+			if(year != calendar_months[i].year) {
+				year = calendar_months[i].year;
+				
+				year_item = json_object_new_object();
+				json_object_array_add(year_array, year_item);
+				json_object_object_add_ex(year_item, "year", json_object_new_int(year), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+				
+				month_array = json_object_new_array();
+				json_object_object_add_ex(year_item, "months", month_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			}
+			
+			json_object_array_add(month_array, json_object_new_int(calendar_months[i].month));
+		}
+		
+		free(calendar_months);
+		
+		json_object_object_add_ex(response_object, "minute_min_timestamp", json_object_new_int64(minute_min_timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_object, "minute_max_timestamp", json_object_new_int64(minute_max_timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		*resp_data = strdup(json_object_get_string(response_object));
+		
+		json_object_put(response_object);
+		
+		if(*resp_data == NULL)
+			return MHD_HTTP_INTERNAL_SERVER_ERROR;
+		
+		*resp_data_size = strlen(*resp_data);
+		
+		*resp_content_type = strdup(JSON_CONTENT_TYPE);
+		
+		return MHD_HTTP_OK;
+	}
+	
+	free(calendar_months);
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_energy_months, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_energy_months, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -71,19 +123,19 @@ unsigned int http_handler_get_energy_overview(struct MHD_Connection *conn,
 		json_object_array_add(month_array, json_object_new_int(sqlite3_column_int(ppstmt, 1)));
 	}
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to get energy dates from database: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(response_object);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_energy_minute_bounds, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_energy_minute_bounds, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		json_object_put(response_object);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
@@ -96,8 +148,8 @@ unsigned int http_handler_get_energy_overview(struct MHD_Connection *conn,
 		result = sqlite3_step(ppstmt);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to get energy dates from database: %s", sqlite3_errstr(result));
@@ -138,6 +190,9 @@ unsigned int http_handler_get_energy_minutes(struct MHD_Connection *conn,
 	sqlite3_stmt *ppstmt = NULL;
 	const char sql_get_energy_minutes[] = "SELECT timestamp,second_count,active,reactive FROM energy_minutes WHERE timestamp >= ?1 AND timestamp <= ?2;";
 	
+	energy_minute_t *minute_buffer = NULL;
+	int minute_count;
+	
 	json_object *response_array = NULL;
 	json_object *response_item = NULL;
 	
@@ -153,26 +208,60 @@ unsigned int http_handler_get_energy_minutes(struct MHD_Connection *conn,
 	if(end_timestamp - start_timestamp > 24 * 3600)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((minute_buffer = (energy_minute_t*) malloc(sizeof(energy_minute_t) * (24 * 60 + 1))) == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	/* Intervalos recentes são atendidos pelo cache, sem acessar o banco de dados */
+	if((minute_count = energy_minute_cache_get(start_timestamp, end_timestamp, minute_buffer, 24 * 60 + 1)) >= 0) {
+		response_array = json_object_new_array();
+		
+		for(int i = 0; i < minute_count; i++) {
+			response_item = json_object_new_object();
+			
+			json_object_object_add_ex(response_item, "timestamp", json_object_new_int64(minute_buffer[i].timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			json_object_object_add_ex(response_item, "second_count", json_object_new_int(minute_buffer[i].second_count), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			json_object_object_add_ex(response_item, "active", json_object_new_double(minute_buffer[i].active), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			json_object_object_add_ex(response_item, "reactive", json_object_new_double(minute_buffer[i].reactive), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+			
+			json_object_array_add(response_array, response_item);
+		}
+		
+		free(minute_buffer);
+		
+		*resp_data = strdup(json_object_get_string(response_array));
+		
+		json_object_put(response_array);
+		
+		if(*resp_data == NULL)
+			return MHD_HTTP_INTERNAL_SERVER_ERROR;
+		
+		*resp_data_size = strlen(*resp_data);
+		
+		*resp_content_type = strdup(JSON_CONTENT_TYPE);
+		
+		return MHD_HTTP_OK;
+	}
+	
+	free(minute_buffer);
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_energy_minutes, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_energy_minutes, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if(sqlite3_bind_int64(ppstmt, 1, start_timestamp) != SQLITE_OK || sqlite3_bind_int64(ppstmt, 2, end_timestamp) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -190,8 +279,8 @@ unsigned int http_handler_get_energy_minutes(struct MHD_Connection *conn,
 		json_object_array_add(response_array, response_item);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to get energy data as minutes: %s", sqlite3_errstr(result));
@@ -240,36 +329,34 @@ unsigned int http_handler_get_energy_hours(struct MHD_Connection *conn,
 	
 	if(date_year_srt == NULL || sscanf(date_year_srt, "%d", &date_year) != 1)
 		return MHD_HTTP_BAD_REQUEST;
-		
+	
 	if(date_month_srt == NULL || sscanf(date_month_srt, "%d", &date_month) != 1)
 		return MHD_HTTP_BAD_REQUEST;
-		
+	
 	if(date_day_srt == NULL || sscanf(date_day_srt, "%d", &date_day) != 1)
 		return MHD_HTTP_BAD_REQUEST;
 	
 	if(date_year < 2021 || date_month < 1 || date_month > 12 || date_day < 1 || date_day > 31)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_energy_hours, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_energy_hours, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if(sqlite3_bind_int(ppstmt, 1, date_year) != SQLITE_OK || sqlite3_bind_int(ppstmt, 2, date_month) != SQLITE_OK || sqlite3_bind_int(ppstmt, 3, date_day) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -288,8 +375,8 @@ unsigned int http_handler_get_energy_hours(struct MHD_Connection *conn,
 		json_object_array_add(response_array, response_item);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to get energy data as hours: %s", sqlite3_errstr(result));
@@ -337,33 +424,31 @@ unsigned int http_handler_get_energy_days(struct MHD_Connection *conn,
 	
 	if(date_year_srt == NULL || sscanf(date_year_srt, "%d", &date_year) != 1)
 		return MHD_HTTP_BAD_REQUEST;
-		
+	
 	if(date_month_srt == NULL || sscanf(date_month_srt, "%d", &date_month) != 1)
 		return MHD_HTTP_BAD_REQUEST;
 	
 	if(date_year < 2021 || date_month < 1 || date_month > 12)
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_energy_days, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_energy_days, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if(sqlite3_bind_int(ppstmt, 1, date_year) != SQLITE_OK || sqlite3_bind_int(ppstmt, 2, date_month) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -382,8 +467,8 @@ unsigned int http_handler_get_energy_days(struct MHD_Connection *conn,
 		json_object_array_add(response_array, response_item);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to get energy data as days: %s", sqlite3_errstr(result));
@@ -432,26 +517,24 @@ unsigned int http_handler_get_energy_months(struct MHD_Connection *conn,
 		return MHD_HTTP_BAD_REQUEST;
 	
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_energy_months, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_energy_months, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if(sqlite3_bind_int(ppstmt, 1, date_year) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -470,8 +553,8 @@ unsigned int http_handler_get_energy_months(struct MHD_Connection *conn,
 		json_object_array_add(response_array, response_item);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to get energy data as months: %s", sqlite3_errstr(result));
@@ -492,3 +575,255 @@ unsigned int http_handler_get_energy_months(struct MHD_Connection *conn,
 	
 	return MHD_HTTP_OK;
 }
+
+unsigned int http_handler_get_energy_aggregate(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg) {
+	const char *start_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "start");
+	const char *end_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "end");
+	const char *bucket_size_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "bucket");
+	time_t start_timestamp, end_timestamp;
+	long bucket_size;
+	
+	energy_bucket_t *bucket_buffer = NULL;
+	int bucket_qty;
+	
+	json_object *response_array = NULL;
+	json_object *response_item = NULL;
+	
+	if(logged_user_id <= 0)
+		return MHD_HTTP_UNAUTHORIZED;
+	
+	if(start_timestamp_str == NULL || sscanf(start_timestamp_str, "%ld", &start_timestamp) != 1 || start_timestamp < 0)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if(end_timestamp_str == NULL || sscanf(end_timestamp_str, "%ld", &end_timestamp) != 1)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	/* Os dados são armazenados por minuto, então o intervalo é expandido para minutos inteiros */
+	start_timestamp -= start_timestamp % 60;
+	end_timestamp += (60 - (end_timestamp % 60)) % 60;
+	
+	if(end_timestamp <= start_timestamp)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	// Sem tamanho de bucket, o intervalo inteiro é somado em um único bucket
+	if(bucket_size_str == NULL)
+		bucket_size = end_timestamp - start_timestamp;
+	else if(sscanf(bucket_size_str, "%ld", &bucket_size) != 1 || bucket_size < 60 || (bucket_size % 60) != 0)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if(bucket_size > INT_MAX - 59 || (end_timestamp - start_timestamp + bucket_size - 1) / bucket_size > ENERGY_AGGREGATE_MAX_BUCKETS)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if((bucket_buffer = (energy_bucket_t*) malloc(sizeof(energy_bucket_t) * ENERGY_AGGREGATE_MAX_BUCKETS)) == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	if((bucket_qty = energy_aggregate(start_timestamp, end_timestamp, (int) bucket_size, bucket_buffer, ENERGY_AGGREGATE_MAX_BUCKETS)) < 0) {
+		free(bucket_buffer);
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	}
+	
+	response_array = json_object_new_array();
+	
+	for(int i = 0; i < bucket_qty; i++) {
+		response_item = json_object_new_object();
+		
+		json_object_object_add_ex(response_item, "timestamp", json_object_new_int64(bucket_buffer[i].timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "second_count", json_object_new_int(bucket_buffer[i].second_count), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "active", json_object_new_double(bucket_buffer[i].active), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "reactive", json_object_new_double(bucket_buffer[i].reactive), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "cost", json_object_new_double(bucket_buffer[i].cost), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		json_object_array_add(response_array, response_item);
+	}
+	
+	free(bucket_buffer);
+	
+	*resp_data = strdup(json_object_get_string(response_array));
+	
+	json_object_put(response_array);
+	
+	if(*resp_data == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	*resp_data_size = strlen(*resp_data);
+	
+	*resp_content_type = strdup(JSON_CONTENT_TYPE);
+	
+	return MHD_HTTP_OK;
+}
+
+unsigned int http_handler_get_energy_coverage(struct MHD_Connection *conn,
+												int logged_user_id,
+												path_parameter_t *path_parameters,
+												char *req_data,
+												size_t req_data_size,
+												char **resp_content_type,
+												char **resp_data,
+												size_t *resp_data_size,
+												void *arg) {
+	const char *date_year_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "year");
+	const char *date_month_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "month");
+	int date_year, date_month;
+	int day_seconds[31];
+	struct tm day_tm;
+	time_t day_start, day_end;
+	
+	json_object *response_array = NULL;
+	json_object *response_item = NULL;
+	
+	if(logged_user_id <= 0)
+		return MHD_HTTP_UNAUTHORIZED;
+	
+	if(date_year_srt == NULL || sscanf(date_year_srt, "%d", &date_year) != 1)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if(date_month_srt == NULL || sscanf(date_month_srt, "%d", &date_month) != 1)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if(date_year < 2021 || date_month < 1 || date_month > 12)
+		return MHD_HTTP_BAD_REQUEST;
+	
+	if(energy_calendar_get_month_coverage(date_year, date_month, day_seconds))
+		return MHD_HTTP_SERVICE_UNAVAILABLE;
+	
+	response_array = json_object_new_array();
+	
+	for(int day = 1; day <= 31; day++) {
+		if(day_seconds[day - 1] <= 0)
+			continue;
+		
+		/* A duração do dia local pode ser diferente de 24 horas por causa do horário de verão */
+		memset(&day_tm, 0, sizeof(struct tm));
+		day_tm.tm_year = date_year - 1900;
+		day_tm.tm_mon = date_month - 1;
+		day_tm.tm_mday = day;
+		day_tm.tm_isdst = -1;
+		
+		day_start = mktime(&day_tm);
+		
+		day_tm.tm_mday++;
+		day_tm.tm_hour = 0;
+		day_tm.tm_isdst = -1;
+		
+		day_end = mktime(&day_tm);
+		
+		response_item = json_object_new_object();
+		
+		json_object_object_add_ex(response_item, "day", json_object_new_int(day), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "second_count", json_object_new_int(day_seconds[day - 1]), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		json_object_object_add_ex(response_item, "coverage", json_object_new_double((day_end > day_start) ? (double) day_seconds[day - 1] / (day_end - day_start) : 0), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+		
+		json_object_array_add(response_array, response_item);
+	}
+	
+	*resp_data = strdup(json_object_get_string(response_array));
+	
+	json_object_put(response_array);
+	
+	if(*resp_data == NULL)
+		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	
+	*resp_data_size = strlen(*resp_data);
+	
+	*resp_content_type = strdup(JSON_CONTENT_TYPE);
+	
+	return MHD_HTTP_OK;
+}
+
+/* Soma os segundos registrados nos dias do mês [first_day, last_day], -1 se o calendário não foi carregado. Não muda
+ * quando os mesmos dados são reintegrados por uma reconstrução, o que é coberto pelo server_start_time do ETag. */
+static int64_t calendar_seconds(int year, int month, int first_day, int last_day) {
+	int day_seconds[31];
+	int64_t total = 0;
+	
+	if(energy_calendar_get_month_coverage(year, month, day_seconds))
+		return -1;
+	
+	for(int day = first_day; day <= last_day; day++)
+		total += day_seconds[day - 1];
+	
+	return total;
+}
+
+static struct tm current_date() {
+	time_t now = replay_now();
+	struct tm now_tm;
+	
+	localtime_r(&now, &now_tm);
+	
+	return now_tm;
+}
+
+/*
+ * Versões dos períodos fechados, que não recebem mais dados. Como os registros de energia só mudam quando
+ * um segundo é acrescentado, a quantidade de segundos do período identifica o conteúdo.
+ */
+int64_t http_version_energy_hours(struct MHD_Connection *conn) {
+	const char *date_year_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "year");
+	const char *date_month_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "month");
+	const char *date_day_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "day");
+	int date_year, date_month, date_day;
+	struct tm now_tm = current_date();
+	
+	if(date_year_srt == NULL || sscanf(date_year_srt, "%d", &date_year) != 1
+		|| date_month_srt == NULL || sscanf(date_month_srt, "%d", &date_month) != 1
+		|| date_day_srt == NULL || sscanf(date_day_srt, "%d", &date_day) != 1)
+		return -1;
+	
+	if(date_year < 2021 || date_month < 1 || date_month > 12 || date_day < 1 || date_day > 31)
+		return -1;
+	
+	if(date_year * 10000 + date_month * 100 + date_day >= (now_tm.tm_year + 1900) * 10000 + (now_tm.tm_mon + 1) * 100 + now_tm.tm_mday)
+		return -1;
+	
+	return calendar_seconds(date_year, date_month, date_day, date_day);
+}
+
+int64_t http_version_energy_days(struct MHD_Connection *conn) {
+	const char *date_year_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "year");
+	const char *date_month_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "month");
+	int date_year, date_month;
+	struct tm now_tm = current_date();
+	
+	if(date_year_srt == NULL || sscanf(date_year_srt, "%d", &date_year) != 1
+		|| date_month_srt == NULL || sscanf(date_month_srt, "%d", &date_month) != 1)
+		return -1;
+	
+	if(date_year < 2021 || date_month < 1 || date_month > 12)
+		return -1;
+	
+	if(date_year * 100 + date_month >= (now_tm.tm_year + 1900) * 100 + (now_tm.tm_mon + 1))
+		return -1;
+	
+	return calendar_seconds(date_year, date_month, 1, 31);
+}
+
+int64_t http_version_energy_months(struct MHD_Connection *conn) {
+	const char *date_year_srt = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "year");
+	int date_year;
+	int64_t month_seconds, total = 0;
+	struct tm now_tm = current_date();
+	
+	if(date_year_srt == NULL || sscanf(date_year_srt, "%d", &date_year) != 1 || date_year < 2021)
+		return -1;
+	
+	if(date_year >= now_tm.tm_year + 1900)
+		return -1;
+	
+	for(int month = 1; month <= 12; month++) {
+		if((month_seconds = calendar_seconds(date_year, month, 1, 31)) < 0)
+			return -1;
+		
+		total += month_seconds;
+	}
+	
+	return total;
+}
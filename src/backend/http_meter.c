@@ -58,26 +58,24 @@ unsigned int http_handler_get_meter_events(struct MHD_Connection *conn,
 		return MHD_HTTP_BAD_REQUEST;
 	}
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_meter_events, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_meter_events, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
 	
 	if(sqlite3_bind_int64(ppstmt, 1, start_timestamp) != SQLITE_OK || sqlite3_bind_int64(ppstmt, 2, end_timestamp) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	}
@@ -98,8 +96,8 @@ unsigned int http_handler_get_meter_events(struct MHD_Connection *conn,
 		json_object_object_add_ex(json_event, "count", json_object_new_int(sqlite3_column_int(ppstmt, 2)), JSON_C_OBJECT_ADD_KEY_IS_NEW);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to fetch meter events from database: %s", sqlite3_errstr(result));
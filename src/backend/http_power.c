@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <endian.h>
 #include <time.h>
 
 #include <json-c/json.h>
@@ -11,6 +13,30 @@
 #include "power.h"
 #include "disaggregation.h"
 
+/* As respostas são enviadas em partes, lendo os dados aos poucos dos arquivos e do banco de dados, então o uso
+ * de memória não depende do tamanho do intervalo. */
+#define POWER_DATA_MAX_RANGE (31 * 24 * 3600)
+#define LOAD_EVENTS_MAX_RANGE (31 * 24 * 3600)
+
+// Quantidade de entradas lidas de cada vez durante o envio
+#define POWER_STREAM_BUFFER_LEN 256
+#define LOAD_EVENTS_STREAM_BUFFER_LEN 64
+
+// Tamanho máximo do texto de um item dos arrays JSON enviados em partes
+#define JSON_STREAM_ITEM_MAX 2048
+
+/*
+ * Formato binário dos dados de potência (format=bin ou Accept: application/octet-stream), para ser carregado
+ * diretamente em typed arrays. Cabeçalho de 8 bytes com a assinatura "TCPD", a versão e a quantidade de colunas de
+ * valores (uint16), seguido de blocos com a quantidade de entradas (uint32), a coluna de timestamps (uint32) e as
+ * colunas de valores (float32), na ordem do JSON. Tudo em little-endian e alinhado em 4 bytes, um bloco com zero
+ * entradas indica o fim dos dados.
+ */
+#define POWER_BINARY_MAGIC "TCPD"
+#define POWER_BINARY_VERSION 1
+#define POWER_BINARY_MAX_COLUMNS 3
+#define POWER_BINARY_BLOCK_SIZE (8 + 4 + POWER_STREAM_BUFFER_LEN * 4 * (1 + POWER_BINARY_MAX_COLUMNS))
+
 enum power_get_type {
 	POWER_GET_PT,
 	POWER_GET_PTV,
@@ -21,27 +47,371 @@ enum power_get_type {
 	POWER_GET_Q
 };
 
+/* Array JSON enviado em partes, os itens são gerados um por vez por next_item, que retorna o tamanho do texto
+ * escrito, zero no fim do array ou um valor negativo em caso de erro. Deve ser o primeiro membro do estado do stream. */
+typedef struct json_array_stream_s {
+	int (*next_item)(struct json_array_stream_s *array_stream, char *item, size_t len);
+	
+	char pending[JSON_STREAM_ITEM_MAX];
+	size_t pending_len;
+	size_t pending_pos;
+	
+	int item_count;
+	int finished;
+} json_array_stream_t;
+
+typedef struct power_stream_s {
+	json_array_stream_t array_stream;
+	
+	enum power_get_type type;
+	power_data_cursor_t cursor;
+	
+	power_data_t pd_buffer[POWER_STREAM_BUFFER_LEN];
+	int pd_qty;
+	int pd_pos;
+	
+	/* Bloco do formato binário sendo enviado, o primeiro também contém o cabeçalho */
+	uint8_t block[POWER_BINARY_BLOCK_SIZE];
+	size_t block_len;
+	size_t block_pos;
+	int block_count;
+	int block_finished;
+} power_stream_t;
+
+typedef struct load_event_stream_s {
+	json_array_stream_t array_stream;
+	
+	time_t next_timestamp;
+	time_t end_timestamp;
+	
+	load_event_t loadev_buffer[LOAD_EVENTS_STREAM_BUFFER_LEN];
+	int loadev_qty;
+	int loadev_pos;
+} load_event_stream_t;
+
+static ssize_t json_array_stream_read(void *ctx, char *buffer, size_t max) {
+	json_array_stream_t *array_stream = (json_array_stream_t*) ctx;
+	size_t written = 0, copy_len;
+	int item_len;
+	
+	while(written < max) {
+		if(array_stream->pending_pos < array_stream->pending_len) {
+			copy_len = MIN(array_stream->pending_len - array_stream->pending_pos, max - written);
+			
+			memcpy(&buffer[written], &array_stream->pending[array_stream->pending_pos], copy_len);
+			
+			array_stream->pending_pos += copy_len;
+			written += copy_len;
+			
+			continue;
+		}
+		
+		if(array_stream->finished)
+			break;
+		
+		// O primeiro caractere fica reservado para o separador do item
+		item_len = array_stream->next_item(array_stream, &array_stream->pending[1], sizeof(array_stream->pending) - 1);
+		
+		if(item_len < 0 || item_len >= (int) sizeof(array_stream->pending) - 1)
+			return -1;
+		
+		array_stream->pending_pos = 0;
+		
+		if(item_len == 0) {
+			array_stream->pending_len = sprintf(array_stream->pending, (array_stream->item_count == 0) ? "[]" : "]");
+			array_stream->finished = 1;
+		} else {
+			array_stream->pending[0] = (array_stream->item_count == 0) ? '[' : ',';
+			array_stream->pending_len = 1 + item_len;
+			array_stream->item_count++;
+		}
+	}
+	
+	return written;
+}
+
+static int power_stream_next_item(json_array_stream_t *array_stream, char *item, size_t len) {
+	power_stream_t *power_stream = (power_stream_t*) array_stream;
+	power_data_t *pd;
+	
+	if(power_stream->pd_pos >= power_stream->pd_qty) {
+		power_stream->pd_qty = power_data_cursor_read(&power_stream->cursor, power_stream->pd_buffer, POWER_STREAM_BUFFER_LEN);
+		power_stream->pd_pos = 0;
+		
+		if(power_stream->pd_qty <= 0)
+			return power_stream->pd_qty;
+	}
+	
+	pd = &power_stream->pd_buffer[power_stream->pd_pos++];
+	
+	// Gerar o JSON de resposta diretamente em texto neste caso é mais fácil e eficiente.
+	if(power_stream->type == POWER_GET_PT)
+		return snprintf(item, len, "[%ld,%.2lf]", pd->timestamp, (pd->p[0] + pd->p[1]));
+	else if(power_stream->type == POWER_GET_PTV)
+		return snprintf(item, len, "[%ld,%.2lf,%.2lf,%.2lf]", pd->timestamp, (pd->p[0] + pd->p[1]), pd->v[0], pd->v[1]);
+	else if(power_stream->type == POWER_GET_V)
+		return snprintf(item, len, "[%ld,%.2lf,%.2lf]", pd->timestamp, pd->v[0], pd->v[1]);
+	else if(power_stream->type == POWER_GET_P)
+		return snprintf(item, len, "[%ld,%.2lf,%.2lf]", pd->timestamp, pd->p[0], pd->p[1]);
+	else if(power_stream->type == POWER_GET_I)
+		return snprintf(item, len, "[%ld,%.2lf,%.2lf]", pd->timestamp, pd->i[0], pd->i[1]);
+	else if(power_stream->type == POWER_GET_S)
+		return snprintf(item, len, "[%ld,%.2lf,%.2lf]", pd->timestamp, pd->s[0], pd->s[1]);
+	else
+		return snprintf(item, len, "[%ld,%.2lf,%.2lf]", pd->timestamp, pd->q[0], pd->q[1]);
+}
+
+/* Valores de uma entrada para o tipo de consulta, na mesma ordem das colunas do JSON. Retorna a quantidade de valores. */
+static int power_get_values(enum power_get_type type, const power_data_t *pd, double *values) {
+	if(type == POWER_GET_PT) {
+		values[0] = pd->p[0] + pd->p[1];
+		return 1;
+	} else if(type == POWER_GET_PTV) {
+		values[0] = pd->p[0] + pd->p[1];
+		values[1] = pd->v[0];
+		values[2] = pd->v[1];
+		return 3;
+	}
+	
+	if(type == POWER_GET_V)
+		memcpy(values, pd->v, sizeof(pd->v));
+	else if(type == POWER_GET_P)
+		memcpy(values, pd->p, sizeof(pd->p));
+	else if(type == POWER_GET_I)
+		memcpy(values, pd->i, sizeof(pd->i));
+	else if(type == POWER_GET_S)
+		memcpy(values, pd->s, sizeof(pd->s));
+	else
+		memcpy(values, pd->q, sizeof(pd->q));
+	
+	return 2;
+}
+
+static void put_le32(uint8_t *dest, uint32_t value) {
+	value = htole32(value);
+	memcpy(dest, &value, sizeof(uint32_t));
+}
+
+static void put_float_le32(uint8_t *dest, float value) {
+	uint32_t bits;
+	
+	memcpy(&bits, &value, sizeof(uint32_t));
+	put_le32(dest, bits);
+}
+
+/* Monta o próximo bloco do formato binário a partir das entradas lidas do cursor */
+static int power_binary_next_block(power_stream_t *power_stream) {
+	double values[POWER_BINARY_MAX_COLUMNS];
+	uint8_t *ts_column, *value_column;
+	int pd_qty, value_qty;
+	
+	// A quantidade de valores depende apenas do tipo da consulta
+	value_qty = power_get_values(power_stream->type, &power_stream->pd_buffer[0], values);
+	
+	power_stream->block_len = 0;
+	power_stream->block_pos = 0;
+	
+	if(power_stream->block_count == 0) {
+		uint16_t header[2] = {htole16(POWER_BINARY_VERSION), htole16(value_qty)};
+		
+		memcpy(power_stream->block, POWER_BINARY_MAGIC, 4);
+		memcpy(&power_stream->block[4], header, sizeof(header));
+		
+		power_stream->block_len = 8;
+	}
+	
+	if((pd_qty = power_data_cursor_read(&power_stream->cursor, power_stream->pd_buffer, POWER_STREAM_BUFFER_LEN)) < 0)
+		return pd_qty;
+	
+	put_le32(&power_stream->block[power_stream->block_len], pd_qty);
+	power_stream->block_len += 4;
+	
+	ts_column = &power_stream->block[power_stream->block_len];
+	
+	for(int i = 0; i < pd_qty; i++) {
+		power_get_values(power_stream->type, &power_stream->pd_buffer[i], values);
+		
+		put_le32(&ts_column[i * 4], power_stream->pd_buffer[i].timestamp);
+		
+		for(int j = 0; j < value_qty; j++) {
+			value_column = &ts_column[(1 + j) * pd_qty * 4];
+			put_float_le32(&value_column[i * 4], values[j]);
+		}
+	}
+	
+	power_stream->block_len += pd_qty * 4 * (1 + value_qty);
+	power_stream->block_count++;
+	
+	if(pd_qty == 0)
+		power_stream->block_finished = 1;
+	
+	return 0;
+}
+
+static ssize_t power_binary_stream_read(void *ctx, char *buffer, size_t max) {
+	power_stream_t *power_stream = (power_stream_t*) ctx;
+	size_t written = 0, copy_len;
+	
+	while(written < max) {
+		if(power_stream->block_pos < power_stream->block_len) {
+			copy_len = MIN(power_stream->block_len - power_stream->block_pos, max - written);
+			
+			memcpy(&buffer[written], &power_stream->block[power_stream->block_pos], copy_len);
+			
+			power_stream->block_pos += copy_len;
+			written += copy_len;
+			
+			continue;
+		}
+		
+		if(power_stream->block_finished)
+			break;
+		
+		if(power_binary_next_block(power_stream) < 0)
+			return -1;
+	}
+	
+	return written;
+}
+
+static void power_stream_free(void *ctx) {
+	power_stream_t *power_stream = (power_stream_t*) ctx;
+	
+	power_data_cursor_close(&power_stream->cursor);
+	free(power_stream);
+}
+
+static json_object *load_event_to_json(const load_event_t *load_event) {
+	json_object *response_item = NULL;
+	json_object *appliance_array = NULL;
+	
+	response_item = json_object_new_object();
+	
+	json_object_object_add_ex(response_item, "timestamp", json_object_new_int64(load_event->timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "duration", json_object_new_int(load_event->duration), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "delta_pt", json_object_new_double(load_event->delta_pt), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "peak_pt", json_object_new_double(load_event->peak_pt), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "top_appliance_id", json_object_new_int(load_event->top_appliance_id), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "prob_avg",  json_object_new_double(load_event->prob_avg), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "prob_sd",  json_object_new_double(load_event->prob_sd), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "knn_appliance_id", json_object_new_int(load_event->knn_appliance_id), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "knn_confidence", json_object_new_double(load_event->knn_confidence), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	json_object_object_add_ex(response_item, "model_version", json_object_new_int(load_event->model_version), JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	appliance_array = json_object_new_array();
+	json_object_array_add(appliance_array, json_object_new_double(load_event->delta_p[0]));
+	json_object_array_add(appliance_array, json_object_new_double(load_event->delta_p[1]));
+	
+	json_object_object_add_ex(response_item, "delta_p", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	appliance_array = json_object_new_array();
+	json_object_array_add(appliance_array, json_object_new_double(load_event->delta_s[0]));
+	json_object_array_add(appliance_array, json_object_new_double(load_event->delta_s[1]));
+	
+	json_object_object_add_ex(response_item, "delta_s", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	appliance_array = json_object_new_array();
+	json_object_array_add(appliance_array, json_object_new_double(load_event->delta_q[0]));
+	json_object_array_add(appliance_array, json_object_new_double(load_event->delta_q[1]));
+	
+	json_object_object_add_ex(response_item, "delta_q", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	appliance_array = json_object_new_array();
+	json_object_array_add(appliance_array, json_object_new_int(load_event->appliance_ids[0]));
+	json_object_array_add(appliance_array, json_object_new_int(load_event->appliance_ids[1]));
+	json_object_array_add(appliance_array, json_object_new_int(load_event->appliance_ids[2]));
+	
+	json_object_object_add_ex(response_item, "appliance_ids", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	appliance_array = json_object_new_array();
+	json_object_array_add(appliance_array, json_object_new_double(load_event->appliance_probs[0]));
+	json_object_array_add(appliance_array, json_object_new_double(load_event->appliance_probs[1]));
+	json_object_array_add(appliance_array, json_object_new_double(load_event->appliance_probs[2]));
+	
+	json_object_object_add_ex(response_item, "appliance_probs", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
+	
+	return response_item;
+}
+
+static int load_event_stream_next_item(json_array_stream_t *array_stream, char *item, size_t len) {
+	load_event_stream_t *loadev_stream = (load_event_stream_t*) array_stream;
+	json_object *response_item;
+	int item_len;
+	
+	if(loadev_stream->loadev_pos >= loadev_stream->loadev_qty) {
+		if(loadev_stream->next_timestamp > loadev_stream->end_timestamp)
+			return 0;
+		
+		loadev_stream->loadev_qty = get_load_events(loadev_stream->next_timestamp, loadev_stream->end_timestamp, loadev_stream->loadev_buffer, LOAD_EVENTS_STREAM_BUFFER_LEN);
+		loadev_stream->loadev_pos = 0;
+		
+		if(loadev_stream->loadev_qty <= 0)
+			return loadev_stream->loadev_qty;
+		
+		// Menos eventos que o pedido indica que não há mais nada no intervalo
+		if(loadev_stream->loadev_qty < LOAD_EVENTS_STREAM_BUFFER_LEN)
+			loadev_stream->next_timestamp = loadev_stream->end_timestamp + 1;
+		else
+			loadev_stream->next_timestamp = loadev_stream->loadev_buffer[loadev_stream->loadev_qty - 1].timestamp + 1;
+	}
+	
+	response_item = load_event_to_json(&loadev_stream->loadev_buffer[loadev_stream->loadev_pos++]);
+	
+	item_len = snprintf(item, len, "%s", json_object_get_string(response_item));
+	
+	json_object_put(response_item);
+	
+	return item_len;
+}
+
+/* Interpreta os parâmetros last ou start e end, comuns aos dados de potência e aos eventos de carga */
+static int parse_time_range(struct MHD_Connection *conn, int max_range, time_t *start_timestamp, time_t *end_timestamp) {
+	const char *last_secs_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "last");
+	const char *start_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "start");
+	const char *end_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "end");
+	
+	int last_secs;
+	
+	if(last_secs_str) {
+		if(sscanf(last_secs_str, "%d", &last_secs) != 1)
+			return -1;
+		
+		if(last_secs < 0 || last_secs > max_range)
+			return -1;
+		
+		*end_timestamp = power_get_last_timestamp();
+		*start_timestamp = *end_timestamp - last_secs;
+	
+	} else if(start_timestamp_str && end_timestamp_str) {
+		if(sscanf(start_timestamp_str, "%ld", start_timestamp) != 1 || sscanf(end_timestamp_str, "%ld", end_timestamp) != 1)
+			return -1;
+		
+		if(*end_timestamp <= 0 || *start_timestamp <= 0 || *end_timestamp < *start_timestamp || *end_timestamp - *start_timestamp > max_range)
+			return -1;
+	
+	} else {
+		return -1;
+	}
+	
+	return 0;
+}
+
 unsigned int http_handler_get_power_data(struct MHD_Connection *conn,
 										int logged_user_id,
 										path_parameter_t *path_parameters,
-										char *req_data,
-										size_t req_data_size,
 										char **resp_content_type,
-										char **resp_data,
-										size_t *resp_data_size,
+										http_stream_t *resp_stream,
 										void *arg) {
 	
 	const char *type_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "type");
-	const char *last_secs_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "last");
-	const char *start_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "start");
-	const char *end_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "end");
+	const char *format_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "format");
+	const char *accept_str = MHD_lookup_connection_value(conn, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT);
 	
 	enum power_get_type type;
-	int last_secs;
+	int binary_format;
 	time_t start_timestamp, end_timestamp;
 	
-	power_data_t *pd_buffer = NULL;
-	int pd_qty;
+	power_stream_t *power_stream;
 	
 	if(logged_user_id <= 0)
 		return MHD_HTTP_UNAUTHORIZED;
@@ -63,79 +433,32 @@ unsigned int http_handler_get_power_data(struct MHD_Connection *conn,
 	else
 		return MHD_HTTP_BAD_REQUEST;
 	
-	if(last_secs_str) {
-		if(sscanf(last_secs_str, "%d", &last_secs) != 1)
-			return MHD_HTTP_BAD_REQUEST;
-		
-		if(last_secs < 0 || last_secs > 12 * 3600)
-			return MHD_HTTP_BAD_REQUEST;
-		
-		end_timestamp = power_get_last_timestamp();
-		start_timestamp = end_timestamp - last_secs;
-		
-	} else if(start_timestamp_str && end_timestamp_str) {
-		if(sscanf(start_timestamp_str, "%ld", &start_timestamp) != 1 || sscanf(end_timestamp_str, "%ld", &end_timestamp) != 1)
-			return MHD_HTTP_BAD_REQUEST;
-		
-		if(end_timestamp <= 0 || start_timestamp<= 0 || end_timestamp < start_timestamp || end_timestamp - start_timestamp > 12 * 3600)
-			return MHD_HTTP_BAD_REQUEST;
-		
-	} else {
+	// O parâmetro format tem prioridade sobre o cabeçalho Accept
+	if(format_str == NULL)
+		binary_format = (accept_str && strstr(accept_str, BINARY_CONTENT_TYPE));
+	else if(!strcmp(format_str, "bin"))
+		binary_format = 1;
+	else if(!strcmp(format_str, "json"))
+		binary_format = 0;
+	else
 		return MHD_HTTP_BAD_REQUEST;
-	}
-	
-	pd_buffer = (power_data_t*) malloc(sizeof(power_data_t) * (1 + end_timestamp - start_timestamp));
-	
-	if(pd_buffer == NULL)
-		return MHD_HTTP_INTERNAL_SERVER_ERROR;
 	
-	pd_qty = get_power_data(start_timestamp, end_timestamp, pd_buffer, (1 + end_timestamp - start_timestamp));
+	if(parse_time_range(conn, POWER_DATA_MAX_RANGE, &start_timestamp, &end_timestamp))
+		return MHD_HTTP_BAD_REQUEST;
 	
-	if(pd_qty < 0) {
-		free(pd_buffer);
+	if((power_stream = (power_stream_t*) calloc(1, sizeof(power_stream_t))) == NULL)
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
-	}
 	
-	// Gerar o JSON de resposta diretamente em texto neste caso é mais fácil e eficiente.
-	*resp_data = (char*) malloc(sizeof(char) * (3 + pd_qty * 35));
-	
-	if(*resp_data == NULL) {
-		free(pd_buffer);
-		return MHD_HTTP_INTERNAL_SERVER_ERROR;
-	}
+	power_stream->array_stream.next_item = power_stream_next_item;
+	power_stream->type = type;
 	
-	*resp_data[0] = '[';
-	*resp_data_size = 1;
+	power_data_cursor_init(&power_stream->cursor, start_timestamp, end_timestamp);
 	
-	for(int i = 0; i < pd_qty; i++) {
-		if(type == POWER_GET_PT)
-			*resp_data_size += sprintf(&(*resp_data)[*resp_data_size], "[%ld,%.2lf],", pd_buffer[i].timestamp, (pd_buffer[i].p[0] + pd_buffer[i].p[1]));
-		else if(type == POWER_GET_PTV)
-			*resp_data_size += sprintf(&(*resp_data)[*resp_data_size], "[%ld,%.2lf,%.2lf,%.2lf],", pd_buffer[i].timestamp, (pd_buffer[i].p[0] + pd_buffer[i].p[1]), pd_buffer[i].v[0], pd_buffer[i].v[1]);
-		else if(type == POWER_GET_V)
-			*resp_data_size += sprintf(&(*resp_data)[*resp_data_size], "[%ld,%.2lf,%.2lf],", pd_buffer[i].timestamp, pd_buffer[i].v[0], pd_buffer[i].v[1]);
-		else if(type == POWER_GET_P)
-			*resp_data_size += sprintf(&(*resp_data)[*resp_data_size], "[%ld,%.2lf,%.2lf],", pd_buffer[i].timestamp, pd_buffer[i].p[0], pd_buffer[i].p[1]);
-		else if(type == POWER_GET_I)
-			*resp_data_size += sprintf(&(*resp_data)[*resp_data_size], "[%ld,%.2lf,%.2lf],", pd_buffer[i].timestamp, pd_buffer[i].i[0], pd_buffer[i].i[1]);
-		else if(type == POWER_GET_S)
-			*resp_data_size += sprintf(&(*resp_data)[*resp_data_size], "[%ld,%.2lf,%.2lf],", pd_buffer[i].timestamp, pd_buffer[i].s[0], pd_buffer[i].s[1]);
-		else if(type == POWER_GET_Q)
-			*resp_data_size += sprintf(&(*resp_data)[*resp_data_size], "[%ld,%.2lf,%.2lf],", pd_buffer[i].timestamp, pd_buffer[i].q[0], pd_buffer[i].q[1]);
-	}
+	resp_stream->read = binary_format ? power_binary_stream_read : json_array_stream_read;
+	resp_stream->free = power_stream_free;
+	resp_stream->ctx = power_stream;
 	
-	free(pd_buffer);
-	
-	if(pd_qty) {
-		(*resp_data)[*resp_data_size - 1] = ']';
-	} else {
-		(*resp_data)[*resp_data_size] = ']';
-		(*resp_data_size)++;
-	}
-	
-	*resp_data_size *= sizeof(char);
-	
-	*resp_content_type = strdup(JSON_CONTENT_TYPE);
+	*resp_content_type = strdup(binary_format ? BINARY_CONTENT_TYPE : JSON_CONTENT_TYPE);
 	
 	return MHD_HTTP_OK;
 }
@@ -143,121 +466,31 @@ unsigned int http_handler_get_power_data(struct MHD_Connection *conn,
 unsigned int http_handler_get_load_events(struct MHD_Connection *conn,
 										int logged_user_id,
 										path_parameter_t *path_parameters,
-										char *req_data,
-										size_t req_data_size,
 										char **resp_content_type,
-										char **resp_data,
-										size_t *resp_data_size,
+										http_stream_t *resp_stream,
 										void *arg) {
 	
-	const char *last_secs_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "last");
-	const char *start_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "start");
-	const char *end_timestamp_str = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "end");
-	
-	int last_secs;
 	time_t start_timestamp, end_timestamp;
 	
-	json_object *response_array = NULL;
-	json_object *response_item = NULL;
-	json_object *appliance_array = NULL;
-	
-	load_event_t *loadev_buffer = NULL;
-	int qty;
+	load_event_stream_t *loadev_stream;
 	
 	if(logged_user_id <= 0)
 		return MHD_HTTP_UNAUTHORIZED;
 	
-	if(last_secs_str) {
-		if(sscanf(last_secs_str, "%d", &last_secs) != 1)
-			return MHD_HTTP_BAD_REQUEST;
-		
-		if(last_secs < 0 || last_secs > 12 * 3600)
-			return MHD_HTTP_BAD_REQUEST;
-		
-		end_timestamp = power_get_last_timestamp();
-		start_timestamp = end_timestamp - last_secs;
-		
-	} else if(start_timestamp_str && end_timestamp_str) {
-		if(sscanf(start_timestamp_str, "%ld", &start_timestamp) != 1 || sscanf(end_timestamp_str, "%ld", &end_timestamp) != 1)
-			return MHD_HTTP_BAD_REQUEST;
-		
-		if(end_timestamp <= 0 || start_timestamp<= 0 || end_timestamp < start_timestamp || end_timestamp - start_timestamp > 12 * 3600)
-			return MHD_HTTP_BAD_REQUEST;
-		
-	} else {
+	if(parse_time_range(conn, LOAD_EVENTS_MAX_RANGE, &start_timestamp, &end_timestamp))
 		return MHD_HTTP_BAD_REQUEST;
-	}
 	
-	loadev_buffer = (load_event_t*) malloc(sizeof(load_event_t) * (1 + end_timestamp - start_timestamp));
-	
-	if(loadev_buffer == NULL)
-		return MHD_HTTP_INTERNAL_SERVER_ERROR;
-	
-	qty = get_load_events(start_timestamp, end_timestamp, loadev_buffer, (1 + end_timestamp - start_timestamp));
-	
-	if(qty < 0) {
-		free(loadev_buffer);
+	if((loadev_stream = (load_event_stream_t*) calloc(1, sizeof(load_event_stream_t))) == NULL)
 		return MHD_HTTP_INTERNAL_SERVER_ERROR;
-	}
 	
-	response_array = json_object_new_array();
+	loadev_stream->array_stream.next_item = load_event_stream_next_item;
+	loadev_stream->next_timestamp = start_timestamp;
+	loadev_stream->end_timestamp = end_timestamp;
 	
-	for(int i = 0; i < qty; i++) {
-		response_item = json_object_new_object();
-		
-		json_object_object_add_ex(response_item, "timestamp", json_object_new_int64(loadev_buffer[i].timestamp), JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		json_object_object_add_ex(response_item, "duration", json_object_new_int(loadev_buffer[i].duration), JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		json_object_object_add_ex(response_item, "delta_pt", json_object_new_double(loadev_buffer[i].delta_pt), JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		json_object_object_add_ex(response_item, "peak_pt", json_object_new_double(loadev_buffer[i].peak_pt), JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		json_object_object_add_ex(response_item, "top_appliance_id", json_object_new_int(loadev_buffer[i].top_appliance_id), JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		json_object_object_add_ex(response_item, "prob_avg",  json_object_new_double(loadev_buffer[i].prob_avg), JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		json_object_object_add_ex(response_item, "prob_sd",  json_object_new_double(loadev_buffer[i].prob_sd), JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		
-		appliance_array = json_object_new_array();
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].delta_p[0]));
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].delta_p[1]));
-		
-		json_object_object_add_ex(response_item, "delta_p", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		
-		appliance_array = json_object_new_array();
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].delta_s[0]));
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].delta_s[1]));
-		
-		json_object_object_add_ex(response_item, "delta_s", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		
-		appliance_array = json_object_new_array();
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].delta_q[0]));
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].delta_q[1]));
-		
-		json_object_object_add_ex(response_item, "delta_q", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		
-		appliance_array = json_object_new_array();
-		json_object_array_add(appliance_array, json_object_new_int(loadev_buffer[i].appliance_ids[0]));
-		json_object_array_add(appliance_array, json_object_new_int(loadev_buffer[i].appliance_ids[1]));
-		json_object_array_add(appliance_array, json_object_new_int(loadev_buffer[i].appliance_ids[2]));
-		
-		json_object_object_add_ex(response_item, "appliance_ids", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		
-		appliance_array = json_object_new_array();
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].appliance_probs[0]));
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].appliance_probs[1]));
-		json_object_array_add(appliance_array, json_object_new_double(loadev_buffer[i].appliance_probs[2]));
-		
-		json_object_object_add_ex(response_item, "appliance_probs", appliance_array, JSON_C_OBJECT_ADD_KEY_IS_NEW);
-		
-		json_object_array_add(response_array, response_item);
-	}
-	
-	free(loadev_buffer);
-	
-	*resp_data = strdup(json_object_get_string(response_array));
-	
-	json_object_put(response_array);
-	
-	if(*resp_data == NULL)
-		return MHD_HTTP_INTERNAL_SERVER_ERROR;
+	resp_stream->read = json_array_stream_read;
+	resp_stream->free = free;
+	resp_stream->ctx = loadev_stream;
 	
-	*resp_data_size = strlen(*resp_data);
 	*resp_content_type = strdup(JSON_CONTENT_TYPE);
 	
 	return MHD_HTTP_OK;
@@ -0,0 +1,503 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logger.h"
+#include "database.h"
+#include "disaggregation.h"
+#include "load_event_store.h"
+
+#define LOAD_EVENT_STORE_BATCH_SIZE 64
+#define LOAD_EVENT_STORE_FLUSH_INTERVAL 30
+#define LOAD_EVENT_STORE_MAX_PENDING 8192
+
+/* Eventos detectados ou reclassificados ainda não gravados, preenchidos pelas threads de desagregação e
+ * reclassificação e gravados em lotes pela thread de desagregação */
+static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Colunas lidas pelas consultas, na ordem usada por read_event_row()
+#define LOAD_EVENT_COLUMNS "timestamp,time_gap,duration,delta_pt,peak_pt,delta_pa,delta_pb,delta_sa,delta_sb,delta_qa,delta_qb," \
+							"top_appliance_id,appliance_id_a,appliance_id_b,appliance_id_c,appliance_prob_a,appliance_prob_b,appliance_prob_c,prob_avg,prob_sd," \
+							"knn_appliance_id,knn_confidence,model_version"
+
+static load_event_t *pending_events = NULL;
+static int pending_event_qty = 0;
+static int pending_event_max = 0;
+
+static time_t last_flush_timestamp = 0;
+
+/* Cria a tabela de eventos de carga, se ainda não existir. O timestamp é a chave primária inteira (o rowid da
+ * tabela), então as consultas por intervalo percorrem a própria árvore da tabela sem um índice separado. */
+int load_event_store_init() {
+	int result;
+	sqlite3 *db_conn = NULL;
+	const char sql_create_table[] = "CREATE TABLE IF NOT EXISTS load_events(timestamp INTEGER PRIMARY KEY, time_gap INTEGER, duration INTEGER, delta_pt REAL, peak_pt REAL,"
+									" delta_pa REAL, delta_pb REAL, delta_sa REAL, delta_sb REAL, delta_qa REAL, delta_qb REAL, top_appliance_id INTEGER,"
+									" appliance_id_a INTEGER, appliance_id_b INTEGER, appliance_id_c INTEGER, appliance_prob_a REAL, appliance_prob_b REAL, appliance_prob_c REAL,"
+									" prob_avg REAL, prob_sd REAL, knn_appliance_id INTEGER, knn_confidence REAL, model_version INTEGER);";
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = sqlite3_exec(db_conn, sql_create_table, NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to create load events table: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	database_close(db_conn);
+	
+	return 0;
+}
+
+int load_event_store_prepare_insert(sqlite3 *db_conn, sqlite3_stmt **ppstmt) {
+	int result;
+	const char sql_insert_event[] = "INSERT OR REPLACE INTO load_events(timestamp,time_gap,duration,delta_pt,peak_pt,delta_pa,delta_pb,delta_sa,delta_sb,delta_qa,delta_qb,"
+									"top_appliance_id,appliance_id_a,appliance_id_b,appliance_id_c,appliance_prob_a,appliance_prob_b,appliance_prob_c,prob_avg,prob_sd,"
+									"knn_appliance_id,knn_confidence,model_version) VALUES(?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12,?13,?14,?15,?16,?17,?18,?19,?20,?21,?22,?23);";
+	
+	if((result = database_prepare(db_conn, sql_insert_event, ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Grava um evento usando a consulta preparada por load_event_store_prepare_insert(), substituindo o existente com o mesmo timestamp */
+int load_event_store_insert(sqlite3_stmt *ppstmt, const load_event_t *load_event) {
+	int result;
+	
+	// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
+	result = sqlite3_bind_int64(ppstmt, 1, load_event->timestamp);
+	result += sqlite3_bind_int(ppstmt, 2, load_event->time_gap);
+	result += sqlite3_bind_int(ppstmt, 3, load_event->duration);
+	result += sqlite3_bind_double(ppstmt, 4, load_event->delta_pt);
+	result += sqlite3_bind_double(ppstmt, 5, load_event->peak_pt);
+	result += sqlite3_bind_double(ppstmt, 6, load_event->delta_p[0]);
+	result += sqlite3_bind_double(ppstmt, 7, load_event->delta_p[1]);
+	result += sqlite3_bind_double(ppstmt, 8, load_event->delta_s[0]);
+	result += sqlite3_bind_double(ppstmt, 9, load_event->delta_s[1]);
+	result += sqlite3_bind_double(ppstmt, 10, load_event->delta_q[0]);
+	result += sqlite3_bind_double(ppstmt, 11, load_event->delta_q[1]);
+	result += sqlite3_bind_int(ppstmt, 12, load_event->top_appliance_id);
+	result += sqlite3_bind_int(ppstmt, 13, load_event->appliance_ids[0]);
+	result += sqlite3_bind_int(ppstmt, 14, load_event->appliance_ids[1]);
+	result += sqlite3_bind_int(ppstmt, 15, load_event->appliance_ids[2]);
+	result += sqlite3_bind_double(ppstmt, 16, load_event->appliance_probs[0]);
+	result += sqlite3_bind_double(ppstmt, 17, load_event->appliance_probs[1]);
+	result += sqlite3_bind_double(ppstmt, 18, load_event->appliance_probs[2]);
+	result += sqlite3_bind_double(ppstmt, 19, load_event->prob_avg);
+	result += sqlite3_bind_double(ppstmt, 20, load_event->prob_sd);
+	result += sqlite3_bind_int(ppstmt, 21, load_event->knn_appliance_id);
+	result += sqlite3_bind_double(ppstmt, 22, load_event->knn_confidence);
+	result += sqlite3_bind_int(ppstmt, 23, load_event->model_version);
+	
+	if(result) {
+		LOG_ERROR("Failed to bind value to prepared statement.");
+		sqlite3_reset(ppstmt);
+		
+		return -1;
+	}
+	
+	result = sqlite3_step(ppstmt);
+	
+	sqlite3_reset(ppstmt);
+	
+	return (result == SQLITE_DONE) ? 0 : -1;
+}
+
+/* Coloca um evento na fila de gravação, um evento com o mesmo timestamp de outro já gravado o substitui */
+void load_event_store_add(const load_event_t *load_event) {
+	load_event_t *new_events;
+	
+	pthread_mutex_lock(&pending_mutex);
+	
+	if(pending_event_qty == pending_event_max) {
+		// Se o banco de dados ficar indisponível os eventos mais antigos da fila são descartados
+		if(pending_event_max >= LOAD_EVENT_STORE_MAX_PENDING) {
+			LOG_WARN("Load event store queue is full, discarding oldest event.");
+			
+			memmove(&pending_events[0], &pending_events[1], sizeof(load_event_t) * (pending_event_qty - 1));
+			pending_event_qty--;
+		} else if((new_events = (load_event_t*) realloc(pending_events, sizeof(load_event_t) * MIN(MAX(LOAD_EVENT_STORE_BATCH_SIZE, pending_event_max * 2), LOAD_EVENT_STORE_MAX_PENDING))) == NULL) {
+			LOG_ERROR("Failed to allocate memory for load event store.");
+			pthread_mutex_unlock(&pending_mutex);
+			
+			return;
+		} else {
+			pending_events = new_events;
+			pending_event_max = MIN(MAX(LOAD_EVENT_STORE_BATCH_SIZE, pending_event_max * 2), LOAD_EVENT_STORE_MAX_PENDING);
+		}
+	}
+	
+	memcpy(&pending_events[pending_event_qty++], load_event, sizeof(load_event_t));
+	
+	pthread_mutex_unlock(&pending_mutex);
+}
+
+/* Grava a fila quando ela completa um lote ou quando passa o intervalo máximo desde a última gravação */
+void load_event_store_update(time_t timestamp) {
+	int flush = 0;
+	
+	pthread_mutex_lock(&pending_mutex);
+	
+	if(last_flush_timestamp == 0)
+		last_flush_timestamp = timestamp;
+	
+	if(pending_event_qty >= LOAD_EVENT_STORE_BATCH_SIZE || (pending_event_qty > 0 && timestamp - last_flush_timestamp >= LOAD_EVENT_STORE_FLUSH_INTERVAL)) {
+		last_flush_timestamp = timestamp;
+		flush = 1;
+	}
+	
+	pthread_mutex_unlock(&pending_mutex);
+	
+	if(flush)
+		load_event_store_flush();
+}
+
+static int store_events(const load_event_t *events, int event_qty) {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = sqlite3_exec(db_conn, "BEGIN TRANSACTION", NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to begin SQL transaction: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if(load_event_store_prepare_insert(db_conn, &ppstmt)) {
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	for(int i = 0; i < event_qty; i++) {
+		if(load_event_store_insert(ppstmt, &events[i])) {
+			LOG_ERROR("Failed to store load event: %s", sqlite3_errmsg(db_conn));
+			database_finalize(ppstmt);
+			sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+			database_close(db_conn);
+			
+			return -1;
+		}
+	}
+	
+	database_finalize(ppstmt);
+	
+	if((result = sqlite3_exec(db_conn, "COMMIT", NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to commit SQL transaction: %s", sqlite3_errstr(result));
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	database_close(db_conn);
+	
+	return 0;
+}
+
+/* Devolve para o início da fila os eventos de uma gravação que falhou, antes dos que chegaram durante a tentativa,
+ * para que uma reclassificação mais recente não seja sobrescrita pela versão antiga do evento */
+static void requeue_events(load_event_t *events, int event_qty) {
+	load_event_t *new_events;
+	int new_qty;
+	
+	pthread_mutex_lock(&pending_mutex);
+	
+	new_qty = MIN(event_qty + pending_event_qty, LOAD_EVENT_STORE_MAX_PENDING);
+	
+	if((new_events = (load_event_t*) malloc(sizeof(load_event_t) * new_qty)) == NULL) {
+		LOG_ERROR("Failed to allocate memory for load event store, discarding %d events.", event_qty);
+		pthread_mutex_unlock(&pending_mutex);
+		
+		return;
+	}
+	
+	// Com a fila cheia os eventos mais antigos são descartados
+	if(new_qty < event_qty + pending_event_qty) {
+		LOG_WARN("Load event store queue is full, discarding %d events.", event_qty + pending_event_qty - new_qty);
+		
+		events += event_qty + pending_event_qty - new_qty;
+		event_qty = new_qty - pending_event_qty;
+	}
+	
+	memcpy(&new_events[0], events, sizeof(load_event_t) * event_qty);
+	memcpy(&new_events[event_qty], pending_events, sizeof(load_event_t) * (new_qty - event_qty));
+	
+	free(pending_events);
+	
+	pending_events = new_events;
+	pending_event_qty = new_qty;
+	pending_event_max = new_qty;
+	
+	pthread_mutex_unlock(&pending_mutex);
+}
+
+/* Grava os eventos da fila em uma única transação. Em caso de falha os eventos voltam para a fila. */
+int load_event_store_flush() {
+	load_event_t *events;
+	int event_qty;
+	
+	pthread_mutex_lock(&pending_mutex);
+	
+	events = pending_events;
+	event_qty = pending_event_qty;
+	
+	pending_events = NULL;
+	pending_event_qty = 0;
+	pending_event_max = 0;
+	
+	pthread_mutex_unlock(&pending_mutex);
+	
+	if(event_qty == 0) {
+		free(events);
+		return 0;
+	}
+	
+	if(store_events(events, event_qty)) {
+		requeue_events(events, event_qty);
+		free(events);
+		
+		return -1;
+	}
+	
+	free(events);
+	
+	return event_qty;
+}
+
+/* Lê uma linha das consultas com as colunas na ordem de LOAD_EVENT_COLUMNS */
+static void read_event_row(sqlite3_stmt *ppstmt, load_event_t *load_event) {
+	load_event->timestamp = sqlite3_column_int64(ppstmt, 0);
+	load_event->time_gap = sqlite3_column_int(ppstmt, 1);
+	load_event->duration = sqlite3_column_int(ppstmt, 2);
+	load_event->delta_pt = sqlite3_column_double(ppstmt, 3);
+	load_event->peak_pt = sqlite3_column_double(ppstmt, 4);
+	load_event->delta_p[0] = sqlite3_column_double(ppstmt, 5);
+	load_event->delta_p[1] = sqlite3_column_double(ppstmt, 6);
+	load_event->delta_s[0] = sqlite3_column_double(ppstmt, 7);
+	load_event->delta_s[1] = sqlite3_column_double(ppstmt, 8);
+	load_event->delta_q[0] = sqlite3_column_double(ppstmt, 9);
+	load_event->delta_q[1] = sqlite3_column_double(ppstmt, 10);
+	load_event->top_appliance_id = sqlite3_column_int(ppstmt, 11);
+	
+	for(int i = 0; i < LOAD_EVENT_APPLIANCE_QTY; i++) {
+		load_event->appliance_ids[i] = sqlite3_column_int(ppstmt, 12 + i);
+		load_event->appliance_probs[i] = sqlite3_column_double(ppstmt, 15 + i);
+	}
+	
+	load_event->prob_avg = sqlite3_column_double(ppstmt, 18);
+	load_event->prob_sd = sqlite3_column_double(ppstmt, 19);
+	load_event->knn_appliance_id = sqlite3_column_int(ppstmt, 20);
+	load_event->knn_confidence = sqlite3_column_double(ppstmt, 21);
+	load_event->model_version = sqlite3_column_int(ppstmt, 22);
+}
+
+/* Lê os eventos gravados com timestamp em [timestamp_start, timestamp_end], em ordem cronológica */
+int load_event_store_get(time_t timestamp_start, time_t timestamp_end, load_event_t *buffer, int buffer_len) {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_events[] = "SELECT " LOAD_EVENT_COLUMNS " FROM load_events WHERE timestamp >= ?1 AND timestamp <= ?2 ORDER BY timestamp LIMIT ?3;";
+	int output_count = 0;
+	
+	if(buffer == NULL)
+		return -1;
+	
+	if(buffer_len == 0 || timestamp_end < timestamp_start)
+		return 0;
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_events, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	result = sqlite3_bind_int64(ppstmt, 1, timestamp_start);
+	result += sqlite3_bind_int64(ppstmt, 2, timestamp_end);
+	result += sqlite3_bind_int(ppstmt, 3, buffer_len);
+	
+	if(result) {
+		LOG_ERROR("Failed to bind value to prepared statement.");
+		database_finalize(ppstmt);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW && output_count < buffer_len) {
+		read_event_row(ppstmt, &buffer[output_count]);
+		output_count++;
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_DONE && result != SQLITE_ROW) {
+		LOG_ERROR("Failed to get load events from database: %s", sqlite3_errstr(result));
+		return -1;
+	}
+	
+	return output_count;
+}
+
+/* Lê em ordem cronológica os eventos gravados com timestamp em [timestamp_start, timestamp_end] que foram classificados
+ * com modelos anteriores a model_version, para a reclassificação dos eventos que não estão no buffer em memória */
+int load_event_store_get_outdated(time_t timestamp_start, time_t timestamp_end, int model_version, load_event_t *buffer, int buffer_len) {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_events[] = "SELECT " LOAD_EVENT_COLUMNS " FROM load_events WHERE timestamp >= ?1 AND timestamp <= ?2 AND model_version < ?3 ORDER BY timestamp LIMIT ?4;";
+	int output_count = 0;
+	
+	if(buffer == NULL)
+		return -1;
+	
+	if(buffer_len == 0 || timestamp_end < timestamp_start)
+		return 0;
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_events, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	result = sqlite3_bind_int64(ppstmt, 1, timestamp_start);
+	result += sqlite3_bind_int64(ppstmt, 2, timestamp_end);
+	result += sqlite3_bind_int(ppstmt, 3, model_version);
+	result += sqlite3_bind_int(ppstmt, 4, buffer_len);
+	
+	if(result) {
+		LOG_ERROR("Failed to bind value to prepared statement.");
+		database_finalize(ppstmt);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW && output_count < buffer_len) {
+		read_event_row(ppstmt, &buffer[output_count]);
+		output_count++;
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_DONE && result != SQLITE_ROW) {
+		LOG_ERROR("Failed to get load events from database: %s", sqlite3_errstr(result));
+		return -1;
+	}
+	
+	return output_count;
+}
+
+/* Atualiza apenas os campos de classificação dos eventos gravados, em uma única transação. Eventos removidos
+ * nesse meio tempo (por exemplo por uma nova detecção em lote) não são recriados. */
+int load_event_store_update_classification(const load_event_t *events, int event_qty) {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_update_event[] = "UPDATE load_events SET top_appliance_id = ?2, appliance_id_a = ?3, appliance_id_b = ?4, appliance_id_c = ?5, appliance_prob_a = ?6,"
+									" appliance_prob_b = ?7, appliance_prob_c = ?8, prob_avg = ?9, prob_sd = ?10, knn_appliance_id = ?11, knn_confidence = ?12, model_version = ?13"
+									" WHERE timestamp = ?1;";
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = sqlite3_exec(db_conn, "BEGIN TRANSACTION", NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to begin SQL transaction: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_update_event, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	for(int i = 0; i < event_qty; i++) {
+		// SQLITE_OK é zero, então somando todos os resultados podemos saber se algum falhou
+		result = sqlite3_bind_int64(ppstmt, 1, events[i].timestamp);
+		result += sqlite3_bind_int(ppstmt, 2, events[i].top_appliance_id);
+		
+		for(int j = 0; j < LOAD_EVENT_APPLIANCE_QTY; j++) {
+			result += sqlite3_bind_int(ppstmt, 3 + j, events[i].appliance_ids[j]);
+			result += sqlite3_bind_double(ppstmt, 6 + j, events[i].appliance_probs[j]);
+		}
+		
+		result += sqlite3_bind_double(ppstmt, 9, events[i].prob_avg);
+		result += sqlite3_bind_double(ppstmt, 10, events[i].prob_sd);
+		result += sqlite3_bind_int(ppstmt, 11, events[i].knn_appliance_id);
+		result += sqlite3_bind_double(ppstmt, 12, events[i].knn_confidence);
+		result += sqlite3_bind_int(ppstmt, 13, events[i].model_version);
+		
+		if(result || (result = sqlite3_step(ppstmt)) != SQLITE_DONE) {
+			LOG_ERROR("Failed to update load event classification: %s", sqlite3_errmsg(db_conn));
+			database_finalize(ppstmt);
+			sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+			database_close(db_conn);
+			
+			return -1;
+		}
+		
+		sqlite3_reset(ppstmt);
+	}
+	
+	database_finalize(ppstmt);
+	
+	if((result = sqlite3_exec(db_conn, "COMMIT", NULL, NULL, NULL)) != SQLITE_OK) {
+		LOG_ERROR("Failed to commit SQL transaction: %s", sqlite3_errstr(result));
+		sqlite3_exec(db_conn, "ROLLBACK", NULL, NULL, NULL);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	database_close(db_conn);
+	
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef LOAD_EVENT_STORE_H
+#define LOAD_EVENT_STORE_H
+
+#include <time.h>
+#include <sqlite3.h>
+
+#include "disaggregation.h"
+
+int load_event_store_init();
+int load_event_store_prepare_insert(sqlite3 *db_conn, sqlite3_stmt **ppstmt);
+int load_event_store_insert(sqlite3_stmt *ppstmt, const load_event_t *load_event);
+void load_event_store_add(const load_event_t *load_event);
+void load_event_store_update(time_t timestamp);
+int load_event_store_flush();
+int load_event_store_get(time_t timestamp_start, time_t timestamp_end, load_event_t *buffer, int buffer_len);
+int load_event_store_get_outdated(time_t timestamp_start, time_t timestamp_end, int model_version, load_event_t *buffer, int buffer_len);
+int load_event_store_update_classification(const load_event_t *events, int event_qty);
+
+#endif
@@ -13,9 +13,21 @@
 #include "database.h"
 #include "http.h"
 #include "power.h"
+#include "energy.h"
+#include "archive.h"
+#include "disaggregation.h"
+#include "classifier.h"
+#include "signature_matrix.h"
+#include "appliance_tracker.h"
+#include "load_event_store.h"
+#include "replay.h"
 
 void *data_acquisition_loop(void *argp);
+void *replay_loop(void *argp);
 void *disaggregation_loop(void *argp);
+void *reclassification_loop(void *argp);
+void *dashboard_publisher_loop(void *argp);
+void *classifier_training_loop(void *argp);
 
 int main(int argc, char **argv) {
 	sigset_t signal_set;
@@ -24,31 +36,70 @@ int main(int argc, char **argv) {
 	
 	int opt;
 	int http_port = DEFAULT_HTTP_PORT;
+	int http_thread_qty = DEFAULT_HTTP_THREAD_QTY;
 	char *log_level_name = NULL;
 	char *working_dir_path = NULL;
+	char *rebuild_range = NULL;
+	char *disaggregation_range = NULL;
+	char *replay_range = NULL;
+	char *replay_source_dir = NULL;
+	double replay_speed = 1.0;
+	int thread_qty = 0;
+	int result;
 	
 	pthread_t data_acquisition_thread;
 	pthread_t disaggregation_thread;
+	pthread_t reclassification_thread;
+	pthread_t dashboard_publisher_thread;
+	pthread_t classifier_training_thread;
 	
 	struct MHD_Daemon *httpd;
 	
-	while((opt = getopt(argc, argv, "l:p:w:")) != -1) {
+	while((opt = getopt(argc, argv, "d:j:l:p:r:s:t:w:x:R:")) != -1) {
 		switch (opt) {
+			case 'd':
+				disaggregation_range = strdup(optarg);
+				break;
+			case 'j':
+				thread_qty = atoi(optarg);
+				break;
 			case 'l':
 				log_level_name = strdup(optarg);
 				break;
 			case 'p':
 				http_port = atoi(optarg);
 				break;
+			case 'r':
+				rebuild_range = strdup(optarg);
+				break;
+			case 's':
+				replay_source_dir = strdup(optarg);
+				break;
+			case 't':
+				http_thread_qty = atoi(optarg);
+				break;
 			case 'w':
 				working_dir_path = strdup(optarg);
 				break;
+			case 'x':
+				replay_speed = atof(optarg);
+				break;
+			case 'R':
+				replay_range = strdup(optarg);
+				break;
 			default:
 				fprintf(stderr, "Usage: %s [options] -k key\n", argv[0]);
 				fprintf(stderr, "Valid options:\n");
+				fprintf(stderr, "\t-d Detect load events from power data files, store them and exit (YYYY-MM-DD[:YYYY-MM-DD])\n");
+				fprintf(stderr, "\t-j Worker thread quantity for archive processing\n");
 				fprintf(stderr, "\t-l Logging level\n");
 				fprintf(stderr, "\t-p HTTP port number\n");
+				fprintf(stderr, "\t-r Rebuild energy tables from power data files and exit, with the backend stopped (YYYY-MM-DD[:YYYY-MM-DD])\n");
+				fprintf(stderr, "\t-s Power data files directory for replay\n");
+				fprintf(stderr, "\t-t HTTP worker thread quantity, 0 for one thread per connection (default %d)\n", DEFAULT_HTTP_THREAD_QTY);
 				fprintf(stderr, "\t-w Working directory path\n");
+				fprintf(stderr, "\t-x Replay speed multiple, 0 for maximum speed (default 1)\n");
+				fprintf(stderr, "\t-R Replay power data files instead of acquiring from the device (YYYY-MM-DD[:YYYY-MM-DD])\n");
 				exit(EXIT_FAILURE);
 		}
 	}
@@ -68,6 +119,11 @@ int main(int argc, char **argv) {
 		exit(EXIT_FAILURE);
 	}
 	
+	if(http_thread_qty < 0) {
+		LOG_FATAL("Invalid HTTP worker thread quantity.");
+		exit(EXIT_FAILURE);
+	}
+	
 	if(working_dir_path != NULL) {
 		if(chdir(working_dir_path) < 0) {
 			LOG_FATAL("Failed changing working directory to: %s", working_dir_path);
@@ -82,6 +138,71 @@ int main(int argc, char **argv) {
 		exit(EXIT_FAILURE);
 	}
 	
+	if(rebuild_range != NULL) {
+		time_t rebuild_start, rebuild_end;
+		
+		if(archive_parse_date_range(rebuild_range, &rebuild_start, &rebuild_end)) {
+			LOG_FATAL("Invalid date range: %s", rebuild_range);
+			exit(EXIT_FAILURE);
+		}
+		
+		free(rebuild_range);
+		
+		/* As gravações do backend ficariam bloqueadas durante toda a reconstrução, e o cache de minutos e o
+		 * calendário em memória ficariam desatualizados */
+		if((result = database_lock_exclusive()) != 0) {
+			LOG_FATAL("%s", (result > 0) ? "Energy data cannot be rebuilt while the backend is running." : "Failed to lock the database.");
+			exit(EXIT_FAILURE);
+		}
+		
+		if(energy_rebuild(rebuild_start, rebuild_end, (thread_qty > 0) ? thread_qty : archive_default_thread_qty()))
+			exit(EXIT_FAILURE);
+		
+		return 0;
+	}
+	
+	if(disaggregation_range != NULL) {
+		time_t disaggregation_start, disaggregation_end;
+		
+		if(archive_parse_date_range(disaggregation_range, &disaggregation_start, &disaggregation_end)) {
+			LOG_FATAL("Invalid date range: %s", disaggregation_range);
+			exit(EXIT_FAILURE);
+		}
+		
+		free(disaggregation_range);
+		
+		if(disaggregation_batch(disaggregation_start, disaggregation_end, (thread_qty > 0) ? thread_qty : archive_default_thread_qty()))
+			exit(EXIT_FAILURE);
+		
+		return 0;
+	}
+	
+	if((result = database_lock_exclusive()) != 0) {
+		LOG_FATAL("%s", (result > 0) ? "The database is in use by another backend or an energy rebuild." : "Failed to lock the database.");
+		exit(EXIT_FAILURE);
+	}
+	
+	if(replay_range != NULL) {
+		time_t replay_start, replay_end;
+		
+		if(archive_parse_date_range(replay_range, &replay_start, &replay_end)) {
+			LOG_FATAL("Invalid date range: %s", replay_range);
+			exit(EXIT_FAILURE);
+		}
+		
+		if(replay_source_dir == NULL || (replay_speed != 0.0 && replay_speed < 1.0)) {
+			LOG_FATAL("Replay requires a source directory (-s) and a speed of 0 or at least 1.");
+			exit(EXIT_FAILURE);
+		}
+		
+		/* O relógio virtual é usado pelos módulos inicializados a seguir */
+		if(replay_init(replay_source_dir, replay_start, replay_end, replay_speed))
+			exit(EXIT_FAILURE);
+		
+		free(replay_range);
+		free(replay_source_dir);
+	}
+	
 	sigemptyset(&signal_set);
 	sigaddset(&signal_set, SIGINT);
 	sigaddset(&signal_set, SIGTERM);
@@ -91,16 +212,52 @@ int main(int argc, char **argv) {
 	 * criadas a partir de agora vão herdar esse bloqueio. */
 	pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
 	
-	load_saved_power_data();
+	// Na reprodução o buffer é preenchido a partir do início do intervalo
+	if(!replay_is_active())
+		load_saved_power_data();
+	
+	/* Em caso de falha as consultas continuam sendo feitas no banco de dados */
+	if(energy_minute_cache_init() < 0)
+		LOG_WARN("Failed to initialize energy minute cache.");
+	
+	if(energy_calendar_init() < 0)
+		LOG_WARN("Failed to initialize energy calendar.");
+	
+	if(appliance_tracker_init() < 0)
+		LOG_WARN("Failed to initialize appliance tracker, appliance energy will not be stored.");
+	
+	if(load_event_store_init() < 0)
+		LOG_WARN("Failed to initialize load event store, load events will only be kept in memory.");
 	
-	LOG_INFO("Starting data acquisition thread.");
-	pthread_create(&data_acquisition_thread, NULL, data_acquisition_loop, (void*) &terminate);
+	if(signature_matrix_load() < 0)
+		LOG_WARN("Failed to load signature matrix, k-NN classification will not be available.");
+	
+	/* Os modelos salvos são usados até o treinamento em segundo plano terminar */
+	if(classifier_init() < 0)
+		LOG_ERROR("Failed to initialize appliance classifier, load events will not be classified.");
+	
+	LOG_INFO("Starting classifier training thread.");
+	pthread_create(&classifier_training_thread, NULL, classifier_training_loop, (void*) &terminate);
+	
+	if(replay_is_active()) {
+		LOG_INFO("Starting replay thread.");
+		pthread_create(&data_acquisition_thread, NULL, replay_loop, (void*) &terminate);
+	} else {
+		LOG_INFO("Starting data acquisition thread.");
+		pthread_create(&data_acquisition_thread, NULL, data_acquisition_loop, (void*) &terminate);
+	}
 	
 	LOG_INFO("Starting disaggregation thread.");
 	pthread_create(&disaggregation_thread, NULL, disaggregation_loop, (void*) &terminate);
 	
+	LOG_INFO("Starting load event reclassification thread.");
+	pthread_create(&reclassification_thread, NULL, reclassification_loop, (void*) &terminate);
+	
+	LOG_INFO("Starting dashboard publisher thread.");
+	pthread_create(&dashboard_publisher_thread, NULL, dashboard_publisher_loop, (void*) &terminate);
+	
 	LOG_INFO("Starting HTTP server.");
-	httpd = http_init(http_port);
+	httpd = http_init(http_port, http_thread_qty);
 	
 	/* Suspende a execução da thread principal até receber algum sinal do conjunto */
 	sigwait(&signal_set, &recv_signal);
@@ -111,6 +268,9 @@ int main(int argc, char **argv) {
 	
 	pthread_join(data_acquisition_thread, NULL);
 	pthread_join(disaggregation_thread, NULL);
+	pthread_join(reclassification_thread, NULL);
+	pthread_join(dashboard_publisher_thread, NULL);
+	pthread_join(classifier_training_thread, NULL);
 	
 	close_power_data_file();
 	
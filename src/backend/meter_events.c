@@ -16,18 +16,16 @@ int store_meter_event_db(time_t timestamp, const char *type) {
 	if(type == NULL)
 		return -1;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_store_event, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_store_event, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare the SQL statement for meter event storage: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -37,16 +35,16 @@ int store_meter_event_db(time_t timestamp, const char *type) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind value to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to store meter event in database: %s", sqlite3_errstr(result));
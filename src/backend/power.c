@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
@@ -12,7 +13,12 @@
 
 #define POWER_DATA_BUFFER_SIZE (24 * 3600)
 
+/* Os dados mais antigos do buffer são lidos dos arquivos com essa folga, pois o buffer continua
+ * sendo sobrescrito durante a leitura */
+#define POWER_CURSOR_BUFFER_MARGIN 300
+
 static pthread_mutex_t power_data_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t power_data_cond = PTHREAD_COND_INITIALIZER;
 
 static time_t last_loaded_timestamp = 0;
 
@@ -23,13 +29,108 @@ static int power_data_buffer_count = 0;
 static FILE *open_pd_fd = NULL;
 static char open_pd_filename[32];
 
-static size_t generate_pd_filename(time_t time_epoch, char *buffer, size_t len) {
+size_t generate_pd_filename(time_t time_epoch, char *buffer, size_t len) {
 	struct tm time_tm;
 	
 	gmtime_r(&time_epoch, &time_tm);
 	return strftime(buffer, len, "pd-%F.csv", &time_tm);
 }
 
+void power_calc_derived_values(power_data_t *pd_ptr) {
+	pd_ptr->s[0] = pd_ptr->v[0] * pd_ptr->i[0];
+	pd_ptr->s[1] = pd_ptr->v[1] * pd_ptr->i[1];
+	
+	pd_ptr->q[0] = sqrtf(powf(pd_ptr->s[0], 2) - powf(pd_ptr->p[0], 2));
+	pd_ptr->q[1] = sqrtf(powf(pd_ptr->s[1], 2) - powf(pd_ptr->p[1], 2));
+}
+
+/* Interpreta uma linha no formato dos arquivos pd-*.csv (timestamp,v1,v2,i1,i2,p1,p2). Linhas com campos
+ * extras (como as geradas pelo tcc-data-export, que também inclui S e Q) são aceitas, os extras são ignorados. */
+int parse_power_data_line(const char *line, power_data_t *pd_ptr) {
+	char *endptr;
+	double *fields[6] = {&pd_ptr->v[0], &pd_ptr->v[1], &pd_ptr->i[0], &pd_ptr->i[1], &pd_ptr->p[0], &pd_ptr->p[1]};
+	
+	pd_ptr->timestamp = strtol(line, &endptr, 10);
+	
+	if(endptr == line || *endptr != ',')
+		return -1;
+	
+	for(int i = 0; i < 6; i++) {
+		line = endptr + 1;
+		*fields[i] = strtod(line, &endptr);
+		
+		if(endptr == line || (*endptr != ',' && *endptr != '\n' && *endptr != '\r' && *endptr != '\0'))
+			return -1;
+		
+		if(i < 5 && *endptr != ',')
+			return -1;
+	}
+	
+	power_calc_derived_values(pd_ptr);
+	
+	return 0;
+}
+
+/* Lê todas as entradas de um arquivo de dados de potência com timestamp no intervalo [timestamp_start, timestamp_end),
+ * um timestamp_end igual a zero indica que não há limite superior. Entradas fora de ordem são descartadas.
+ * O buffer retornado deve ser liberado pelo chamador. */
+int read_power_data_file(const char *filename, time_t timestamp_start, time_t timestamp_end, power_data_t **buffer_ptr) {
+	FILE *pd_file = NULL;
+	char line[256];
+	power_data_t *buffer = NULL;
+	power_data_t pd_aux;
+	int size = 3600, count = 0;
+	time_t last_timestamp = 0;
+	
+	if(filename == NULL || buffer_ptr == NULL)
+		return -1;
+	
+	if((pd_file = fopen(filename, "r")) == NULL) {
+		LOG_ERROR("Failed to open power data file \"%s\": %s", filename, strerror(errno));
+		return -1;
+	}
+	
+	if((buffer = (power_data_t*) malloc(sizeof(power_data_t) * size)) == NULL) {
+		fclose(pd_file);
+		return -2;
+	}
+	
+	while(fgets(line, sizeof(line), pd_file)) {
+		if(parse_power_data_line(line, &pd_aux))
+			continue;
+		
+		if(pd_aux.timestamp < timestamp_start || (timestamp_end > 0 && pd_aux.timestamp >= timestamp_end))
+			continue;
+		
+		if(pd_aux.timestamp <= last_timestamp)
+			continue;
+		
+		if(count >= size) {
+			power_data_t *tmp_ptr;
+			
+			size *= 2;
+			
+			if((tmp_ptr = (power_data_t*) realloc(buffer, sizeof(power_data_t) * size)) == NULL) {
+				free(buffer);
+				fclose(pd_file);
+				return -2;
+			}
+			
+			buffer = tmp_ptr;
+		}
+		
+		memcpy(&buffer[count], &pd_aux, sizeof(power_data_t));
+		last_timestamp = pd_aux.timestamp;
+		count++;
+	}
+	
+	fclose(pd_file);
+	
+	*buffer_ptr = buffer;
+	
+	return count;
+}
+
 static int import_power_data_file(const char *filename, time_t timestamp_limit) {
 	FILE *pd_file = NULL;
 	power_data_t pd_aux;
@@ -55,11 +156,7 @@ static int import_power_data_file(const char *filename, time_t timestamp_limit)
 		
 		last_loaded_timestamp = pd_aux.timestamp;
 		
-		pd_aux.s[0] = pd_aux.v[0] * pd_aux.i[0];
-		pd_aux.s[1] = pd_aux.v[1] * pd_aux.i[1];
-		
-		pd_aux.q[0] = sqrtf(powf(pd_aux.s[0], 2) - powf(pd_aux.p[0], 2));
-		pd_aux.q[1] = sqrtf(powf(pd_aux.s[1], 2) - powf(pd_aux.p[1], 2));
+		power_calc_derived_values(&pd_aux);
 		
 		memcpy(&power_data_buffer[power_data_buffer_pos], &pd_aux, sizeof(power_data_t));
 		
@@ -132,11 +229,7 @@ int store_power_data(power_data_t *pd_ptr) {
 	if(pd_ptr == NULL)
 		return -1;
 	
-	pd_ptr->s[0] = pd_ptr->v[0] * pd_ptr->i[0];
-	pd_ptr->s[1] = pd_ptr->v[1] * pd_ptr->i[1];
-	
-	pd_ptr->q[0] = sqrtf(powf(pd_ptr->s[0], 2) - powf(pd_ptr->p[0], 2));
-	pd_ptr->q[1] = sqrtf(powf(pd_ptr->s[1], 2) - powf(pd_ptr->p[1], 2));
+	power_calc_derived_values(pd_ptr);
 	
 	if(pthread_mutex_lock(&power_data_mutex))
 		return -2;
@@ -194,6 +287,8 @@ int store_power_data(power_data_t *pd_ptr) {
 	
 	last_loaded_timestamp = pd_ptr->timestamp;
 	
+	pthread_cond_broadcast(&power_data_cond);
+	
 	pthread_mutex_unlock(&power_data_mutex);
 	
 	return 0;
@@ -233,6 +328,112 @@ int get_power_data(time_t timestamp_start, time_t timestamp_end, power_data_t *b
 	return output_count;
 }
 
+void power_data_cursor_init(power_data_cursor_t *cursor, time_t timestamp_start, time_t timestamp_end) {
+	cursor->next_timestamp = timestamp_start;
+	cursor->timestamp_end = timestamp_end;
+	cursor->pd_file = NULL;
+	cursor->pd_file_day_end = 0;
+}
+
+void power_data_cursor_close(power_data_cursor_t *cursor) {
+	if(cursor->pd_file)
+		fclose(cursor->pd_file);
+	
+	cursor->pd_file = NULL;
+}
+
+/* Lê do arquivo diário até encher o buffer, chegar ao fim do dia ou alcançar file_limit (exclusivo) */
+static int cursor_read_file(power_data_cursor_t *cursor, power_data_t *buffer, int buffer_len, time_t file_limit) {
+	char filename[32];
+	char line[256];
+	power_data_t pd_aux;
+	int count = 0;
+	
+	if(cursor->pd_file == NULL) {
+		// Os arquivos são divididos por dia em UTC
+		cursor->pd_file_day_end = cursor->next_timestamp - (cursor->next_timestamp % (24 * 3600)) + 24 * 3600;
+		
+		generate_pd_filename(cursor->next_timestamp, filename, sizeof(filename));
+		
+		if((cursor->pd_file = fopen(filename, "r")) == NULL) {
+			cursor->next_timestamp = cursor->pd_file_day_end;
+			return 0;
+		}
+	}
+	
+	while(count < buffer_len) {
+		if(fgets(line, sizeof(line), cursor->pd_file) == NULL) {
+			power_data_cursor_close(cursor);
+			cursor->next_timestamp = MAX(cursor->next_timestamp, cursor->pd_file_day_end);
+			
+			break;
+		}
+		
+		if(parse_power_data_line(line, &pd_aux) || pd_aux.timestamp < cursor->next_timestamp)
+			continue;
+		
+		if(pd_aux.timestamp >= file_limit) {
+			power_data_cursor_close(cursor);
+			cursor->next_timestamp = pd_aux.timestamp;
+			
+			break;
+		}
+		
+		memcpy(&buffer[count], &pd_aux, sizeof(power_data_t));
+		cursor->next_timestamp = pd_aux.timestamp + 1;
+		count++;
+	}
+	
+	return count;
+}
+
+/*
+ * Lê as próximas entradas do intervalo do cursor. Retorna a quantidade lida, zero quando o intervalo terminou
+ * ou um valor negativo em caso de erro. Entradas que ainda não chegaram não são esperadas.
+ */
+int power_data_cursor_read(power_data_cursor_t *cursor, power_data_t *buffer, int buffer_len) {
+	time_t buffer_oldest_timestamp;
+	int count = 0, result;
+	
+	while(count < buffer_len && cursor->next_timestamp <= cursor->timestamp_end) {
+		if(pthread_mutex_lock(&power_data_mutex))
+			return -2;
+		
+		buffer_oldest_timestamp = 0;
+		
+		if(power_data_buffer_count > 0)
+			buffer_oldest_timestamp = power_data_buffer[(power_data_buffer_count < POWER_DATA_BUFFER_SIZE) ? 0 : power_data_buffer_pos].timestamp;
+		
+		pthread_mutex_unlock(&power_data_mutex);
+		
+		if(buffer_oldest_timestamp == 0 || cursor->next_timestamp < buffer_oldest_timestamp + POWER_CURSOR_BUFFER_MARGIN) {
+			time_t file_limit = cursor->timestamp_end + 1;
+			
+			if(buffer_oldest_timestamp != 0)
+				file_limit = MIN(file_limit, buffer_oldest_timestamp + POWER_CURSOR_BUFFER_MARGIN);
+			
+			count += cursor_read_file(cursor, &buffer[count], buffer_len - count, file_limit);
+			
+			continue;
+		}
+		
+		power_data_cursor_close(cursor);
+		
+		if((result = get_power_data(cursor->next_timestamp, cursor->timestamp_end, &buffer[count], buffer_len - count)) < 0)
+			return result;
+		
+		// Menos entradas que o pedido indica que o buffer em memória não tem mais dados no intervalo
+		if(result < buffer_len - count)
+			cursor->next_timestamp = cursor->timestamp_end + 1;
+		else
+			cursor->next_timestamp = buffer[count + result - 1].timestamp + 1;
+		
+		count += result;
+	}
+	
+	return count;
+}
+
 time_t power_get_last_timestamp() {
 	time_t timestamp;
 	
@@ -245,3 +446,34 @@ time_t power_get_last_timestamp() {
 	
 	return timestamp;
 }
+
+/* Aguarda até que exista um dado mais recente que last_timestamp ou até o fim do timeout.
+ * Retorna o timestamp do dado mais recente, que é igual a last_timestamp em caso de timeout. */
+time_t power_wait_new_data(time_t last_timestamp, int timeout_ms) {
+	struct timespec abstime;
+	time_t timestamp;
+	
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	
+	abstime.tv_sec += timeout_ms / 1000;
+	abstime.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	
+	if(abstime.tv_nsec >= 1000000000L) {
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000L;
+	}
+	
+	if(pthread_mutex_lock(&power_data_mutex))
+		return -1;
+	
+	while(last_loaded_timestamp <= last_timestamp) {
+		if(pthread_cond_timedwait(&power_data_cond, &power_data_mutex, &abstime))
+			break;
+	}
+	
+	timestamp = last_loaded_timestamp;
+	
+	pthread_mutex_unlock(&power_data_mutex);
+	
+	return timestamp;
+}
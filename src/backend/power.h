@@ -1,6 +1,8 @@
 #ifndef POWER_DATA_H
 #define POWER_DATA_H
 
+#include <stdio.h>
+#include <stddef.h>
 #include <time.h>
 
 typedef struct power_data_s {
@@ -12,10 +14,27 @@ typedef struct power_data_s {
 	double q[2];
 } power_data_t;
 
+/* Leitura incremental de um intervalo de dados com memória constante, dos arquivos diários para o que não está mais no buffer em memória */
+typedef struct power_data_cursor_s {
+	time_t next_timestamp;
+	time_t timestamp_end;
+	
+	FILE *pd_file;
+	time_t pd_file_day_end;
+} power_data_cursor_t;
+
+size_t generate_pd_filename(time_t time_epoch, char *buffer, size_t len);
+void power_calc_derived_values(power_data_t *pd_ptr);
+int parse_power_data_line(const char *line, power_data_t *pd_ptr);
+int read_power_data_file(const char *filename, time_t timestamp_start, time_t timestamp_end, power_data_t **buffer_ptr);
 int load_saved_power_data();
 void close_power_data_file();
 int store_power_data(power_data_t *pd_ptr);
 int get_power_data(time_t timestamp_start, time_t timestamp_end, power_data_t *buffer, int buffer_len);
 time_t power_get_last_timestamp();
+void power_data_cursor_init(power_data_cursor_t *cursor, time_t timestamp_start, time_t timestamp_end);
+int power_data_cursor_read(power_data_cursor_t *cursor, power_data_t *buffer, int buffer_len);
+void power_data_cursor_close(power_data_cursor_t *cursor);
+time_t power_wait_new_data(time_t last_timestamp, int timeout_ms);
 
 #endif
@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logger.h"
+#include "power.h"
+#include "energy.h"
+#include "replay.h"
+
+// Intervalo máximo de cada espera, para que o pedido de término seja atendido mesmo em falhas longas dos dados
+#define REPLAY_MAX_SLEEP_MS 500
+
+static pthread_mutex_t replay_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int replay_active = 0;
+static time_t replay_clock = 0;
+
+static char replay_source_dir[PATH_MAX];
+static time_t replay_timestamp_start = 0;
+static time_t replay_timestamp_end = 0;
+static double replay_speed = 1.0;
+
+/*
+ * Configura a reprodução dos arquivos pd-*.csv de source_dir no intervalo [timestamp_start, timestamp_end), que
+ * substitui a aquisição de dados. Com speed igual a zero as amostras são reproduzidas o mais rápido possível.
+ * Como as amostras são gravadas nos arquivos do diretório de trabalho, a origem deve ser outro diretório.
+ * Deve ser chamada depois de mudar para o diretório de trabalho e antes de iniciar as threads.
+ */
+int replay_init(const char *source_dir, time_t timestamp_start, time_t timestamp_end, double speed) {
+	char working_dir_path[PATH_MAX];
+	
+	if(source_dir == NULL || timestamp_end <= timestamp_start || speed < 0.0)
+		return -1;
+	
+	if(realpath(source_dir, replay_source_dir) == NULL || getcwd(working_dir_path, sizeof(working_dir_path)) == NULL) {
+		LOG_ERROR("Invalid replay source directory: %s", source_dir);
+		return -1;
+	}
+	
+	if(strcmp(replay_source_dir, working_dir_path) == 0) {
+		LOG_ERROR("Replay source directory must not be the working directory.");
+		return -1;
+	}
+	
+	pthread_mutex_lock(&replay_mutex);
+	
+	replay_timestamp_start = timestamp_start;
+	replay_timestamp_end = timestamp_end;
+	replay_speed = speed;
+	replay_clock = timestamp_start;
+	replay_active = 1;
+	
+	pthread_mutex_unlock(&replay_mutex);
+	
+	return 0;
+}
+
+int replay_is_active() {
+	int active;
+	
+	pthread_mutex_lock(&replay_mutex);
+	active = replay_active;
+	pthread_mutex_unlock(&replay_mutex);
+	
+	return active;
+}
+
+/* Relógio virtual: durante a reprodução é o timestamp da última amostra reproduzida, senão o relógio do sistema */
+time_t replay_now() {
+	time_t now;
+	
+	pthread_mutex_lock(&replay_mutex);
+	now = (replay_active) ? replay_clock : time(NULL);
+	pthread_mutex_unlock(&replay_mutex);
+	
+	return now;
+}
+
+static double elapsed_seconds(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Aguarda até o instante real correspondente a timestamp, retorna diferente de zero se o término foi pedido */
+static int replay_wait(time_t timestamp, time_t first_timestamp, const struct timespec *real_start, volatile int *terminate) {
+	struct timespec now_ts;
+	double target, remaining;
+	
+	target = (timestamp - first_timestamp) / replay_speed;
+	
+	while(!(*terminate)) {
+		clock_gettime(CLOCK_MONOTONIC, &now_ts);
+		
+		if((remaining = target - elapsed_seconds(real_start, &now_ts)) <= 0.0)
+			return 0;
+		
+		usleep((useconds_t) (MIN(remaining * 1000.0, REPLAY_MAX_SLEEP_MS) * 1000.0));
+	}
+	
+	return 1;
+}
+
+/* Substitui data_acquisition_loop() no modo de reprodução, usando o mesmo caminho de armazenamento das amostras */
+void *replay_loop(void *argp) {
+	int *terminate = (int*) argp;
+	char filename[32];
+	char path[PATH_MAX + sizeof(filename) + 1];
+	power_data_t *data;
+	int count;
+	int result;
+	time_t first_timestamp = 0;
+	struct timespec real_start, day_start_ts, now_ts;
+	long total_qty = 0;
+	
+	LOG_INFO("Replaying power data from \"%s\" at %s.", replay_source_dir, (replay_speed > 0.0) ? "fixed speed" : "maximum speed");
+	
+	clock_gettime(CLOCK_MONOTONIC, &real_start);
+	
+	/* Os arquivos são divididos por dia em UTC */
+	for(time_t day = replay_timestamp_start - (replay_timestamp_start % (24 * 3600)); day < replay_timestamp_end && !(*terminate); day += 24 * 3600) {
+		int day_qty = 0;
+		
+		generate_pd_filename(day, filename, sizeof(filename));
+		snprintf(path, sizeof(path), "%s/%s", replay_source_dir, filename);
+		
+		if(access(path, F_OK) != 0) {
+			LOG_DEBUG("Power data file \"%s\" does not exist, skipping.", path);
+			continue;
+		}
+		
+		if((count = read_power_data_file(path, MAX(replay_timestamp_start, day), MIN(replay_timestamp_end, day + 24 * 3600), &data)) < 0) {
+			LOG_ERROR("Failed to read power data file \"%s\".", path);
+			continue;
+		}
+		
+		clock_gettime(CLOCK_MONOTONIC, &day_start_ts);
+		
+		for(int i = 0; i < count && !(*terminate); i++) {
+			if(first_timestamp == 0) {
+				first_timestamp = data[i].timestamp;
+				clock_gettime(CLOCK_MONOTONIC, &real_start);
+			}
+			
+			if(replay_speed > 0.0 && replay_wait(data[i].timestamp, first_timestamp, &real_start, terminate))
+				break;
+			
+			if((result = store_power_data(&data[i])) < 0) {
+				*terminate = 1;
+				kill(getpid(), SIGTERM);
+				break;
+			}
+			
+			if(result == 0) {
+				energy_add_power(&data[i]);
+				day_qty++;
+			}
+			
+			pthread_mutex_lock(&replay_mutex);
+			replay_clock = data[i].timestamp;
+			pthread_mutex_unlock(&replay_mutex);
+		}
+		
+		free(data);
+		
+		clock_gettime(CLOCK_MONOTONIC, &now_ts);
+		
+		total_qty += day_qty;
+		
+		LOG_INFO("Replayed %d samples from \"%s\" in %.1lf s (%.0lf samples/s).", day_qty, filename, elapsed_seconds(&day_start_ts, &now_ts),
+					day_qty / MAX(elapsed_seconds(&day_start_ts, &now_ts), 1e-6));
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &now_ts);
+	
+	// O relógio virtual fica parado na última amostra, mantendo o servidor HTTP consistente com os dados
+	LOG_INFO("Replay finished: %ld samples in %.1lf s (%.0lf samples/s).", total_qty, elapsed_seconds(&real_start, &now_ts),
+				total_qty / MAX(elapsed_seconds(&real_start, &now_ts), 1e-6));
+	
+	return NULL;
+}
@@ -0,0 +1,10 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <time.h>
+
+int replay_init(const char *source_dir, time_t timestamp_start, time_t timestamp_end, double speed);
+int replay_is_active();
+time_t replay_now();
+
+#endif
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "logger.h"
+#include "database.h"
+#include "disaggregation.h"
+#include "signature_matrix.h"
+
+/* Bloco de parâmetros processado por instrução, as extensões de vetor do GCC geram SSE ou NEON conforme a arquitetura */
+typedef float feature_block_t __attribute__((vector_size(16)));
+
+#define SIGNATURE_MATRIX_BLOCK_SIZE ((int) (sizeof(feature_block_t) / sizeof(float)))
+#define SIGNATURE_MATRIX_MIN_CAPACITY 64
+
+typedef struct signature_row_s {
+	time_t timestamp;
+	int appliance_id;
+	double features[SIGNATURE_FEATURE_QTY];
+} signature_row_t;
+
+/* As assinaturas ficam em linhas com os valores originais, usados para recalcular a normalização, e em colunas
+ * normalizadas (média zero e desvio padrão um) contíguas e alinhadas, que permitem calcular a distância de uma
+ * consulta para vários vizinhos de uma só vez. A capacidade é sempre múltipla do tamanho do bloco. */
+static pthread_rwlock_t matrix_lock = PTHREAD_RWLOCK_INITIALIZER;
+static signature_row_t *matrix_rows = NULL;
+static float *matrix_columns = NULL;
+static int matrix_qty = 0;
+static int matrix_capacity = 0;
+static int matrix_loaded = 0;
+
+static double feature_mean[SIGNATURE_FEATURE_QTY];
+static double feature_scale[SIGNATURE_FEATURE_QTY];
+
+static int *inactive_appliance_ids = NULL;
+static int inactive_appliance_qty = 0;
+
+static void extract_features(const load_event_t *signature, double *features) {
+	features[0] = signature->delta_pt;
+	features[1] = signature->peak_pt;
+	features[2] = signature->delta_p[0];
+	features[3] = signature->delta_p[1];
+	features[4] = signature->delta_q[0];
+	features[5] = signature->delta_q[1];
+	features[6] = signature->delta_s[0];
+	features[7] = signature->delta_s[1];
+	features[8] = signature->duration;
+}
+
+/* Recalcula a média e o desvio padrão de cada parâmetro e reescreve as colunas, deve ser chamada com matrix_lock
+ * travado para escrita. Linear na quantidade de assinaturas, que é pequena. */
+static void matrix_normalize() {
+	for(int f = 0; f < SIGNATURE_FEATURE_QTY; f++) {
+		double sum = 0.0, sum_sq = 0.0;
+		double variance;
+		float *column = &matrix_columns[f * matrix_capacity];
+		
+		for(int i = 0; i < matrix_qty; i++)
+			sum += matrix_rows[i].features[f];
+		
+		feature_mean[f] = (matrix_qty) ? (sum / matrix_qty) : 0.0;
+		
+		for(int i = 0; i < matrix_qty; i++)
+			sum_sq += pow(matrix_rows[i].features[f] - feature_mean[f], 2);
+		
+		variance = (matrix_qty) ? (sum_sq / matrix_qty) : 0.0;
+		
+		// Parâmetros constantes não ajudam a distinguir aparelhos e são ignorados
+		feature_scale[f] = (variance > DBL_EPSILON) ? (1.0 / sqrt(variance)) : 0.0;
+		
+		for(int i = 0; i < matrix_qty; i++)
+			column[i] = (matrix_rows[i].features[f] - feature_mean[f]) * feature_scale[f];
+		
+		for(int i = matrix_qty; i < matrix_capacity; i++)
+			column[i] = 0.0f;
+	}
+}
+
+/* Deve ser chamada com matrix_lock travado para escrita */
+static int matrix_reserve(int qty) {
+	signature_row_t *new_rows;
+	float *new_columns;
+	int new_capacity;
+	
+	if(qty <= matrix_capacity)
+		return 0;
+	
+	new_capacity = MAX(SIGNATURE_MATRIX_MIN_CAPACITY, matrix_capacity * 2);
+	
+	while(new_capacity < qty)
+		new_capacity *= 2;
+	
+	if((new_rows = (signature_row_t*) realloc(matrix_rows, sizeof(signature_row_t) * new_capacity)) == NULL)
+		return -1;
+	
+	matrix_rows = new_rows;
+	
+	if((new_columns = (float*) aligned_alloc(sizeof(feature_block_t), sizeof(float) * new_capacity * SIGNATURE_FEATURE_QTY)) == NULL)
+		return -1;
+	
+	// As colunas são reescritas por matrix_normalize()
+	free(matrix_columns);
+	matrix_columns = new_columns;
+	matrix_capacity = new_capacity;
+	
+	return 0;
+}
+
+static int appliance_is_active(int appliance_id) {
+	for(int i = 0; i < inactive_appliance_qty; i++) {
+		if(inactive_appliance_ids[i] == appliance_id)
+			return 0;
+	}
+	
+	return 1;
+}
+
+/* Carrega todas as assinaturas do banco de dados, as alterações seguintes são feitas por signature_matrix_add() e
+ * signature_matrix_remove() sem reler a tabela. */
+int signature_matrix_load() {
+	int result;
+	sqlite3 *db_conn = NULL;
+	sqlite3_stmt *ppstmt = NULL;
+	const char sql_get_signatures[] = "SELECT timestamp,appliance_id,delta_pt,peak_pt,delta_pa,delta_pb,delta_qa,delta_qb,delta_sa,delta_sb,duration FROM signatures;";
+	const char sql_get_inactive_appliances[] = "SELECT id FROM appliances WHERE NOT is_active;";
+	int *new_inactive_ids;
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
+		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	pthread_rwlock_wrlock(&matrix_lock);
+	
+	matrix_qty = 0;
+	matrix_loaded = 0;
+	inactive_appliance_qty = 0;
+	
+	if((result = database_prepare(db_conn, sql_get_signatures, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&matrix_lock);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		signature_row_t *row;
+		
+		if(matrix_reserve(matrix_qty + 1)) {
+			LOG_ERROR("Failed to allocate memory for signature matrix.");
+			break;
+		}
+		
+		row = &matrix_rows[matrix_qty++];
+		
+		row->timestamp = sqlite3_column_int64(ppstmt, 0);
+		row->appliance_id = sqlite3_column_int(ppstmt, 1);
+		
+		for(int f = 0; f < SIGNATURE_FEATURE_QTY; f++)
+			row->features[f] = sqlite3_column_double(ppstmt, 2 + f);
+	}
+	
+	database_finalize(ppstmt);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get signatures from database: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&matrix_lock);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	if((result = database_prepare(db_conn, sql_get_inactive_appliances, &ppstmt)) != SQLITE_OK) {
+		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&matrix_lock);
+		database_close(db_conn);
+		
+		return -1;
+	}
+	
+	while((result = sqlite3_step(ppstmt)) == SQLITE_ROW) {
+		if((new_inactive_ids = (int*) realloc(inactive_appliance_ids, sizeof(int) * (inactive_appliance_qty + 1))) == NULL)
+			break;
+		
+		inactive_appliance_ids = new_inactive_ids;
+		inactive_appliance_ids[inactive_appliance_qty++] = sqlite3_column_int(ppstmt, 0);
+	}
+	
+	database_finalize(ppstmt);
+	database_close(db_conn);
+	
+	if(result != SQLITE_DONE) {
+		LOG_ERROR("Failed to get inactive appliances from database: %s", sqlite3_errstr(result));
+		pthread_rwlock_unlock(&matrix_lock);
+		
+		return -1;
+	}
+	
+	if(matrix_capacity)
+		matrix_normalize();
+	
+	matrix_loaded = 1;
+	
+	LOG_INFO("Loaded %d signatures into signature matrix.", matrix_qty);
+	
+	pthread_rwlock_unlock(&matrix_lock);
+	
+	return 0;
+}
+
+/* Adiciona uma assinatura, substituindo a existente com o mesmo timestamp (como o INSERT OR REPLACE da tabela) */
+int signature_matrix_add(int appliance_id, const load_event_t *signature) {
+	signature_row_t *row = NULL;
+	
+	if(signature == NULL)
+		return -1;
+	
+	if(pthread_rwlock_wrlock(&matrix_lock))
+		return -1;
+	
+	if(!matrix_loaded) {
+		pthread_rwlock_unlock(&matrix_lock);
+		return -1;
+	}
+	
+	for(int i = 0; i < matrix_qty; i++) {
+		if(matrix_rows[i].timestamp == signature->timestamp) {
+			row = &matrix_rows[i];
+			break;
+		}
+	}
+	
+	if(row == NULL) {
+		if(matrix_reserve(matrix_qty + 1)) {
+			LOG_ERROR("Failed to allocate memory for signature matrix.");
+			pthread_rwlock_unlock(&matrix_lock);
+			
+			return -1;
+		}
+		
+		row = &matrix_rows[matrix_qty++];
+	}
+	
+	row->timestamp = signature->timestamp;
+	row->appliance_id = appliance_id;
+	extract_features(signature, row->features);
+	
+	matrix_normalize();
+	
+	pthread_rwlock_unlock(&matrix_lock);
+	
+	return 0;
+}
+
+int signature_matrix_remove(time_t timestamp) {
+	int removed = 0;
+	
+	if(pthread_rwlock_wrlock(&matrix_lock))
+		return -1;
+	
+	for(int i = 0; i < matrix_qty; i++) {
+		if(matrix_rows[i].timestamp != timestamp)
+			continue;
+		
+		// A ordem das linhas não importa, a última ocupa o lugar da removida
+		memcpy(&matrix_rows[i], &matrix_rows[matrix_qty - 1], sizeof(signature_row_t));
+		matrix_qty--;
+		removed = 1;
+		
+		break;
+	}
+	
+	if(removed)
+		matrix_normalize();
+	
+	pthread_rwlock_unlock(&matrix_lock);
+	
+	return removed;
+}
+
+/* Assinaturas de aparelhos inativos continuam na matriz, mas são ignoradas na classificação */
+void signature_matrix_set_appliance_active(int appliance_id, int is_active) {
+	int *new_inactive_ids;
+	
+	if(pthread_rwlock_wrlock(&matrix_lock))
+		return;
+	
+	if(is_active) {
+		for(int i = 0; i < inactive_appliance_qty; i++) {
+			if(inactive_appliance_ids[i] == appliance_id)
+				inactive_appliance_ids[i--] = inactive_appliance_ids[--inactive_appliance_qty];
+		}
+	} else if(appliance_is_active(appliance_id)) {
+		if((new_inactive_ids = (int*) realloc(inactive_appliance_ids, sizeof(int) * (inactive_appliance_qty + 1))) != NULL) {
+			inactive_appliance_ids = new_inactive_ids;
+			inactive_appliance_ids[inactive_appliance_qty++] = appliance_id;
+		}
+	}
+	
+	pthread_rwlock_unlock(&matrix_lock);
+}
+
+/* Classifica o evento pelos k vizinhos mais próximos (força bruta) entre as assinaturas do mesmo tipo (ligamento ou
+ * desligamento), com votos ponderados pelo inverso da distância. Retorna 1 se não há assinaturas para comparar. */
+int signature_matrix_classify(const load_event_t *load_event, int k, int *appliance_id, double *confidence) {
+	double features[SIGNATURE_FEATURE_QTY];
+	float query[SIGNATURE_FEATURE_QTY];
+	float *distances;
+	int neighbor_ids[SIGNATURE_KNN_MAX_K];
+	float neighbor_distances[SIGNATURE_KNN_MAX_K];
+	int neighbor_qty = 0;
+	double weight_sum = 0.0, best_weight = 0.0;
+	int on;
+	
+	if(load_event == NULL || appliance_id == NULL || k < 1)
+		return -1;
+	
+	k = MIN(k, SIGNATURE_KNN_MAX_K);
+	on = (load_event->delta_pt > 0.0);
+	
+	extract_features(load_event, features);
+	
+	if(pthread_rwlock_rdlock(&matrix_lock))
+		return -1;
+	
+	if(!matrix_loaded || matrix_qty == 0) {
+		pthread_rwlock_unlock(&matrix_lock);
+		return 1;
+	}
+	
+	if((distances = (float*) aligned_alloc(sizeof(feature_block_t), sizeof(float) * matrix_capacity)) == NULL) {
+		pthread_rwlock_unlock(&matrix_lock);
+		return -1;
+	}
+	
+	for(int f = 0; f < SIGNATURE_FEATURE_QTY; f++)
+		query[f] = (features[f] - feature_mean[f]) * feature_scale[f];
+	
+	/* Distância euclidiana ao quadrado, calculada por blocos de assinaturas com uma coluna por vez */
+	for(int b = 0; b < matrix_capacity / SIGNATURE_MATRIX_BLOCK_SIZE; b++) {
+		feature_block_t sum = {0};
+		
+		for(int f = 0; f < SIGNATURE_FEATURE_QTY; f++) {
+			feature_block_t diff = ((const feature_block_t*) &matrix_columns[f * matrix_capacity])[b] - query[f];
+			
+			sum += diff * diff;
+		}
+		
+		((feature_block_t*) distances)[b] = sum;
+	}
+	
+	/* Mantém os k mais próximos ordenados por inserção */
+	for(int i = 0; i < matrix_qty; i++) {
+		int position;
+		
+		if((matrix_rows[i].features[0] > 0.0) != on || !appliance_is_active(matrix_rows[i].appliance_id))
+			continue;
+		
+		if(neighbor_qty == k && distances[i] >= neighbor_distances[k - 1])
+			continue;
+		
+		for(position = MIN(neighbor_qty, k - 1); position > 0 && neighbor_distances[position - 1] > distances[i]; position--) {
+			neighbor_distances[position] = neighbor_distances[position - 1];
+			neighbor_ids[position] = neighbor_ids[position - 1];
+		}
+		
+		neighbor_distances[position] = distances[i];
+		neighbor_ids[position] = matrix_rows[i].appliance_id;
+		
+		if(neighbor_qty < k)
+			neighbor_qty++;
+	}
+	
+	pthread_rwlock_unlock(&matrix_lock);
+	
+	free(distances);
+	
+	if(neighbor_qty == 0)
+		return 1;
+	
+	for(int n = 0; n < neighbor_qty; n++)
+		weight_sum += 1.0 / (sqrt(neighbor_distances[n]) + FLT_EPSILON);
+	
+	for(int n = 0; n < neighbor_qty; n++) {
+		double weight = 0.0;
+		
+		for(int m = 0; m < neighbor_qty; m++) {
+			if(neighbor_ids[m] == neighbor_ids[n])
+				weight += 1.0 / (sqrt(neighbor_distances[m]) + FLT_EPSILON);
+		}
+		
+		if(weight > best_weight) {
+			best_weight = weight;
+			*appliance_id = neighbor_ids[n];
+		}
+	}
+	
+	if(confidence)
+		*confidence = best_weight / weight_sum;
+	
+	return 0;
+}
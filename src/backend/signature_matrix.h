@@ -0,0 +1,19 @@
+#ifndef SIGNATURE_MATRIX_H
+#define SIGNATURE_MATRIX_H
+
+#include <time.h>
+
+#include "disaggregation.h"
+
+/* delta_pt, peak_pt, delta_p[2], delta_q[2], delta_s[2] e duração */
+#define SIGNATURE_FEATURE_QTY 9
+
+#define SIGNATURE_KNN_MAX_K 15
+
+int signature_matrix_load();
+int signature_matrix_add(int appliance_id, const load_event_t *signature);
+int signature_matrix_remove(time_t timestamp);
+void signature_matrix_set_appliance_active(int appliance_id, int is_active);
+int signature_matrix_classify(const load_event_t *load_event, int k, int *appliance_id, double *confidence);
+
+#endif
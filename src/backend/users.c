@@ -19,26 +19,24 @@ int users_get_id_by_username(const char *username) {
 	if(username == NULL || strlen(username) < 1)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_user_id, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_user_id, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if((result = sqlite3_bind_text(ppstmt, 1, username, -1, SQLITE_STATIC)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -49,8 +47,8 @@ int users_get_id_by_username(const char *username) {
 		result = sqlite3_step(ppstmt);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to find user ID: %s", sqlite3_errstr(result));
@@ -71,26 +69,24 @@ int users_check_active(int user_id) {
 	if(user_id <= 0)
 		return -2;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_user, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_user, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if((result = sqlite3_bind_int(ppstmt, 1, user_id)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -102,8 +98,8 @@ int users_check_active(int user_id) {
 		result = sqlite3_step(ppstmt);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read user: %s", sqlite3_errstr(result));
@@ -123,26 +119,28 @@ int users_check_admin(int user_id) {
 	if(user_id <= 0)
 		return -2;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	// Usuários autenticados recentemente têm a permissão em cache junto com a sessão
+	if((is_admin = auth_get_cached_admin(user_id)) >= 0)
+		return is_admin;
+	
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_user, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_user, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if((result = sqlite3_bind_int(ppstmt, 1, user_id)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -154,8 +152,8 @@ int users_check_admin(int user_id) {
 		result = sqlite3_step(ppstmt);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read user: %s", sqlite3_errstr(result));
@@ -176,26 +174,24 @@ int users_get_list(user_t **user_list_ptr, int filter_inactive) {
 	if(user_list_ptr == NULL)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_users, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_users, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if((result = sqlite3_bind_int(ppstmt, 1, (filter_inactive) ? 0 : 1)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -203,8 +199,8 @@ int users_get_list(user_t **user_list_ptr, int filter_inactive) {
 	*user_list_ptr = (user_t*) malloc(sizeof(user_t) * size);
 	
 	if(*user_list_ptr == NULL) {
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -2;
 	}
@@ -235,8 +231,8 @@ int users_get_list(user_t **user_list_ptr, int filter_inactive) {
 		count++;
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read users: %s", sqlite3_errstr(result));
@@ -263,26 +259,24 @@ int users_get(int user_id, user_t *user_ptr) {
 	if(user_id <= 0)
 		return -2;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_get_user, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_get_user, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	if((result = sqlite3_bind_int(ppstmt, 1, user_id)) != SQLITE_OK) {
 		LOG_ERROR("Failed to bind value to prepared statement: %s", sqlite3_errstr(result));
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -292,8 +286,8 @@ int users_get(int user_id, user_t *user_ptr) {
 		
 		if(user_ptr) {
 			if((str_ptr = (const char*) sqlite3_column_text(ppstmt, 0)) == NULL) {
-				sqlite3_finalize(ppstmt);
-				sqlite3_close(db_conn);
+				database_finalize(ppstmt);
+				database_close(db_conn);
 				
 				return -1;
 			}
@@ -310,8 +304,8 @@ int users_get(int user_id, user_t *user_ptr) {
 		result = sqlite3_step(ppstmt);
 	}
 	
-	sqlite3_finalize(ppstmt);
-	sqlite3_close(db_conn);
+	database_finalize(ppstmt);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to read user: %s", sqlite3_errstr(result));
@@ -335,18 +329,16 @@ int users_create(const user_t *user, const char *password) {
 	if(user == NULL || user->name == NULL || password == NULL)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_create_user, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_create_user, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement for inserting new user: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -355,8 +347,8 @@ int users_create(const user_t *user, const char *password) {
 	
 	if((hash = auth_hash_password(salt, password)) == NULL) {
 		LOG_ERROR("Failed to calculate password hash for new user.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -2;
 	}
@@ -374,19 +366,19 @@ int users_create(const user_t *user, const char *password) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	user_id = sqlite3_last_insert_rowid(db_conn);
 	
-	sqlite3_close(db_conn);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to insert new user: %s", sqlite3_errstr(result));
@@ -407,18 +399,16 @@ int users_update(const user_t *user) {
 	if(user == NULL || user->name == NULL)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_update_user, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_update_user, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement for user update: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -432,19 +422,19 @@ int users_update(const user_t *user) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	changes = sqlite3_changes(db_conn);
 	
-	sqlite3_close(db_conn);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to update user: %s", sqlite3_errstr(result));
@@ -452,6 +442,9 @@ int users_update(const user_t *user) {
 		return -1;
 	}
 	
+	if(changes > 0)
+		auth_invalidate_user_sessions(user->id);
+	
 	return changes;
 }
 
@@ -466,18 +459,16 @@ int users_update_password(int user_id, const char *password) {
 	if(password == NULL)
 		return 0;
 	
-	if((result = sqlite3_open(DB_FILENAME, &db_conn)) != SQLITE_OK) {
+	if((result = database_open(&db_conn)) != SQLITE_OK) {
 		LOG_ERROR("Failed to open database connection: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
-	sqlite3_busy_timeout(db_conn, 1000);
-	
-	if((result = sqlite3_prepare_v2(db_conn, sql_update_user_password, -1, &ppstmt, NULL)) != SQLITE_OK) {
+	if((result = database_prepare(db_conn, sql_update_user_password, &ppstmt)) != SQLITE_OK) {
 		LOG_ERROR("Failed to prepare SQL statement for user password update: %s", sqlite3_errstr(result));
-		sqlite3_close(db_conn);
+		database_close(db_conn);
 		
 		return -1;
 	}
@@ -486,8 +477,8 @@ int users_update_password(int user_id, const char *password) {
 	
 	if((hash = auth_hash_password(salt, password)) == NULL) {
 		LOG_ERROR("Failed to calculate password hash.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -2;
 	}
@@ -503,19 +494,19 @@ int users_update_password(int user_id, const char *password) {
 	
 	if(result) {
 		LOG_ERROR("Failed to bind values to prepared statement.");
-		sqlite3_finalize(ppstmt);
-		sqlite3_close(db_conn);
+		database_finalize(ppstmt);
+		database_close(db_conn);
 		
 		return -1;
 	}
 	
 	result = sqlite3_step(ppstmt);
 	
-	sqlite3_finalize(ppstmt);
+	database_finalize(ppstmt);
 	
 	changes = sqlite3_changes(db_conn);
 	
-	sqlite3_close(db_conn);
+	database_close(db_conn);
 	
 	if(result != SQLITE_DONE) {
 		LOG_ERROR("Failed to update user password: %s", sqlite3_errstr(result));
@@ -523,5 +514,8 @@ int users_update_password(int user_id, const char *password) {
 		return -1;
 	}
 	
+	if(changes > 0)
+		auth_invalidate_user_sessions(user_id);
+	
 	return changes;
 }
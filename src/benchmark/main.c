@@ -0,0 +1,467 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "logger.h"
+#include "database.h"
+#include "power.h"
+#include "disaggregation.h"
+#include "event_detector.h"
+#include "signature_matrix.h"
+#include "classifier.h"
+
+#define BENCHMARK_MAX_APPLIANCES 64
+#define BENCHMARK_DEFAULT_THRESHOLD 50.0
+#define BENCHMARK_DEFAULT_TOLERANCE 2
+#define BENCHMARK_DEFAULT_KNN_K 5
+
+/* Evento de referência, appliance_id negativo indica um evento sem aparelho conhecido (avalia só a detecção) */
+typedef struct labeled_event_s {
+	time_t timestamp;
+	int appliance_id;
+} labeled_event_t;
+
+/* Evento detectado com as medidas usadas no relatório */
+typedef struct detected_event_s {
+	load_event_t load_event;
+	
+	// Tempo de processamento da amostra que completou o evento, incluindo a classificação
+	double latency_us;
+	
+	// Segundos de dados entre o início do evento e a amostra que permitiu detectá-lo
+	int delay;
+} detected_event_t;
+
+typedef struct benchmark_options_s {
+	double threshold;
+	int tolerance;
+	int knn_k;
+	int classify;
+	int svm_available;
+} benchmark_options_t;
+
+static void print_usage(const char *filename) {
+	fprintf(stderr, "Usage: %s [options] data_file [data_file ...]\n", filename);
+	fprintf(stderr, "Data files can be pd-*.csv archives or tcc-data-export output, in chronological order.\n");
+	fprintf(stderr, "Valid options:\n");
+	fprintf(stderr, "\t-d Detector (step, cusum, glr, edge or all), default step\n");
+	fprintf(stderr, "\t-t Detection threshold in W, default %.0lf\n", BENCHMARK_DEFAULT_THRESHOLD);
+	fprintf(stderr, "\t-e Labeled events file, with timestamp,appliance_id lines\n");
+	fprintf(stderr, "\t-m Maximum time difference in seconds to match a labeled event, default %d\n", BENCHMARK_DEFAULT_TOLERANCE);
+	fprintf(stderr, "\t-k Number of neighbors for k-NN classification, default %d\n", BENCHMARK_DEFAULT_KNN_K);
+	fprintf(stderr, "\t-w Working directory with the database (labeled signatures) and saved classifier models\n");
+}
+
+static double elapsed_us(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static int compare_double(const void *a, const void *b) {
+	const double da = *((const double*) a), db = *((const double*) b);
+	
+	return (da > db) - (da < db);
+}
+
+static int compare_labeled_event(const void *a, const void *b) {
+	const labeled_event_t *la = (const labeled_event_t*) a, *lb = (const labeled_event_t*) b;
+	
+	return (la->timestamp > lb->timestamp) - (la->timestamp < lb->timestamp);
+}
+
+/* Lê e concatena os arquivos de dados, descartando amostras fora de ordem entre arquivos */
+static int load_data_files(char **filenames, int file_qty, power_data_t **data_ptr) {
+	power_data_t *data = NULL, *file_data, *new_data;
+	int count = 0;
+	int file_count;
+	
+	for(int f = 0; f < file_qty; f++) {
+		if((file_count = read_power_data_file(filenames[f], 0, 0, &file_data)) < 0) {
+			LOG_ERROR("Failed to read data file \"%s\".", filenames[f]);
+			free(data);
+			
+			return -1;
+		}
+		
+		if((new_data = (power_data_t*) realloc(data, sizeof(power_data_t) * (count + file_count + 1))) == NULL) {
+			free(file_data);
+			free(data);
+			
+			return -2;
+		}
+		
+		data = new_data;
+		
+		for(int i = 0; i < file_count; i++) {
+			if(count > 0 && file_data[i].timestamp <= data[count - 1].timestamp)
+				continue;
+			
+			memcpy(&data[count++], &file_data[i], sizeof(power_data_t));
+		}
+		
+		free(file_data);
+	}
+	
+	*data_ptr = data;
+	
+	return count;
+}
+
+static int load_labeled_events(const char *filename, labeled_event_t **events_ptr) {
+	FILE *labels_fd;
+	char line[128];
+	labeled_event_t *events = NULL, *new_events;
+	labeled_event_t event_aux;
+	long timestamp_aux;
+	int count = 0, size = 0;
+	
+	if((labels_fd = fopen(filename, "r")) == NULL) {
+		LOG_ERROR("Failed to open labeled events file \"%s\".", filename);
+		return -1;
+	}
+	
+	while(fgets(line, sizeof(line), labels_fd)) {
+		if(line[0] == '#' || sscanf(line, "%ld,%d", &timestamp_aux, &event_aux.appliance_id) != 2)
+			continue;
+		
+		event_aux.timestamp = timestamp_aux;
+		
+		if(count == size) {
+			size = MAX(256, size * 2);
+			
+			if((new_events = (labeled_event_t*) realloc(events, sizeof(labeled_event_t) * size)) == NULL) {
+				free(events);
+				fclose(labels_fd);
+				
+				return -2;
+			}
+			
+			events = new_events;
+		}
+		
+		events[count++] = event_aux;
+	}
+	
+	fclose(labels_fd);
+	
+	if(count > 0)
+		qsort(events, count, sizeof(labeled_event_t), compare_labeled_event);
+	
+	*events_ptr = events;
+	
+	return count;
+}
+
+static int run_streaming(event_detector_type_t type, const power_data_t *data, int count, const benchmark_options_t *options, detected_event_t **events_ptr, double *elapsed_ptr) {
+	event_detector_t detector;
+	load_event_t load_event;
+	detected_event_t *events = NULL, *new_events;
+	struct timespec start_ts, end_ts, sample_ts;
+	int event_qty = 0, event_max = 0;
+	
+	// A vazão é medida sem cronometrar cada amostra
+	event_detector_init(&detector, type, options->threshold);
+	
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+	
+	for(int i = 0; i < count; i++)
+		event_detector_feed(&detector, &data[i], &load_event);
+	
+	clock_gettime(CLOCK_MONOTONIC, &end_ts);
+	
+	*elapsed_ptr = elapsed_us(&start_ts, &end_ts);
+	
+	event_detector_init(&detector, type, options->threshold);
+	
+	for(int i = 0; i < count; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &sample_ts);
+		
+		if(event_detector_feed(&detector, &data[i], &load_event) != 1)
+			continue;
+		
+		if(options->classify)
+			classify_load_event(&load_event, options->knn_k);
+		
+		clock_gettime(CLOCK_MONOTONIC, &end_ts);
+		
+		if(event_qty == event_max) {
+			event_max = MAX(256, event_max * 2);
+			
+			if((new_events = (detected_event_t*) realloc(events, sizeof(detected_event_t) * event_max)) == NULL) {
+				free(events);
+				return -2;
+			}
+			
+			events = new_events;
+		}
+		
+		events[event_qty].load_event = load_event;
+		events[event_qty].latency_us = elapsed_us(&sample_ts, &end_ts);
+		events[event_qty].delay = data[i].timestamp - load_event.timestamp;
+		event_qty++;
+	}
+	
+	*events_ptr = events;
+	
+	return event_qty;
+}
+
+static void print_latency(const detected_event_t *events, int event_qty) {
+	double *latencies;
+	double latency_sum = 0.0;
+	long delay_sum = 0;
+	int delay_max = 0;
+	
+	if(event_qty == 0 || (latencies = (double*) malloc(sizeof(double) * event_qty)) == NULL)
+		return;
+	
+	for(int i = 0; i < event_qty; i++) {
+		latencies[i] = events[i].latency_us;
+		latency_sum += events[i].latency_us;
+		delay_sum += events[i].delay;
+		delay_max = MAX(delay_max, events[i].delay);
+	}
+	
+	qsort(latencies, event_qty, sizeof(double), compare_double);
+	
+	printf("Event latency (us): avg %.2lf, p50 %.2lf, p95 %.2lf, max %.2lf\n", latency_sum / event_qty,
+			latencies[event_qty / 2], latencies[(int) (event_qty * 0.95)], latencies[event_qty - 1]);
+	printf("Detection delay (s): avg %.2lf, max %d\n", (double) delay_sum / event_qty, delay_max);
+	
+	free(latencies);
+}
+
+static int appliance_index(int *appliance_ids, int *appliance_qty, int appliance_id) {
+	for(int i = 0; i < *appliance_qty; i++) {
+		if(appliance_ids[i] == appliance_id)
+			return i;
+	}
+	
+	if(*appliance_qty == BENCHMARK_MAX_APPLIANCES)
+		return -1;
+	
+	appliance_ids[*appliance_qty] = appliance_id;
+	
+	return (*appliance_qty)++;
+}
+
+/* Associa eventos detectados e de referência em ordem cronológica, cada um usado no máximo uma vez */
+static void print_accuracy(const detected_event_t *events, int event_qty, const labeled_event_t *labels, int label_qty, const benchmark_options_t *options) {
+	static int confusion[BENCHMARK_MAX_APPLIANCES][BENCHMARK_MAX_APPLIANCES];
+	int appliance_ids[BENCHMARK_MAX_APPLIANCES];
+	int appliance_qty = 0;
+	int true_positives = 0, false_positives = 0, false_negatives = 0;
+	int classified_qty = 0, correct_qty = 0;
+	double precision, recall;
+	int e = 0, l = 0;
+	
+	memset(confusion, 0, sizeof(confusion));
+	
+	// A primeira coluna é usada para eventos sem classificação
+	appliance_index(appliance_ids, &appliance_qty, -1);
+	
+	while(e < event_qty || l < label_qty) {
+		if(l == label_qty || (e < event_qty && events[e].load_event.timestamp < labels[l].timestamp - options->tolerance)) {
+			false_positives++;
+			e++;
+		} else if(e == event_qty || events[e].load_event.timestamp > labels[l].timestamp + options->tolerance) {
+			false_negatives++;
+			l++;
+		} else {
+			true_positives++;
+			
+			if(labels[l].appliance_id >= 0) {
+				int row = appliance_index(appliance_ids, &appliance_qty, labels[l].appliance_id);
+				int col = appliance_index(appliance_ids, &appliance_qty, MAX(-1, events[e].load_event.top_appliance_id));
+				
+				if(row >= 0 && col >= 0)
+					confusion[row][col]++;
+				
+				classified_qty++;
+				
+				if(events[e].load_event.top_appliance_id == labels[l].appliance_id)
+					correct_qty++;
+			}
+			
+			e++;
+			l++;
+		}
+	}
+	
+	precision = (true_positives + false_positives) ? ((double) true_positives / (true_positives + false_positives)) : 0.0;
+	recall = (true_positives + false_negatives) ? ((double) true_positives / (true_positives + false_negatives)) : 0.0;
+	
+	printf("Detection (tolerance %d s): TP %d, FP %d, FN %d, precision %.3lf, recall %.3lf, F1 %.3lf\n", options->tolerance,
+			true_positives, false_positives, false_negatives, precision, recall, (precision + recall > 0.0) ? (2 * precision * recall / (precision + recall)) : 0.0);
+	
+	if(!options->classify || classified_qty == 0)
+		return;
+	
+	printf("Classification: %d of %d matched events correct (%.1lf%%)\n", correct_qty, classified_qty, 100.0 * correct_qty / classified_qty);
+	printf("Confusion matrix (rows: labeled appliance, columns: classified appliance, -1: unclassified)\n");
+	
+	printf("%8s", "");
+	
+	for(int c = 0; c < appliance_qty; c++)
+		printf("%7d", appliance_ids[c]);
+	
+	printf("\n");
+	
+	for(int r = 1; r < appliance_qty; r++) {
+		printf("%8d", appliance_ids[r]);
+		
+		for(int c = 0; c < appliance_qty; c++)
+			printf("%7d", confusion[r][c]);
+		
+		printf("\n");
+	}
+}
+
+static void run_benchmark(event_detector_type_t type, const power_data_t *data, int count, const labeled_event_t *labels, int label_qty, const benchmark_options_t *options) {
+	detected_event_t *events = NULL;
+	load_event_t *batch_events = NULL;
+	struct timespec start_ts, end_ts;
+	double streaming_us, batch_us;
+	int event_qty, batch_qty;
+	
+	printf("\nDetector: %s (threshold %.1lf W)\n", event_detector_type_name(type), options->threshold);
+	
+	if((event_qty = run_streaming(type, data, count, options, &events, &streaming_us)) < 0) {
+		LOG_ERROR("Failed to run streaming detector.");
+		return;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+	batch_qty = event_detector_detect_batch(type, options->threshold, data, count, &batch_events);
+	clock_gettime(CLOCK_MONOTONIC, &end_ts);
+	
+	batch_us = elapsed_us(&start_ts, &end_ts);
+	
+	free(batch_events);
+	
+	printf("Events: %d\n", event_qty);
+	printf("Throughput: streaming %.0lf samples/s, batch %.0lf samples/s\n", count / (streaming_us / 1e6), count / (batch_us / 1e6));
+	
+	if(batch_qty != event_qty)
+		printf("Warning: batch detector found %d events\n", batch_qty);
+	
+	print_latency(events, event_qty);
+	
+	if(labels)
+		print_accuracy(events, event_qty, labels, label_qty, options);
+	
+	free(events);
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	char *detector_name = NULL;
+	char *labels_filename = NULL;
+	char *working_dir_path = NULL;
+	benchmark_options_t options;
+	
+	power_data_t *data = NULL;
+	labeled_event_t *labels = NULL;
+	int count, label_qty = 0;
+	int detector_type;
+	
+	options.threshold = BENCHMARK_DEFAULT_THRESHOLD;
+	options.tolerance = BENCHMARK_DEFAULT_TOLERANCE;
+	options.knn_k = BENCHMARK_DEFAULT_KNN_K;
+	options.classify = 0;
+	options.svm_available = 0;
+	
+	while((opt = getopt(argc, argv, "d:e:k:m:t:w:")) != -1) {
+		switch (opt) {
+			case 'd':
+				detector_name = strdup(optarg);
+				break;
+			case 'e':
+				labels_filename = strdup(optarg);
+				break;
+			case 'k':
+				options.knn_k = atoi(optarg);
+				break;
+			case 'm':
+				options.tolerance = atoi(optarg);
+				break;
+			case 't':
+				options.threshold = atof(optarg);
+				break;
+			case 'w':
+				working_dir_path = strdup(optarg);
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	
+	if(optind >= argc) {
+		print_usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	
+	logger_set_level(LOGLEVEL_WARN);
+	
+	if(options.threshold <= 0.0 || options.tolerance < 0 || options.knn_k < 1 || options.knn_k > SIGNATURE_KNN_MAX_K) {
+		LOG_FATAL("Invalid parameter.");
+		exit(EXIT_FAILURE);
+	}
+	
+	if(detector_name != NULL && strcmp(detector_name, "all") != 0 && event_detector_type_from_name(detector_name) < 0) {
+		LOG_FATAL("Invalid detector: %s", detector_name);
+		exit(EXIT_FAILURE);
+	}
+	
+	if((count = load_data_files(&argv[optind], argc - optind, &data)) < 0)
+		exit(EXIT_FAILURE);
+	
+	if(labels_filename != NULL) {
+		if((label_qty = load_labeled_events(labels_filename, &labels)) < 0)
+			exit(EXIT_FAILURE);
+		
+		free(labels_filename);
+	}
+	
+	// Os caminhos dos arquivos de dados são relativos ao diretório original
+	if(working_dir_path != NULL) {
+		if(chdir(working_dir_path) < 0) {
+			LOG_FATAL("Failed changing working directory to: %s", working_dir_path);
+			exit(EXIT_FAILURE);
+		}
+		
+		free(working_dir_path);
+		
+		if(access(DB_FILENAME, F_OK) == 0) {
+			options.classify = (signature_matrix_load() == 0);
+			options.svm_available = (classifier_init() == 0 && classifier_get_version() > 0);
+		}
+		
+		if(!options.classify)
+			LOG_WARN("Failed to load signatures, events will not be classified.");
+	}
+	
+	printf("Samples: %d from %d files, labeled events: %d\n", count, argc - optind, label_qty);
+	
+	if(options.classify)
+		printf("Classifier: %s, k-NN with k = %d\n", options.svm_available ? "SVM" : "none", options.knn_k);
+	
+	for(int t = 0; t < EVENT_DETECTOR_TYPE_QTY; t++) {
+		detector_type = (detector_name == NULL) ? EVENT_DETECTOR_STEP : event_detector_type_from_name(detector_name);
+		
+		if(detector_type >= 0 && detector_type != t)
+			continue;
+		
+		run_benchmark(t, data, count, labels, label_qty, &options);
+	}
+	
+	free(detector_name);
+	free(data);
+	free(labels);
+	
+	return 0;
+}
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "logger.h"
+
+#define BENCHMARK_DEFAULT_PORT 8081
+#define BENCHMARK_DEFAULT_CLIENTS 20
+#define BENCHMARK_DEFAULT_REQUESTS 200
+#define BENCHMARK_DEFAULT_INTERVAL_MS 0
+#define BENCHMARK_MAX_URLS 16
+#define BENCHMARK_SAMPLE_INTERVAL_US 100000
+#define RESPONSE_BUFFER_SIZE 65536
+
+typedef struct benchmark_options_s {
+	struct sockaddr_in address;
+	const char *host;
+	const char *auth_key;
+	const char *urls[BENCHMARK_MAX_URLS];
+	int url_qty;
+	int request_qty;
+	int interval_ms;
+} benchmark_options_t;
+
+/* Resultados de um cliente, cada um simula um dashboard com uma única conexão keep-alive */
+typedef struct client_ctx_s {
+	pthread_t thread;
+	int id;
+	const benchmark_options_t *options;
+	
+	double *latencies_us;
+	int request_count;
+	int error_count;
+	int status_error_count;
+	int reconnect_count;
+	size_t received_bytes;
+} client_ctx_t;
+
+/* Memória e threads do servidor, lidos de /proc/<pid>/status */
+typedef struct process_usage_s {
+	long vm_rss_kb;
+	long vm_hwm_kb;
+	int threads;
+} process_usage_t;
+
+typedef struct sampler_ctx_s {
+	pthread_t thread;
+	pid_t pid;
+	volatile int terminate;
+	
+	process_usage_t peak;
+} sampler_ctx_t;
+
+static void print_usage(const char *filename) {
+	fprintf(stderr, "Usage: %s [options] [url_path ...]\n", filename);
+	fprintf(stderr, "Requests each url path in turn from concurrent keep-alive clients, default /dashboard.\n");
+	fprintf(stderr, "Valid options:\n");
+	fprintf(stderr, "\t-H Server IPv4 address, default 127.0.0.1\n");
+	fprintf(stderr, "\t-p Server port, default %d\n", BENCHMARK_DEFAULT_PORT);
+	fprintf(stderr, "\t-c Concurrent clients, default %d\n", BENCHMARK_DEFAULT_CLIENTS);
+	fprintf(stderr, "\t-n Requests per client, default %d\n", BENCHMARK_DEFAULT_REQUESTS);
+	fprintf(stderr, "\t-i Interval between requests of a client in ms, default %d\n", BENCHMARK_DEFAULT_INTERVAL_MS);
+	fprintf(stderr, "\t-k Authentication key sent as a bearer token\n");
+	fprintf(stderr, "\t-P Server process id, to report its memory footprint and thread count\n");
+}
+
+static double elapsed_us(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static int compare_double(const void *a, const void *b) {
+	const double da = *((const double*) a), db = *((const double*) b);
+	
+	return (da > db) - (da < db);
+}
+
+static int read_process_usage(pid_t pid, process_usage_t *usage) {
+	char filename[64];
+	char line[256];
+	FILE *file;
+	
+	snprintf(filename, sizeof(filename), "/proc/%d/status", (int) pid);
+	
+	if((file = fopen(filename, "r")) == NULL)
+		return -1;
+	
+	memset(usage, 0, sizeof(process_usage_t));
+	
+	while(fgets(line, sizeof(line), file)) {
+		if(strncmp(line, "VmRSS:", 6) == 0)
+			usage->vm_rss_kb = atol(line + 6);
+		else if(strncmp(line, "VmHWM:", 6) == 0)
+			usage->vm_hwm_kb = atol(line + 6);
+		else if(strncmp(line, "Threads:", 8) == 0)
+			usage->threads = atoi(line + 8);
+	}
+	
+	fclose(file);
+	
+	return 0;
+}
+
+static void *sampler_loop(void *argp) {
+	sampler_ctx_t *sampler = (sampler_ctx_t*) argp;
+	process_usage_t usage;
+	
+	while(!sampler->terminate) {
+		if(read_process_usage(sampler->pid, &usage) == 0) {
+			sampler->peak.vm_rss_kb = MAX(sampler->peak.vm_rss_kb, usage.vm_rss_kb);
+			sampler->peak.vm_hwm_kb = MAX(sampler->peak.vm_hwm_kb, usage.vm_hwm_kb);
+			sampler->peak.threads = MAX(sampler->peak.threads, usage.threads);
+		}
+		
+		usleep(BENCHMARK_SAMPLE_INTERVAL_US);
+	}
+	
+	return NULL;
+}
+
+static int open_connection(const benchmark_options_t *options) {
+	int sock;
+	int nodelay = 1;
+	
+	if((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+	
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	
+	if(connect(sock, (const struct sockaddr*) &options->address, sizeof(options->address)) < 0) {
+		close(sock);
+		return -1;
+	}
+	
+	return sock;
+}
+
+static int send_all(int sock, const char *data, size_t size) {
+	ssize_t sent;
+	
+	while(size > 0) {
+		if((sent = send(sock, data, size, MSG_NOSIGNAL)) <= 0) {
+			if(sent < 0 && errno == EINTR)
+				continue;
+			
+			return -1;
+		}
+		
+		data += sent;
+		size -= sent;
+	}
+	
+	return 0;
+}
+
+/* Lê uma resposta completa, com Content-Length ou codificação chunked, e retorna o código de status ou -1 em caso de erro.
+ * O buffer guarda os bytes ainda não consumidos entre chamadas, pois a conexão é reaproveitada. */
+static int read_response(int sock, char *buffer, size_t *buffer_len, size_t *body_size) {
+	char *header_end = NULL, *line, *pos;
+	ssize_t received;
+	size_t header_size, consumed;
+	long content_length = -1;
+	int chunked = 0;
+	int status;
+	
+	*body_size = 0;
+	
+	/* Lê até o final dos cabeçalhos */
+	while((header_end = memmem(buffer, *buffer_len, "\r\n\r\n", 4)) == NULL) {
+		if(*buffer_len >= RESPONSE_BUFFER_SIZE)
+			return -1;
+		
+		if((received = recv(sock, buffer + *buffer_len, RESPONSE_BUFFER_SIZE - *buffer_len, 0)) <= 0)
+			return -1;
+		
+		*buffer_len += received;
+	}
+	
+	header_size = header_end - buffer + 4;
+	*header_end = '\0';
+	
+	if(sscanf(buffer, "HTTP/%*d.%*d %d", &status) != 1)
+		return -1;
+	
+	for(line = strstr(buffer, "\r\n"); line != NULL; line = strstr(line, "\r\n")) {
+		line += 2;
+		
+		if(strncasecmp(line, "Content-Length:", 15) == 0)
+			content_length = atol(line + 15);
+		else if(strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked"))
+			chunked = 1;
+	}
+	
+	memmove(buffer, buffer + header_size, *buffer_len - header_size);
+	*buffer_len -= header_size;
+	
+	// Respostas 204 e 304 nunca têm corpo, mesmo que o cabeçalho Content-Length esteja presente
+	if(status == 204 || status == 304)
+		return status;
+	
+	if(!chunked) {
+		// Sem Content-Length e sem chunked o corpo é vazio, pois as respostas mantêm a conexão aberta
+		long remaining = (content_length > 0) ? content_length : 0;
+		
+		while(remaining > 0) {
+			if(*buffer_len == 0) {
+				if((received = recv(sock, buffer, RESPONSE_BUFFER_SIZE, 0)) <= 0)
+					return -1;
+				
+				*buffer_len = received;
+			}
+			
+			consumed = MIN(*buffer_len, (size_t) remaining);
+			memmove(buffer, buffer + consumed, *buffer_len - consumed);
+			*buffer_len -= consumed;
+			remaining -= consumed;
+			*body_size += consumed;
+		}
+		
+		return status;
+	}
+	
+	/* Cada parte começa com o tamanho em hexadecimal, uma parte de tamanho zero termina o corpo */
+	while(1) {
+		long chunk_size, remaining;
+		
+		while((pos = memmem(buffer, *buffer_len, "\r\n", 2)) == NULL) {
+			if(*buffer_len >= RESPONSE_BUFFER_SIZE)
+				return -1;
+			
+			if((received = recv(sock, buffer + *buffer_len, RESPONSE_BUFFER_SIZE - *buffer_len, 0)) <= 0)
+				return -1;
+			
+			*buffer_len += received;
+		}
+		
+		chunk_size = strtol(buffer, NULL, 16);
+		
+		consumed = pos - buffer + 2;
+		memmove(buffer, buffer + consumed, *buffer_len - consumed);
+		*buffer_len -= consumed;
+		
+		// Os dados da parte são seguidos de um CRLF, a última parte é seguida apenas do CRLF final
+		*body_size += chunk_size;
+		remaining = chunk_size + 2;
+		
+		while(remaining > 0) {
+			if(*buffer_len == 0) {
+				if((received = recv(sock, buffer, RESPONSE_BUFFER_SIZE, 0)) <= 0)
+					return -1;
+				
+				*buffer_len = received;
+			}
+			
+			consumed = MIN(*buffer_len, (size_t) remaining);
+			memmove(buffer, buffer + consumed, *buffer_len - consumed);
+			*buffer_len -= consumed;
+			remaining -= consumed;
+		}
+		
+		if(chunk_size == 0)
+			break;
+	}
+	
+	return status;
+}
+
+static void *client_loop(void *argp) {
+	client_ctx_t *client = (client_ctx_t*) argp;
+	const benchmark_options_t *options = client->options;
+	struct timespec start_time, end_time;
+	char request[1024];
+	char *buffer;
+	size_t buffer_len = 0, body_size;
+	int request_size;
+	int sock = -1;
+	int status;
+	
+	if((buffer = (char*) malloc(RESPONSE_BUFFER_SIZE)) == NULL)
+		return NULL;
+	
+	for(int r = 0; r < options->request_qty; r++) {
+		// Cada cliente começa em uma URL diferente, para que todas sejam requisitadas ao mesmo tempo
+		const char *url = options->urls[(client->id + r) % options->url_qty];
+		
+		if(options->auth_key)
+			request_size = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nAuthorization: Bearer %s\r\n\r\n", url, options->host, options->auth_key);
+		else
+			request_size = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", url, options->host);
+		
+		clock_gettime(CLOCK_MONOTONIC, &start_time);
+		
+		/* A latência inclui o tempo de reconexão, como seria percebido pelo usuário */
+		if(sock < 0) {
+			if((sock = open_connection(options)) < 0) {
+				client->error_count++;
+				continue;
+			}
+			
+			buffer_len = 0;
+			client->reconnect_count++;
+		}
+		
+		if(send_all(sock, request, request_size) < 0 || (status = read_response(sock, buffer, &buffer_len, &body_size)) < 0) {
+			client->error_count++;
+			close(sock);
+			sock = -1;
+			
+			continue;
+		}
+		
+		clock_gettime(CLOCK_MONOTONIC, &end_time);
+		
+		if(status != 200 && status != 304)
+			client->status_error_count++;
+		
+		client->latencies_us[client->request_count++] = elapsed_us(&start_time, &end_time);
+		client->received_bytes += body_size;
+		
+		if(options->interval_ms > 0)
+			usleep(options->interval_ms * 1000);
+	}
+	
+	if(sock >= 0)
+		close(sock);
+	
+	free(buffer);
+	
+	return NULL;
+}
+
+static double percentile(const double *sorted_values, int count, double fraction) {
+	int index;
+	
+	if(count == 0)
+		return 0.0;
+	
+	index = (int) (fraction * count);
+	
+	return sorted_values[MIN(index, count - 1)];
+}
+
+static void print_process_usage(const char *label, const process_usage_t *usage) {
+	printf("Server %-6s RSS: %7.1lf MiB, high water mark: %7.1lf MiB, threads: %d\n", label, usage->vm_rss_kb / 1024.0, usage->vm_hwm_kb / 1024.0, usage->threads);
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	benchmark_options_t options;
+	int client_qty = BENCHMARK_DEFAULT_CLIENTS;
+	int server_port = BENCHMARK_DEFAULT_PORT;
+	pid_t server_pid = 0;
+	
+	client_ctx_t *clients;
+	sampler_ctx_t sampler;
+	process_usage_t usage;
+	struct timespec start_time, end_time;
+	double elapsed_s;
+	double *latencies;
+	int latency_qty = 0, error_qty = 0, status_error_qty = 0, reconnect_qty = 0;
+	size_t received_bytes = 0;
+	
+	memset(&options, 0, sizeof(options));
+	options.host = "127.0.0.1";
+	options.request_qty = BENCHMARK_DEFAULT_REQUESTS;
+	options.interval_ms = BENCHMARK_DEFAULT_INTERVAL_MS;
+	
+	while((opt = getopt(argc, argv, "c:i:k:n:p:H:P:")) != -1) {
+		switch (opt) {
+			case 'c':
+				client_qty = atoi(optarg);
+				break;
+			case 'i':
+				options.interval_ms = atoi(optarg);
+				break;
+			case 'k':
+				options.auth_key = optarg;
+				break;
+			case 'n':
+				options.request_qty = atoi(optarg);
+				break;
+			case 'p':
+				server_port = atoi(optarg);
+				break;
+			case 'H':
+				options.host = optarg;
+				break;
+			case 'P':
+				server_pid = atoi(optarg);
+				break;
+			default:
+				print_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	
+	if(client_qty < 1 || options.request_qty < 1 || options.interval_ms < 0 || server_port <= 0 || server_port > 65535) {
+		LOG_FATAL("Invalid parameter.");
+		exit(EXIT_FAILURE);
+	}
+	
+	for(int i = optind; i < argc && options.url_qty < BENCHMARK_MAX_URLS; i++)
+		options.urls[options.url_qty++] = argv[i];
+	
+	if(options.url_qty == 0)
+		options.urls[options.url_qty++] = "/dashboard";
+	
+	options.address.sin_family = AF_INET;
+	options.address.sin_port = htons(server_port);
+	
+	if(inet_pton(AF_INET, options.host, &options.address.sin_addr) != 1) {
+		LOG_FATAL("Invalid server address: %s", options.host);
+		exit(EXIT_FAILURE);
+	}
+	
+	if((clients = (client_ctx_t*) calloc(client_qty, sizeof(client_ctx_t))) == NULL || (latencies = (double*) malloc(sizeof(double) * client_qty * options.request_qty)) == NULL) {
+		LOG_FATAL("Failed to allocate memory for clients.");
+		exit(EXIT_FAILURE);
+	}
+	
+	if(server_pid > 0) {
+		if(read_process_usage(server_pid, &usage) < 0) {
+			LOG_FATAL("Failed to read memory usage of process %d.", (int) server_pid);
+			exit(EXIT_FAILURE);
+		}
+		
+		print_process_usage("before", &usage);
+		
+		memset(&sampler, 0, sizeof(sampler));
+		sampler.pid = server_pid;
+		sampler.peak = usage;
+		
+		pthread_create(&sampler.thread, NULL, sampler_loop, &sampler);
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	
+	/* Os resultados de cada cliente são gravados na sua parte do vetor de latências */
+	for(int c = 0; c < client_qty; c++) {
+		clients[c].id = c;
+		clients[c].options = &options;
+		clients[c].latencies_us = &latencies[c * options.request_qty];
+		
+		pthread_create(&clients[c].thread, NULL, client_loop, &clients[c]);
+	}
+	
+	for(int c = 0; c < client_qty; c++) {
+		pthread_join(clients[c].thread, NULL);
+		
+		// Compacta as latências para ordenar todas juntas
+		memmove(&latencies[latency_qty], clients[c].latencies_us, sizeof(double) * clients[c].request_count);
+		latency_qty += clients[c].request_count;
+		
+		error_qty += clients[c].error_count;
+		status_error_qty += clients[c].status_error_count;
+		reconnect_qty += clients[c].reconnect_count;
+		received_bytes += clients[c].received_bytes;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	elapsed_s = elapsed_us(&start_time, &end_time) / 1e6;
+	
+	qsort(latencies, latency_qty, sizeof(double), compare_double);
+	
+	printf("Clients: %d, requests per client: %d, urls: %d\n", client_qty, options.request_qty, options.url_qty);
+	printf("Completed: %d in %.2lf s (%.1lf requests/s, %.1lf KiB/s), connection errors: %d, reconnections: %d, non-2xx/304: %d\n",
+			latency_qty, elapsed_s, latency_qty / elapsed_s, received_bytes / 1024.0 / elapsed_s, error_qty, reconnect_qty, status_error_qty);
+	printf("Latency ms: p50 %.2lf, p95 %.2lf, p99 %.2lf, max %.2lf\n",
+			percentile(latencies, latency_qty, 0.50) / 1e3, percentile(latencies, latency_qty, 0.95) / 1e3,
+			percentile(latencies, latency_qty, 0.99) / 1e3, (latency_qty > 0) ? latencies[latency_qty - 1] / 1e3 : 0.0);
+	
+	if(server_pid > 0) {
+		sampler.terminate = 1;
+		pthread_join(sampler.thread, NULL);
+		
+		print_process_usage("peak", &sampler.peak);
+		
+		if(read_process_usage(server_pid, &usage) == 0)
+			print_process_usage("after", &usage);
+	}
+	
+	free(clients);
+	free(latencies);
+	
+	return 0;
+}
@@ -16,3 +16,52 @@ window.smceeNavbarMenuItems = [
 		{name: "Assinaturas", href: "signatures.html"},
 	]}
 ];
+
+/* Interpreta a resposta de /power no formato binário (format=bin): cabeçalho "TCPD" seguido de blocos com a
+ * coluna de timestamps e as colunas de valores. Retorna os timestamps e as colunas em typed arrays, ou null se
+ * a resposta for inválida ou estiver incompleta. */
+function parsePowerDataBinary(arrayBuffer) {
+	var view = new DataView(arrayBuffer);
+	var columnQty, totalQty = 0, offset, blockQty, blockSize, pos = 0;
+	var result = {timestamps: null, columns: []};
+	
+	if(arrayBuffer.byteLength < 8 || String.fromCharCode(view.getUint8(0), view.getUint8(1), view.getUint8(2), view.getUint8(3)) !== "TCPD" || view.getUint16(4, true) !== 1)
+		return null;
+	
+	columnQty = view.getUint16(6, true);
+	
+	/* Confere que todos os blocos estão completos e que existe o bloco final vazio antes de ler os dados */
+	for(offset = 8; ; offset += blockSize) {
+		if(offset + 4 > arrayBuffer.byteLength)
+			return null;
+		
+		blockQty = view.getUint32(offset, true);
+		blockSize = 4 + blockQty * 4 * (1 + columnQty);
+		
+		if(offset + blockSize > arrayBuffer.byteLength)
+			return null;
+		
+		if(blockQty === 0)
+			break;
+		
+		totalQty += blockQty;
+	}
+	
+	result.timestamps = new Uint32Array(totalQty);
+	
+	for(let j = 0; j < columnQty; j++)
+		result.columns.push(new Float32Array(totalQty));
+	
+	for(offset = 8; offset + 4 <= arrayBuffer.byteLength && (blockQty = view.getUint32(offset, true)) > 0; offset += 4 + blockQty * 4 * (1 + columnQty)) {
+		for(let i = 0; i < blockQty; i++) {
+			result.timestamps[pos + i] = view.getUint32(offset + 4 + i * 4, true);
+			
+			for(let j = 0; j < columnQty; j++)
+				result.columns[j][pos + i] = view.getFloat32(offset + 4 + ((1 + j) * blockQty + i) * 4, true);
+		}
+		
+		pos += blockQty;
+	}
+	
+	return result;
+}
@@ -65,26 +65,26 @@ function fetchPowerData(secondQty) {
 	
 	xhrFetchData.onload = function() {
 		if(this.status === 200) {
-			var responseObject = JSON.parse(this.responseText);
+			var powerData = parsePowerDataBinary(this.response);
 			var lastTimestamp = null;
 			
 			window.smceePowerData = [];
 			
-			if(responseObject.length < 1)
+			if(powerData === null || powerData.timestamps.length < 1)
 				return;
 			
-			window.smceeDataStartTimestamp = responseObject[0][0];
-			window.smceeDataEndTimestamp = responseObject[responseObject.length - 1][0];
+			window.smceeDataStartTimestamp = powerData.timestamps[0];
+			window.smceeDataEndTimestamp = powerData.timestamps[powerData.timestamps.length - 1];
 			
 			window.smceePowerData.push([new Date((smceeDataEndTimestamp - secondQty - 1) * 1000), null]);
 			
-			for(let pdItem of responseObject) {
-				if(lastTimestamp !== null && pdItem[0] - lastTimestamp > 1)
+			for(let i = 0; i < powerData.timestamps.length; i++) {
+				if(lastTimestamp !== null && powerData.timestamps[i] - lastTimestamp > 1)
 					window.smceePowerData.push([new Date((lastTimestamp + 1) * 1000), null]);
 				
-				window.smceePowerData.push([new Date(pdItem[0] * 1000), pdItem[1]]);
+				window.smceePowerData.push([new Date(powerData.timestamps[i] * 1000), powerData.columns[0][i]]);
 				
-				lastTimestamp = pdItem[0];
+				lastTimestamp = powerData.timestamps[i];
 			}
 			
 			window.smceePowerData.push([new Date((lastTimestamp + 1) * 1000), null]);
@@ -100,7 +100,9 @@ function fetchPowerData(secondQty) {
 		}
 	}
 	
-	xhrFetchData.open("GET", window.smceeApiUrlBase + "power?type=pt&last=" + secondQty);
+	xhrFetchData.open("GET", window.smceeApiUrlBase + "power?type=pt&format=bin&last=" + secondQty);
+	
+	xhrFetchData.responseType = "arraybuffer";
 	
 	xhrFetchData.timeout = 2000;
 	
@@ -114,12 +116,12 @@ function fetchVoltageData() {
 	
 	xhrFetchData.onload = function() {
 		if(this.status === 200) {
-			var responseObject = JSON.parse(this.responseText);
+			var powerData = parsePowerDataBinary(this.response);
 			var lastTimestamp = null;
 			
 			window.smceeVoltageData = [];
 			
-			if(responseObject.length < 1)
+			if(powerData === null || powerData.timestamps.length < 1)
 				return;
 			
 			document.getElementById("button-show-voltage-container").parentNode.classList.add("is-hidden");
@@ -127,13 +129,13 @@ function fetchVoltageData() {
 			
 			window.smceeVoltageData.push([new Date((window.smceeDataEndTimestamp - 1) * 1000), null, null]);
 			
-			for(let pdItem of responseObject) {
-				if(lastTimestamp !== null && pdItem[0] - lastTimestamp > 1)
+			for(let i = 0; i < powerData.timestamps.length; i++) {
+				if(lastTimestamp !== null && powerData.timestamps[i] - lastTimestamp > 1)
 					window.smceeVoltageData.push([new Date((lastTimestamp + 1) * 1000), null, null]);
 				
-				window.smceeVoltageData.push([new Date(pdItem[0] * 1000), pdItem[2], pdItem[3]]);
+				window.smceeVoltageData.push([new Date(powerData.timestamps[i] * 1000), powerData.columns[1][i], powerData.columns[2][i]]);
 				
-				lastTimestamp = pdItem[0];
+				lastTimestamp = powerData.timestamps[i];
 			}
 			
 			window.smceeVoltageData.push([new Date((lastTimestamp + 1) * 1000), null, null]);
@@ -148,7 +150,9 @@ function fetchVoltageData() {
 		}
 	}
 	
-	xhrFetchData.open("GET", window.smceeApiUrlBase + "power?type=ptv&start=" + window.smceeDataStartTimestamp + "&end=" + window.smceeDataEndTimestamp);
+	xhrFetchData.open("GET", window.smceeApiUrlBase + "power?type=ptv&format=bin&start=" + window.smceeDataStartTimestamp + "&end=" + window.smceeDataEndTimestamp);
+	
+	xhrFetchData.responseType = "arraybuffer";
 	
 	xhrFetchData.timeout = 2000;
 	